@@ -18,6 +18,7 @@
 // --sim-end (value)
 // --histogram-len (number of bars on histogram)
 // --svg (filename - produces an animated svg)
+// --trace (filename - replays recorded passengers instead, see below)
 
 #define CAR_DELAY       "100" // string, milliseconds
 #define CARS            1
@@ -35,6 +36,10 @@ static double svg_timescale = 10.0;
 // at a random floor with an intended destination of
 // another random floor
 
+// A trace file has one passenger per line, "<time in ms> <from> <to>",
+// as written by tracegen. Blank lines and lines starting with # are ignored.
+// The trace replaces --num-passengers, --sim-start and --sim-end.
+
 typedef struct {
   char from[4], to[4], col[4];
   int delay;
@@ -99,6 +104,7 @@ static int sim_end = SIM_END;
 static int histogram_len = HISTOGRAM_LEN;
 static const char *svg = NULL;
 static const char *svg_anim_id = SVG_ANIM_ID;
+static const char *trace = NULL;
 
 static car_tracker *car_trackers;
 static passenger_data *pdata;
@@ -142,6 +148,7 @@ void init_args(int argc, char **argv)
         else if (strcmp(argv[i], "--svg")==0) svg = argv[i+1];
         else if (strcmp(argv[i], "--svg-anim-id")==0) svg_anim_id = argv[i+1];
         else if (strcmp(argv[i], "--svg-timescale")==0) svg_timescale = atof(argv[i+1]);
+        else if (strcmp(argv[i], "--trace")==0) trace = argv[i+1];
         else {
             fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
             exit(1);
@@ -149,9 +156,48 @@ void init_args(int argc, char **argv)
     }
 }
 
+void read_trace(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    int capacity = 64;
+    num_passengers = 0;
+    pdata = malloc(sizeof(passenger_data) * capacity);
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+        if (num_passengers == capacity) {
+            capacity *= 2;
+            pdata = realloc(pdata, sizeof(passenger_data) * capacity);
+        }
+        passenger_data *data = &pdata[num_passengers];
+        double time_ms;
+        if (sscanf(p, "%lf %3s %3s", &time_ms, data->from, data->to) != 3 || time_ms < 0) {
+            fprintf(stderr, "Invalid trace line: %s", line);
+            exit(1);
+        }
+        data->delay = (int)(time_ms * 1000.0);
+        num_passengers++;
+    }
+    fclose(fp);
+    if (num_passengers == 0) {
+        fprintf(stderr, "No passengers in trace: %s\n", filename);
+        exit(1);
+    }
+}
+
 int main(int argc, char **argv)
 {
     init_args(argc, argv);
+    if (trace != NULL) {
+        read_trace(trace);
+    } else {
+        pdata = malloc(sizeof(passenger_data) * num_passengers);
+    }
 
     srand(time(NULL));
     gettimeofday(&start_tv, NULL);
@@ -163,14 +209,15 @@ int main(int argc, char **argv)
         car(&car_trackers[i], carname, lowest_floor, highest_floor, car_delay);
     }
     pthread_t passengers[num_passengers];
-    pdata = malloc(sizeof(passenger_data) * num_passengers);
     for (int i = 0; i < num_passengers; i++) {
-        itf(pdata[i].from, rand_between(fti(lowest_floor), fti(highest_floor)));
-        for (;;) {
-            itf(pdata[i].to, rand_between(fti(lowest_floor), fti(highest_floor)));
-            if (strcmp(pdata[i].from, pdata[i].to) != 0) break;
+        if (trace == NULL) {
+            itf(pdata[i].from, rand_between(fti(lowest_floor), fti(highest_floor)));
+            for (;;) {
+                itf(pdata[i].to, rand_between(fti(lowest_floor), fti(highest_floor)));
+                if (strcmp(pdata[i].from, pdata[i].to) != 0) break;
+            }
+            pdata[i].delay = rand_between(sim_start * 1000, sim_end * 1000);
         }
-        pdata[i].delay = rand_between(sim_start * 1000, sim_end * 1000);
         int col = rand_between(0, 4095);
         sprintf(pdata[i].col, "%03x", col);
         col = rand_between(0, 2);
@@ -0,0 +1,86 @@
+#ifndef CARCONTROL_H
+#define CARCONTROL_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "sharedmemory.h"
+#include "cartimer.h"
+
+/**
+ * States of the car's door and movement state machine. Each state except
+ * CAR_IDLE matches the status string of the same name in shared memory.
+ */
+typedef enum
+{
+    CAR_IDLE,    // Stopped at a floor with the doors Closed
+    CAR_OPENING, // Doors opening
+    CAR_OPEN,    // Doors open
+    CAR_CLOSING, // Doors closing
+    CAR_MOVING   // Between floors
+} car_state_t;
+
+/**
+ * One car's state machine. The car sleeps on the shared condition variable
+ * and calls car_control_step when it is woken by a change or when the
+ * deadline returned by car_control_deadline passes. Consecutive timed steps
+ * are scheduled from each other's deadlines, not from when the car woke up.
+ *
+ * All fields are protected by the shared memory mutex.
+ */
+typedef struct
+{
+    shared_memory_t *shm;
+    int lowest_floor;
+    int highest_floor;
+    int delay_ms;            // Time for each door step and each floor moved
+
+    car_state_t state;
+    int direction;           // +1 or -1 while moving
+    bool timer_armed;
+    struct timespec deadline; // When the current timed step finishes
+    bool floor_requested;    // The controller asked for the floor the car is already on
+    timer_stats_t jitter;    // How late timed steps fired
+} car_control_t;
+
+/**
+ * Set up the state machine for a car whose shared memory is initialised.
+ *
+ * @param car The state machine.
+ * @param shm The car's shared memory.
+ * @param lowest_floor The lowest floor the car serves.
+ * @param highest_floor The highest floor the car serves.
+ * @param delay_ms The delay for each door step and floor.
+ */
+void car_control_init(car_control_t *car, shared_memory_t *shm, int lowest_floor, int highest_floor, int delay_ms);
+
+/**
+ * Run every transition that is due, given the buttons, destination and the
+ * time now. Must be called with the shared memory mutex held.
+ *
+ * @param car The state machine.
+ * @param now The current time on CARTIMER_CLOCK.
+ * @return true if the shared data was changed and waiters should be woken.
+ */
+bool car_control_step(car_control_t *car, const struct timespec *now);
+
+/**
+ * Get the time at which the next timed transition is due.
+ *
+ * @param car The state machine.
+ * @param deadline Set to the deadline if there is one.
+ * @return false if nothing is scheduled and the car can wait for a change.
+ */
+bool car_control_deadline(const car_control_t *car, struct timespec *deadline);
+
+/**
+ * Handle a FLOOR command from the controller. Must be called with the shared
+ * memory mutex held. Floors outside the car's range are ignored.
+ *
+ * @param car The state machine.
+ * @param floorlabel The requested floor.
+ * @return true if the shared data was changed and waiters should be woken.
+ */
+bool car_control_request_floor(car_control_t *car, char floorlabel[4]);
+
+#endif // CARCONTROL_H
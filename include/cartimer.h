@@ -0,0 +1,83 @@
+#ifndef CARTIMER_H
+#define CARTIMER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * All car timing uses CLOCK_MONOTONIC so deadlines are not moved by changes
+ * to the wall clock. The shared condition variable is set up on the same
+ * clock by init_shared_data, so these deadlines can be passed straight to
+ * pthread_cond_timedwait.
+ */
+#define CARTIMER_CLOCK CLOCK_MONOTONIC
+
+/**
+ * How late timed steps fired compared with their deadlines.
+ */
+typedef struct {
+    uint64_t count;     // Number of deadlines recorded
+    int64_t total_ns;   // Sum of lateness, for the mean
+    int64_t min_ns;     // Earliest firing (never negative in practice)
+    int64_t max_ns;     // Latest firing
+} timer_stats_t;
+
+/**
+ * @brief Reads the current time on CARTIMER_CLOCK.
+ */
+void cartimer_now(struct timespec *ts);
+
+/**
+ * @brief Adds a number of milliseconds to a time.
+ */
+void cartimer_add_ms(struct timespec *ts, long milliseconds);
+
+/**
+ * @brief Returns a - b in nanoseconds.
+ */
+int64_t cartimer_diff_ns(const struct timespec *a, const struct timespec *b);
+
+/**
+ * @brief Checks whether a deadline has been reached.
+ *
+ * @return true if now is at or after deadline.
+ */
+bool cartimer_reached(const struct timespec *now, const struct timespec *deadline);
+
+/**
+ * @brief Sleeps until an absolute deadline on CARTIMER_CLOCK, resuming the
+ * sleep if it is interrupted by a signal.
+ */
+void cartimer_sleep_until(const struct timespec *deadline);
+
+/**
+ * @brief Sleeps for a number of milliseconds.
+ */
+void cartimer_sleep_ms(long milliseconds);
+
+/**
+ * @brief Clears a set of jitter statistics.
+ */
+void timer_stats_init(timer_stats_t *stats);
+
+/**
+ * @brief Records how late a timed step fired.
+ *
+ * @param stats The statistics to update.
+ * @param deadline When the step was due.
+ * @param fired When the step actually ran.
+ */
+void timer_stats_record(timer_stats_t *stats, const struct timespec *deadline, const struct timespec *fired);
+
+/**
+ * @brief Prints a one line summary of the statistics in microseconds.
+ *
+ * @param stream Where to print.
+ * @param name Label for the line, usually the car name.
+ * @param stats The statistics to print.
+ */
+void timer_stats_print(FILE *stream, const char *name, const timer_stats_t *stats);
+
+#endif // CARTIMER_H
@@ -0,0 +1,136 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define CONNECTION_INITIAL_CAPACITY 256
+#define CONNECTION_MAX_CAPACITY 65536
+
+/**
+ * Where the frame parser is within the current length-prefixed message.
+ */
+typedef enum {
+    FRAME_READ_LENGTH, // Waiting for the 32-bit length prefix
+    FRAME_READ_BODY    // Waiting for frame_length bytes of message body
+} frame_state_t;
+
+/**
+ * Result of draining a socket into a connection's receive buffer.
+ */
+typedef enum {
+    CONNECTION_DRAINED, // The socket has no more data for now
+    CONNECTION_FULL,    // The buffer reached its limit, parse frames then fill again
+    CONNECTION_CLOSED,  // The peer hung up
+    CONNECTION_ERROR    // recv failed
+} connection_status_t;
+
+/**
+ * Per-connection context. Each socket gets its own receive buffer so a
+ * partially sent frame is kept until the rest arrives.
+ */
+typedef struct connection {
+    int fd;
+    bool listener;              // true for the listening socket
+
+    char *buffer;               // Growable receive buffer
+    size_t capacity;            // Allocated size of buffer
+    size_t length;              // Bytes currently held in buffer
+    size_t offset;              // Start of the bytes not yet parsed
+
+    frame_state_t state;
+    uint32_t frame_length;      // Body length of the frame being read
+
+    bool binary;                // The peer asked for binary frames (protocol.h)
+
+    // Bytes queued for the peer while its socket was full, sent when epoll
+    // reports it writable. Any thread may queue, so these are under out_lock.
+    pthread_mutex_t out_lock;
+    char *out;
+    size_t out_capacity;
+    size_t out_length;
+    int epoll_fd;               // The epoll instance watching the socket, -1 if none
+    uint32_t events;            // What it watches for, apart from EPOLLOUT
+} connection_t;
+
+/**
+ * @brief Allocates a connection context for a socket.
+ * 
+ * @param fd The socket file descriptor.
+ * @param listener true if the socket is a listening socket.
+ * @return The new connection, or NULL on allocation failure.
+ */
+connection_t *connection_create(int fd, bool listener);
+
+/**
+ * @brief Frees a connection context. The socket is not closed.
+ * 
+ * @param conn The connection to free.
+ */
+void connection_destroy(connection_t *conn);
+
+/**
+ * @brief Reads everything the (non-blocking) socket has into the receive buffer.
+ * 
+ * @param conn The connection to read into.
+ * @return The state of the socket after reading.
+ */
+connection_status_t connection_fill(connection_t *conn);
+
+/**
+ * @brief Extracts the next complete frame from the receive buffer.
+ * 
+ * @param conn The connection to parse.
+ * @param out Buffer that receives the NUL-terminated frame body.
+ * @param out_size The size of out. Longer frames are a protocol error.
+ * @return The frame length, 0 if no complete frame is buffered, or -1 on a protocol error.
+ */
+int connection_next_frame(connection_t *conn, char *out, size_t out_size);
+
+/**
+ * @brief Starts an epoll instance watching the socket for events, and for
+ * EPOLLOUT while anything is queued to send.
+ * 
+ * @param conn The connection.
+ * @param epoll_fd The epoll instance.
+ * @param events The events to watch for.
+ * @return false if epoll_ctl failed.
+ */
+bool connection_watch(connection_t *conn, int epoll_fd, uint32_t events);
+
+/**
+ * @brief Stops the connection's epoll instance watching the socket.
+ * 
+ * @param conn The connection.
+ */
+void connection_unwatch(connection_t *conn);
+
+/**
+ * @brief Sends bytes without ever waiting. Whatever the socket won't take
+ * now is queued, after anything already queued, and sent by
+ * connection_flush once epoll reports the socket writable. Safe to call from
+ * any thread.
+ * 
+ * @param conn The connection.
+ * @param data The bytes, normally a whole frame.
+ * @param length The number of bytes.
+ * @return false if the send failed, or more than CONNECTION_MAX_CAPACITY
+ *         bytes would be queued because the peer has stopped reading.
+ */
+bool connection_send(connection_t *conn, const void *data, size_t length);
+
+/**
+ * @brief Sends as much of the queue as the socket will take, and stops
+ * watching for EPOLLOUT once it is empty.
+ * 
+ * @param conn The connection.
+ * @return false if the send failed.
+ */
+bool connection_flush(connection_t *conn);
+
+#endif // CONNECTION_H
@@ -16,35 +16,99 @@ typedef enum {
     DIRECTION_IDLE
 } Direction;
 
-// Queue node for floor requests
+#define MAX_QUEUE_SIZE 50
+
+// Delay assumed for a car until its STATUS reports show how fast it really is
+#define DEFAULT_CAR_DELAY_MS 100
+
+// Delays spent at a stop: Opening, Open and Closing
+#define DOOR_STEPS 3
+
+// Words in a bitset with one bit per floor
+#define STOP_WORDS ((FLOOR_COUNT + 63) / 64)
+
+// Queue entry for floor requests
 typedef struct QueueNode {
     int floor;
     Direction direction;
-    struct QueueNode* next;
+    bool pickup;            // Someone gets on here, rather than off
+    int origin;             // For a drop-off, the floor they got on at
 } QueueNode;
 
 
 
+struct car_table;
+struct connection;
+
 typedef struct connectedcar {
     char name[50];
-    char highest_floor[4];
-    char lowest_floor[4];
+    // Floors are kept as the numbers returned by stringToFloor (B1 = -1) and
+    // only turned back into labels when a message is sent
+    int16_t highest_floor;
+    int16_t lowest_floor;
     char status[8];
     char previous_status[8];
-    char currentfloor[4];
-    char destinationfloor[4];
+    int16_t currentfloor;
+    int16_t destinationfloor;
+    int16_t reported_destination;   // Destination in the car's last STATUS, for STATUS_ONLY
     int connectionsocket;
+    struct connection* connection;  // Where FLOOR is queued, NULL outside the controller
+    bool binary;                // FLOOR is sent in the binary encoding (protocol.h)
     int available;
 
-    QueueNode* queue_head;
+    // Pending stops, a fixed ring so dispatch never touches the heap
+    QueueNode queue[MAX_QUEUE_SIZE];
+    size_t queue_start;
+    size_t queue_length;
     Direction current_direction;
+    // Bit floor - FLOOR_LOWEST of stops[direction] is set while a stop is
+    // queued at that floor heading that way
+    uint64_t stops[2][STOP_WORDS];
     Status elevator_status;
+
+    // Estimated from the time between STATUS reports, since CAR doesn't carry it
+    int64_t status_changed_ms;  // When the status or floor last changed
+    int delay_ms;               // Smoothed delay per step, 0 until measured
+
+    // The car's row in its controller's car_table_t, NULL while not in one
+    struct car_table* table;
+    size_t row;
 } connectedcar_t;
 
+/**
+ * The dispatch state of every car in a controller, one array per field, so
+ * the candidate filter and cost bound in controller_best_car run as one
+ * vectorisable loop instead of striding over whole connectedcar_t structs.
+ * Row i is data[i], kept up to date by the functions that change the car.
+ */
+typedef struct car_table {
+    int16_t* lowest_floor;
+    int16_t* highest_floor;
+    int16_t* start_floor;       // Where its stops are timed from: its floor, or the next if moving
+    int16_t* start_time;        // Car delays before it can leave start_floor
+    int16_t* queue_length;
+    int32_t* delay_ms;          // car_delay_estimate
+    int32_t* bound;             // Scratch for controller_best_car
+    size_t capacity;
+} car_table_t;
+
+#define INITIAL_CAPACITY 10
+
 typedef struct controller {
     size_t size;
     size_t capacity;
     connectedcar_t* data;
+
+    // Open-addressed hash table from car name to position in data, -1 if empty
+    int* name_index;
+    size_t name_index_capacity;
+
+    // Direct table from connection socket to position in data, -1 if no car
+    int* socket_index;
+    size_t socket_index_capacity;
+
+    // Hot dispatch state of the cars in data
+    car_table_t table;
 } controller_t;
 
 
@@ -55,6 +119,8 @@ bool can_service_request(connectedcar_t* car, int source_floor, int dest_floor);
 
 
 
+// Function to queue a pickup and drop-off where they cost the least, without
+// carrying anyone past their floor. False if the car's queue is full
 bool add_to_car_queue(connectedcar_t* car, int source_floor, int dest_floor);
 
 
@@ -64,10 +130,97 @@ int get_next_destination(connectedcar_t* car);
 // Function to remove current floor from queue when reached
 void remove_from_car_queue(connectedcar_t* car);
 
+// Function to check, without walking the queue, whether a car has a stop
+// queued at a floor heading the given way
+bool car_has_stop(const connectedcar_t* car, int floor, Direction direction);
+
 
 
 
 
+/**
+ * @brief Sets up a newly registered car, at rest on its lowest floor with an empty queue.
+ * 
+ * @param car The car to set up.
+ * @param name The car's name.
+ * @param lowest_floor The lowest floor the car serves.
+ * @param highest_floor The highest floor the car serves.
+ * @param connection_socket The socket the car is connected on.
+ */
+void connectedcar_init(connectedcar_t* car, const char* name, int lowest_floor, int highest_floor, int connection_socket);
+
+/**
+ * @brief Gets the delay per door step or floor to assume for a car.
+ * 
+ * @param car The car.
+ * @return The measured delay in milliseconds, or DEFAULT_CAR_DELAY_MS if none yet.
+ */
+int car_delay_estimate(const connectedcar_t* car);
+
+/**
+ * @brief Estimates the cost of giving a hall call to a car by playing its
+ * stop list forward with the pickup and drop-off inserted at the cheapest
+ * places: the time until the passenger is picked up, plus the time until they
+ * get off, plus the time the detour adds to every stop already queued.
+ * 
+ * @param car The car.
+ * @param source_floor The floor the passenger is waiting on.
+ * @param dest_floor The floor the passenger is going to.
+ * @return The cost in milliseconds.
+ */
+int64_t car_call_cost(const connectedcar_t* car, int source_floor, int dest_floor);
+
+/**
+ * @brief Finds the car with the lowest car_call_cost that can take a hall
+ * call, without queueing anything. A pass over the car table bounds every
+ * car's cost from below, and only the cars whose bound could beat the best
+ * so far are costed in full, so most of a large group is never costed.
+ * 
+ * @param controller A pointer to the controller.
+ * @param source_floor The floor the passenger is waiting on.
+ * @param dest_floor The floor the passenger is going to.
+ * @param cost Set to the chosen car's cost.
+ * @return The cheapest car, or NULL if no car can take the call.
+ */
+connectedcar_t* controller_best_car(const controller_t* controller, int source_floor, int dest_floor, int64_t* cost);
+
+/**
+ * @brief Chooses the car with the lowest car_call_cost to answer a hall call
+ * and queues the pickup and drop-off on it.
+ * 
+ * @param controller A pointer to the controller.
+ * @param source_floor The floor the passenger is waiting on.
+ * @param dest_floor The floor the passenger is going to.
+ * @return The chosen car, or NULL if no car can take the call.
+ */
+connectedcar_t* controller_assign_call(controller_t* controller, int source_floor, int dest_floor);
+
+/**
+ * @brief Gets the floor to send a car after a call was added to its queue.
+ * A car at rest is sent to its first stop, a car already heading somewhere
+ * is only redirected if the call was queued ahead of that stop.
+ * 
+ * @param car The car.
+ * @param next_floor Set to the floor to send the car to.
+ * @return true if the car should be sent a FLOOR message.
+ */
+bool car_dispatch_call(connectedcar_t* car, int* next_floor);
+
+/**
+ * @brief Applies a STATUS report from a car. When the car starts opening its
+ * doors at its next queued stop the stop is removed and the following one is
+ * returned.
+ * 
+ * @param car The car.
+ * @param status The reported status.
+ * @param current_floor The reported current floor.
+ * @param destination_floor The reported destination floor.
+ * @param now_ms When the report arrived, in milliseconds on a monotonic clock.
+ * @param next_floor Set to the floor to send the car to.
+ * @return true if the car should be sent a FLOOR message.
+ */
+bool car_update_status(connectedcar_t* car, const char* status, int current_floor, int destination_floor, int64_t now_ms, int* next_floor);
+
 /**
  * @brief Initializes the controller with an initial capacity.
  * 
@@ -106,12 +259,14 @@ void controller_copy(const controller_t* src, controller_t* dest);
 void controller_clear(controller_t* controller);
 
 /**
- * @brief Adds a new car to the controller.
+ * @brief Adds a new car to the controller, unless one with the same name is
+ * already in it.
  * 
  * @param controller A pointer to the controller.
  * @param new_car The new car to add.
+ * @return false if the car wasn't added.
  */
-void controller_push(controller_t* controller, const connectedcar_t* new_car);
+bool controller_push(controller_t* controller, const connectedcar_t* new_car);
 
 /**
  * @brief Removes the last car from the controller.
@@ -129,13 +284,33 @@ void controller_pop(controller_t* controller);
 connectedcar_t* controller_last(const controller_t* controller);
 
 /**
- * @brief Inserts a new car at a specific position in the controller.
+ * @brief Inserts a new car at a specific position in the controller, unless
+ * one with the same name is already in it.
  * 
  * @param controller A pointer to the controller.
  * @param pos The position to insert the new car.
  * @param new_car The new car to insert.
+ * @return false if the car wasn't inserted.
  */
-void controller_insert_at(controller_t* controller, size_t pos, const connectedcar_t* new_car);
+bool controller_insert_at(controller_t* controller, size_t pos, const connectedcar_t* new_car);
+
+/**
+ * @brief Finds a car by name using the name index.
+ * 
+ * @param controller A pointer to the controller.
+ * @param name The name of the car to search for.
+ * @return A pointer to the car, or NULL if not found. Only valid until the controller is next modified.
+ */
+connectedcar_t* controller_find_by_name(const controller_t* controller, const char* name);
+
+/**
+ * @brief Finds a car by its connection socket using the socket index.
+ * 
+ * @param controller A pointer to the controller.
+ * @param connection_socket The connection socket value to search for.
+ * @return A pointer to the car, or NULL if not found. Only valid until the controller is next modified.
+ */
+connectedcar_t* controller_find_by_socket(const controller_t* controller, int connection_socket);
 
 /**
  * @brief Gets the name of the car based on its connection socket value.
@@ -153,7 +328,7 @@ const char* controller_get_name_by_socket(const controller_t* controller, int co
  * @param name The name of the car to search for.
  * @return The connection socket of the car, or -1 if not found.
  */
-int controller_get_socket_by_name(const controller_t* controller,char name[50]);
+int controller_get_socket_by_name(const controller_t* controller, const char* name);
 /**
  * @brief Removes a car at a specific position in the controller.
  * 
@@ -162,6 +337,14 @@ int controller_get_socket_by_name(const controller_t* controller,char name[50]);
  */
 void controller_remove_by_name(controller_t* controller, const char* name);
 
+/**
+ * @brief Removes the car registered on a connection socket.
+ * 
+ * @param controller A pointer to the controller.
+ * @param connection_socket The connection socket of the car to remove.
+ */
+void controller_remove_by_socket(controller_t* controller, int connection_socket);
+
 /**
  * @brief Applies a callback function to each car in the controller.
  * 
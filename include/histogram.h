@@ -0,0 +1,28 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/**
+ * Summaries shared by the simulator and the benchmarks, which all collect
+ * int64_t samples and sort them for percentiles.
+ */
+
+/**
+ * @brief qsort comparator for int64_t samples, in ascending order.
+ */
+int compare_int64(const void *a, const void *b);
+
+/**
+ * @brief Prints samples as a text histogram of equal-width bars between
+ * the smallest and largest, one line per bar. Values are printed divided by
+ * 1000 (microseconds as milliseconds, or nanoseconds as microseconds), and a
+ * bar longer than 60 is scaled down to fit.
+ *
+ * @param values The samples.
+ * @param count The number of samples, at least 1.
+ * @param bars The most bars to draw; fewer if there are fewer samples.
+ */
+void histogram_print(const int64_t *values, int count, int bars);
+
+#endif // HISTOGRAM_H
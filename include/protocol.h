@@ -0,0 +1,130 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sharedmemory.h"
+
+/**
+ * Messages between cars, call pads and the controller. Every message is a
+ * frame with a 32-bit big-endian length prefix, and the body is either the
+ * original text command ("CALL B2 15", "STATUS Closing 7 9", "FLOOR 12",
+ * "CAR A 1 20") or a fixed layout binary encoding:
+ *
+ *   byte 0     opcode (message_type_t), below 0x20 so it can never be the
+ *              first letter of a text command
+ *   CALL       int16 source, int16 destination                  5 bytes
+ *   CAR        int16 lowest, int16 highest, name (no NUL)        5 + name
+ *   STATUS     uint8 status (Status), int16 current, int16 dest  6 bytes
+ *   FLOOR      int16 floor                                       3 bytes
+ *   ASSIGNED   name (no NUL), the reply to a CALL                1 + name
+ *   UNAVAILABLE, EMERGENCY, INDIVIDUAL SERVICE                   1 byte
+ *   STATUS_ONLY  uint8 status                                    2 bytes
+ *
+ * Floors are the numbers returned by stringToFloor, in network byte order.
+ *
+ * A client asks for the binary encoding in its first message, either by
+ * sending it in binary or by adding BINARY to the text command ("CAR A 1 20
+ * BINARY", "CALL 1 5 BINARY"). From then on the controller sends it binary
+ * frames. Both encodings are always accepted, so text tools keep working.
+ *
+ * Cars only report what changed (protocol_status_report). STATUS_ONLY is a
+ * STATUS whose floors are the ones last reported, which covers every door
+ * step; it has no text form, so text cars send the whole STATUS.
+ */
+
+#define PROTOCOL_NAME_LENGTH 50      // Including the NUL, as connectedcar_t's name
+#define PROTOCOL_MAX_FRAME 96        // Longest body of any message, either encoding
+
+typedef enum {
+    MSG_INVALID,
+    MSG_CALL,
+    MSG_CAR,
+    MSG_STATUS,
+    MSG_FLOOR,
+    MSG_ASSIGNED,       // "CAR {name}" reply to a CALL
+    MSG_UNAVAILABLE,
+    MSG_EMERGENCY,
+    MSG_SERVICE,        // "INDIVIDUAL SERVICE"
+    MSG_STATUS_ONLY,    // STATUS with the floors last reported, binary only
+    MSG_TYPE_COUNT
+} message_type_t;
+
+typedef struct {
+    message_type_t type;
+    bool binary;        // Sent in binary or asked for binary replies
+    Status status;      // STATUS
+    // CALL source and destination, CAR lowest and highest floor, STATUS
+    // current and destination floor, FLOOR floor
+    int16_t floor[2];
+    char name[PROTOCOL_NAME_LENGTH];  // CAR and ASSIGNED
+} message_t;
+
+/**
+ * @brief Decodes a frame body in either encoding.
+ *
+ * @param frame The frame body.
+ * @param length The length of the body.
+ * @param message Set to the message.
+ * @return false if the frame isn't a valid message.
+ */
+bool protocol_decode(const char *frame, size_t length, message_t *message);
+
+/**
+ * @brief Encodes a message.
+ *
+ * @param message The message.
+ * @param binary true for the binary encoding, false for text.
+ * @param frame Receives the frame body, at least PROTOCOL_MAX_FRAME bytes.
+ * @return The length of the body.
+ */
+size_t protocol_encode(const message_t *message, bool binary, char *frame);
+
+/**
+ * @brief Encodes a message as a whole frame, the length prefix followed by
+ * the body, ready to be written in one go.
+ *
+ * @param message The message.
+ * @param binary true for the binary encoding, false for text.
+ * @param frame Receives the frame, at least PROTOCOL_MAX_FRAME plus 4 bytes.
+ * @return The length of the frame, prefix included.
+ */
+size_t protocol_frame(const message_t *message, bool binary, char *frame);
+
+// How long protocol_send waits for a full socket to drain before giving up
+#define PROTOCOL_SEND_TIMEOUT_MS 1000
+
+/**
+ * @brief Sends a message as a length-prefixed frame. The prefix and body go
+ * out in one write: with two, Nagle holds the body back until the peer's
+ * delayed ACK of the prefix. A short write, or a full non-blocking socket,
+ * is retried until the whole frame is out.
+ *
+ * @param sockfd The socket.
+ * @param message The message.
+ * @param binary true for the binary encoding, false for text.
+ * @return false if the send failed, or the peer stopped reading for
+ *         PROTOCOL_SEND_TIMEOUT_MS.
+ */
+bool protocol_send(int sockfd, const message_t *message, bool binary);
+
+/**
+ * @brief Builds a car's next STATUS report, leaving out what the controller
+ * was last told. Clear last before the first report on a connection.
+ *
+ * @param data The car's shared memory, with its mutex held.
+ * @param last The last report on this connection, updated when one is due.
+ * @param binary true if the connection uses the binary encoding.
+ * @param heartbeat true to send the whole STATUS even if nothing changed.
+ * @param report Set to the message to send.
+ * @return false if there is nothing to report, or the status in shared
+ *         memory isn't a valid one.
+ */
+bool protocol_status_report(const car_shared_data_t *data, message_t *last, bool binary, bool heartbeat,
+                            message_t *report);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,73 @@
+#ifndef SAFETYCHECK_H
+#define SAFETYCHECK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sharedmemory.h"
+
+/**
+ * The safety checks on a car's shared memory, shared by the safety process
+ * (one car) and the safety supervisor (every car). A check only reruns the
+ * invariants whose fields changed since the last one, and returns what it
+ * found as SAFETY_* bits. Messages are printed in bit order.
+ */
+#define SAFETY_EMERGENCY_STOP   0x01u   // Emergency stop pressed, emergency mode set
+#define SAFETY_OVERLOAD         0x02u   // Overload tripped, emergency mode set
+#define SAFETY_DATA_ERROR       0x04u   // Any consistency error, emergency mode set
+#define SAFETY_FLOOR_ERROR      0x08u
+#define SAFETY_STATUS_ERROR     0x10u
+#define SAFETY_BUTTON_ERROR     0x20u
+#define SAFETY_DOOR_ERROR       0x40u
+#define SAFETY_FINDING_COUNT    7
+#define SAFETY_EMERGENCY        (SAFETY_EMERGENCY_STOP | SAFETY_OVERLOAD | SAFETY_DATA_ERROR)
+
+/**
+ * The message for each SAFETY_* bit, without a newline.
+ */
+extern const char *const safety_messages[SAFETY_FINDING_COUNT];
+
+/**
+ * What a car's last check saw: the fields, and the status and floor checks
+ * that only depend on one field, kept until that field changes.
+ */
+typedef struct
+{
+    car_snapshot_t fields;
+    Status status;
+    bool current_floor_valid;
+    bool destination_floor_valid;
+} safety_state_t;
+
+/**
+ * @brief Validates if the given floor string is in a valid format: digits,
+ * or 'B' followed by digits, at most 3 characters.
+ *
+ * @param floor The floor string to be validated.
+ * @return true if the floor string is valid, false otherwise.
+ */
+bool is_valid_floor(const char *floor);
+
+/**
+ * @brief Works out which fields differ between two copies of a car.
+ *
+ * @return SHM_DIRTY_* bits of the fields that differ.
+ */
+uint32_t safety_diff(const car_snapshot_t *last, const car_snapshot_t *now);
+
+/**
+ * @brief Runs the checks that depend on the changed fields, reopening
+ * obstructed doors and putting the car into emergency mode when needed,
+ * timestamped in emergency_at. The caller wakes the car.
+ * Fields that differ from the last check are rechecked even if they weren't
+ * marked, since the Test tools write the fields without marking them.
+ *
+ * @param state The car's state from the last check, updated.
+ * @param data The shared data, with the mutex held.
+ * @param changed SHM_DIRTY_* bits of the fields marked changed, or
+ *                SHM_DIRTY_ALL for the first check.
+ * @return SAFETY_* bits of what was found.
+ */
+uint32_t safety_check(safety_state_t *state, car_shared_data_t *data, uint32_t changed);
+
+#endif // SAFETYCHECK_H
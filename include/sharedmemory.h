@@ -9,6 +9,8 @@
 #include <semaphore.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -34,9 +36,56 @@ typedef struct
     uint8_t emergency_stop;          // 1 if stop button has been pressed, else 0
     uint8_t individual_service_mode; // 1 if in individual service mode, else 0
     uint8_t emergency_mode;          // 1 if in emergency mode, else 0
-    
+    _Atomic uint32_t seq;            // Odd while a writer is changing the fields above
+    _Atomic uint32_t dirty;          // SHM_DIRTY_* bits of the fields changed since the safety check
+    uint64_t dirty_at;               // CLOCK_MONOTONIC ns of the first change marked in dirty
+    // CLOCK_MONOTONIC ns of each stage of the last emergency, for faultbench
+    uint64_t fault_at;               // emergency_stop or overload set
+    uint64_t emergency_at;           // emergency_mode set by the safety checks
+    uint64_t reported_at;            // EMERGENCY sent to the controller
 } car_shared_data_t;
 
+/**
+ * Bits of car_shared_data_t.dirty, one per field. Writers mark the fields
+ * they change with shm_mark_dirty, so the safety monitor only rechecks the
+ * invariants those fields take part in.
+ */
+#define SHM_DIRTY_CURRENT_FLOOR          0x001u
+#define SHM_DIRTY_DESTINATION_FLOOR      0x002u
+#define SHM_DIRTY_STATUS                 0x004u
+#define SHM_DIRTY_OPEN_BUTTON            0x008u
+#define SHM_DIRTY_CLOSE_BUTTON           0x010u
+#define SHM_DIRTY_DOOR_OBSTRUCTION       0x020u
+#define SHM_DIRTY_OVERLOAD               0x040u
+#define SHM_DIRTY_EMERGENCY_STOP         0x080u
+#define SHM_DIRTY_INDIVIDUAL_SERVICE     0x100u
+#define SHM_DIRTY_EMERGENCY_MODE         0x200u
+#define SHM_DIRTY_ALL                    0x3ffu
+
+/**
+ * Set in dirty by the safety supervisor while it sleeps on the word as a
+ * futex. A writer that finds only this bit set wakes it.
+ */
+#define SHM_DIRTY_WATCHED                0x80000000u
+
+/**
+ * A consistent copy of the fields of car_shared_data_t, taken without the
+ * mutex by read_car_snapshot.
+ */
+typedef struct
+{
+    char current_floor[4];
+    char destination_floor[4];
+    char status[8];
+    uint8_t open_button;
+    uint8_t close_button;
+    uint8_t door_obstruction;
+    uint8_t overload;
+    uint8_t emergency_stop;
+    uint8_t individual_service_mode;
+    uint8_t emergency_mode;
+} car_snapshot_t;
+
 /**
  * A shared memory control structure.
  */
@@ -155,6 +204,13 @@ extern const char *status_names[NUM_STATUSES];
  */
 Status stringToStatus(const char *status_str);
 
+/**
+ * The range of floor numbers that have labels (B99 to 999).
+ */
+#define FLOOR_LOWEST -99
+#define FLOOR_HIGHEST 999
+#define FLOOR_COUNT (FLOOR_HIGHEST - FLOOR_LOWEST + 1)
+
 /**
  * Get the label for a floor. Make sure you free the label after use.
  *
@@ -167,9 +223,8 @@ void floorToString(char floorlabel[4], int floor);
  * Convert a floor label back to a floor number.
  *
  * @param floorlabel The string representing the floor.
- * @return The floor number.
+ * @return The floor number, or INT_MIN if the label is not a valid floor.
  */
-#define INT_MIN 999
 int stringToFloor(char floorlabel[4]);
 
 
@@ -183,6 +238,54 @@ bool get_shared_object(shared_memory_t *shm, const char *share_name);
 
 void print_shared_memory(shared_memory_t *shm);
 
+/**
+ * Writers bracket every change to the shared data with these, with the mutex
+ * held, so lock-free readers can tell when they raced with a write. seq is
+ * appended after the fields the Test tools know about, so their layout is
+ * unchanged. Tools that write without bumping seq are still seen by readers,
+ * just without the torn read protection.
+ *
+ * @param shm The shared memory object, with its mutex held.
+ */
+void shm_write_begin(shared_memory_t *shm);
+void shm_write_end(shared_memory_t *shm);
+
+/**
+ * The current CLOCK_MONOTONIC time in nanoseconds, as stored in the shared
+ * data's timestamps. The clock is the same in every process.
+ */
+uint64_t shm_timestamp(void);
+
+/**
+ * Mark fields as changed for the safety monitor. Like seq, dirty is past the
+ * fields the Test tools know about, and the monitor also compares the fields
+ * with the values it last checked, so tools that don't mark still get checked.
+ * The first change after the monitor's check is timestamped in dirty_at, and
+ * wakes the supervisor if it is waiting.
+ *
+ * @param shm The shared memory object, with its mutex held.
+ * @param fields SHM_DIRTY_* bits of the fields changed.
+ */
+void shm_mark_dirty(shared_memory_t *shm, uint32_t fields);
+
+/**
+ * Copy the fields of the shared data.
+ *
+ * @param data The shared data, with its mutex held.
+ * @param snapshot Receives the copy.
+ */
+void copy_car_snapshot(const car_shared_data_t *data, car_snapshot_t *snapshot);
+
+/**
+ * Take a consistent copy of the shared data without locking the mutex. The
+ * copy is retried if a writer was active, falling back to the mutex if a
+ * writer stays active for too long.
+ *
+ * @param shm The shared memory object.
+ * @param snapshot Filled with the copy.
+ */
+void read_car_snapshot(shared_memory_t *shm, car_snapshot_t *snapshot);
+
 
 
 
@@ -200,6 +303,28 @@ void print_shared_memory(shared_memory_t *shm);
      */
 bool edit_shared_memory(shared_memory_t *shm, car_op_t operation, int floor,Status status);
 
+/**
+ * One edit in a batch, with the same arguments as edit_shared_memory.
+ */
+typedef struct
+{
+    car_op_t operation;
+    int floor;
+    Status status;
+} shm_edit_t;
+
+/**
+ * Apply several edits as one change: a single lock, a single broadcast, and
+ * readers never see some of the edits without the rest. If any operation is
+ * not an edit nothing is applied.
+ *
+ * @param shm The shared memory object.
+ * @param edits The edits, applied in order.
+ * @param count The number of edits.
+ * @return true if the edits were applied, false otherwise.
+ */
+bool edit_shared_memory_batch(shared_memory_t *shm, const shm_edit_t *edits, size_t count);
+
 /**
      * For a condition operation read_shared_memory(shm, OP_GET_OPEN);
      * 
@@ -0,0 +1,77 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Discrete-event simulation of a building. The cars run the real car state
+ * machine (carcontrol.c) and the controller runs the real dispatch code
+ * (controllermemory.c), but time comes from a virtual clock that jumps
+ * straight to the next door, movement or passenger event instead of waiting.
+ */
+
+/**
+ * Where a simulated passenger is in their trip.
+ */
+typedef enum {
+    PASSENGER_PENDING,     // Has not called a car yet
+    PASSENGER_WAITING,     // Called, waiting for the assigned car
+    PASSENGER_RIDING,      // In the car
+    PASSENGER_ARRIVED,     // Got out at their destination
+    PASSENGER_UNAVAILABLE  // The controller answered UNAVAILABLE
+} passenger_state_t;
+
+/**
+ * One passenger. The caller fills in arrival_us, from and to, the simulation
+ * fills in the rest. Times are in microseconds of virtual time.
+ */
+typedef struct {
+    int64_t arrival_us;         // When the passenger calls a car
+    int from;                   // Floor numbers as returned by stringToFloor
+    int to;
+
+    passenger_state_t state;
+    int car;                    // Index of the car assigned, -1 if none
+    int64_t boarded_us;         // When the passenger got into the car
+    int64_t wait_us;            // From the call until the car was open on their floor
+    int64_t ride_us;            // From boarding until the car was open on their destination
+} sim_passenger_t;
+
+/**
+ * The building being simulated. Every car serves the same floors.
+ */
+typedef struct {
+    int cars;
+    int lowest_floor;
+    int highest_floor;
+    int delay_ms;               // Car delay, as passed to car
+    int64_t time_limit_us;      // Stop after this much virtual time, 0 to run until idle
+} sim_config_t;
+
+/**
+ * Totals for a run.
+ */
+typedef struct {
+    size_t arrived;             // Passengers that finished their trip
+    size_t unavailable;         // Calls that no car could take
+    size_t unfinished;          // Passengers still waiting or riding at the end
+    uint64_t events;            // Events processed
+    int64_t end_us;             // Virtual time of the last event
+} sim_summary_t;
+
+/**
+ * @brief Runs a simulation until every passenger has arrived or the time
+ * limit is reached.
+ *
+ * @param config The building.
+ * @param passengers The passengers, in any order. Results are written back.
+ * @param count The number of passengers.
+ * @param summary Filled with totals for the run.
+ * @return false if the configuration is invalid or memory ran out.
+ */
+bool simulation_run(const sim_config_t *config, sim_passenger_t *passengers, size_t count, sim_summary_t *summary);
+
+#endif // SIMULATION_H
@@ -0,0 +1,153 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Passenger traffic for the scheduling tests. A workload is a list of calls,
+ * either generated from a named traffic profile or read back from a trace
+ * file, so exactly the same load can be played against the real-time tester
+ * (Test/test-sched.c --trace) and the simulator.
+ *
+ * Trace files have one call per line, "<time in ms> <from> <to>", with the
+ * floors as labels (B1, 1, 2...). Blank lines and lines starting with # are
+ * ignored.
+ */
+
+/**
+ * Who is travelling where. "Upper" floors are all the floors except the
+ * lobby, basements included.
+ */
+typedef enum {
+    PROFILE_UNIFORM,     // Any floor to any other, as Test/test-sched.c does
+    PROFILE_UP_PEAK,     // Morning: mostly from the lobby up
+    PROFILE_DOWN_PEAK,   // Evening: mostly down to the lobby
+    PROFILE_LUNCH,       // Both ways between the lobby and the upper floors
+    PROFILE_INTERFLOOR   // Between upper floors only
+} workload_profile_t;
+
+/**
+ * When calls are made.
+ */
+typedef enum {
+    ARRIVALS_UNIFORM,    // count calls at uniformly random times in the window
+    ARRIVALS_POISSON     // A Poisson process at rate_per_minute over the window
+} workload_arrivals_t;
+
+typedef struct {
+    int64_t time_us;     // When the passenger calls, from the start of the run
+    int from;            // Floor numbers as returned by stringToFloor
+    int to;
+} workload_call_t;
+
+typedef struct {
+    workload_profile_t profile;
+    workload_arrivals_t arrivals;
+    int lowest_floor;
+    int highest_floor;
+    int lobby_floor;         // Floor 1 if served, otherwise the lowest floor
+    int64_t start_us;        // Calls are made from start_us to end_us
+    int64_t end_us;
+    size_t count;            // Number of calls for ARRIVALS_UNIFORM
+    double rate_per_minute;  // Calls per minute for ARRIVALS_POISSON
+
+    // How likely each floor is to be picked, relative to the others, indexed
+    // from lowest_floor. All 1 to start with.
+    double *weights;
+} workload_t;
+
+/**
+ * @brief Looks up a profile by name ("uniform", "up-peak", "down-peak",
+ * "lunch" or "interfloor").
+ *
+ * @param name The name.
+ * @param profile Set to the profile.
+ * @return false if there is no profile with that name.
+ */
+bool workload_profile_from_name(const char *name, workload_profile_t *profile);
+
+/**
+ * @brief Gets the name of a profile.
+ *
+ * @param profile The profile.
+ * @return The name, as accepted by workload_profile_from_name.
+ */
+const char *workload_profile_name(workload_profile_t profile);
+
+/**
+ * @brief Sets up a workload with equal floor weights and count uniformly
+ * timed calls between start_us and end_us.
+ *
+ * @param workload The workload.
+ * @param profile The traffic profile.
+ * @param lowest_floor The lowest floor served.
+ * @param highest_floor The highest floor served, above the lowest.
+ * @param start_us The earliest call.
+ * @param end_us The latest call.
+ * @param count The number of calls.
+ * @return false if the floors are invalid or memory ran out.
+ */
+bool workload_init(workload_t *workload, workload_profile_t profile, int lowest_floor, int highest_floor,
+                   int64_t start_us, int64_t end_us, size_t count);
+
+/**
+ * @brief Switches a workload to Poisson arrivals.
+ *
+ * @param workload The workload.
+ * @param rate_per_minute The average number of calls per minute.
+ */
+void workload_set_poisson(workload_t *workload, double rate_per_minute);
+
+/**
+ * @brief Sets floor weights from a list such as "5:3,B1:0.5". Floors not
+ * listed keep their weight.
+ *
+ * @param workload The workload.
+ * @param spec The list of floor:weight pairs.
+ * @return false if the list doesn't parse or names a floor out of range.
+ */
+bool workload_parse_weights(workload_t *workload, const char *spec);
+
+/**
+ * @brief Frees a workload's floor weights.
+ *
+ * @param workload The workload.
+ */
+void workload_destroy(workload_t *workload);
+
+/**
+ * @brief Generates the calls for a workload, in time order. The random
+ * numbers come from the caller's seed, so a run can be repeated and several
+ * can be generated side by side.
+ *
+ * @param workload The workload.
+ * @param seed The rand_r state, updated as numbers are drawn.
+ * @param calls Set to a malloc'd array of calls, which the caller frees.
+ * @param count Set to the number of calls.
+ * @return false if memory ran out.
+ */
+bool workload_generate(const workload_t *workload, unsigned int *seed, workload_call_t **calls, size_t *count);
+
+/**
+ * @brief Reads a trace file.
+ *
+ * @param file The file.
+ * @param calls Set to a malloc'd array of calls, which the caller frees.
+ * @param count Set to the number of calls.
+ * @return false if a line doesn't parse or memory ran out.
+ */
+bool workload_read_trace(FILE *file, workload_call_t **calls, size_t *count);
+
+/**
+ * @brief Writes calls as a trace file.
+ *
+ * @param file The file.
+ * @param calls The calls.
+ * @param count The number of calls.
+ */
+void workload_write_trace(FILE *file, const workload_call_t *calls, size_t count);
+
+#endif // WORKLOAD_H
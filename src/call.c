@@ -1,15 +1,48 @@
+#define _POSIX_C_SOURCE 200809L
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
 
 #include "sharedmemory.h"
+#include "connection.h"
+#include "protocol.h"
+#include "histogram.h"
+
+/**
+ * Usage: call {source floor} {destination floor}
+ *        call [--binary] --pad [file]
+ *        call [--binary] --rate calls/sec [--duration s] [--lowest-floor floor]
+ *             [--highest-floor floor] [--seed n]
+ *
+ * The first form makes one call and exits. --pad is a long-lived call pad:
+ * it keeps one connection open and sends a CALL for every "{source}
+ * {destination}" line read from stdin (or the file) as soon as it is read,
+ * without waiting for the replies to earlier calls. --rate generates random
+ * calls at a fixed rate for --duration seconds (default 10) over one
+ * connection and reports the rate achieved and the reply latencies.
+ * --binary sends the calls in the binary encoding (see protocol.h).
+ *
+ * The controller answers the calls on a connection in the order they were
+ * sent, so replies are matched to calls first in, first out.
+ */
 
 #define PORT 3000
 #define BUFFER_SIZE 1024
 #define IP "127.0.0.1"
+#define MAX_PENDING 4096   // Calls awaiting a reply before sending pauses
+#define DURATION 10        // seconds
+#define DRAIN_MS 2000      // How long to wait for the last replies
 int clientsockfd;
 
 // Function to create a socket and connect to the server
@@ -54,8 +87,386 @@ void handle_sigint(int sig) {
 }
 
 
+/**
+ * A call sent on the session connection that is waiting for its reply.
+ */
+typedef struct {
+    char source[4];
+    char destination[4];
+    struct timespec sent;
+} pending_call_t;
+
+/**
+ * State shared by the --pad and --rate modes.
+ */
+typedef struct {
+    connection_t *conn;
+    pending_call_t *pending;     // Ring of MAX_PENDING calls, oldest first
+    size_t pending_head;
+    size_t pending_count;
+    bool print_replies;          // --pad prints each reply as it arrives
+    bool binary;                 // Calls are sent in the binary encoding
+
+    size_t sent;
+    size_t cars;
+    size_t unavailable;
+    int64_t *latencies_ns;       // One per reply, for --rate
+    size_t latency_count;
+    size_t latency_capacity;
+} session_t;
+
+static void now_monotonic(struct timespec *ts) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static int64_t diff_ns(const struct timespec *a, const struct timespec *b) {
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+}
+
+// Send a whole length-prefixed frame on a non-blocking socket. The prefix and
+// body go out in one write so pipelined calls aren't held back by Nagle.
+static bool send_frame(int sockfd, const message_t *message, bool binary) {
+    char frame[sizeof(uint32_t) + PROTOCOL_MAX_FRAME];
+    size_t body = protocol_encode(message, binary, frame + sizeof(uint32_t));
+    uint32_t length = htonl((uint32_t)body);
+    size_t total = sizeof(length) + body;
+    memcpy(frame, &length, sizeof(length));
+
+    size_t done = 0;
+    while (done < total) {
+        ssize_t n = send(sockfd, frame + done, total - done, MSG_NOSIGNAL);
+        if (n > 0) {
+            done += (size_t)n;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {sockfd, POLLOUT, 0};
+            poll(&pfd, 1, -1);
+        } else if (n == -1 && errno != EINTR) {
+            perror("send");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool session_call(session_t *session, const char *source, const char *destination) {
+    message_t message = {.type = MSG_CALL, .floor = {(int16_t)stringToFloor((char *)source),
+                                                     (int16_t)stringToFloor((char *)destination)}};
+    if (!send_frame(session->conn->fd, &message, session->binary)) {
+        return false;
+    }
+    pending_call_t *call = &session->pending[(session->pending_head + session->pending_count) % MAX_PENDING];
+    strcpy(call->source, source);
+    strcpy(call->destination, destination);
+    now_monotonic(&call->sent);
+    session->pending_count++;
+    session->sent++;
+    return true;
+}
+
+// Match a reply to the oldest call still waiting for one
+static void session_reply(session_t *session, const char *reply, size_t length) {
+    message_t message;
+    if (!protocol_decode(reply, length, &message) ||
+        (message.type != MSG_ASSIGNED && message.type != MSG_UNAVAILABLE) || session->pending_count == 0) {
+        printf("Received message from server: %s \n", message.binary ? "(binary)" : reply);
+        return;
+    }
+    pending_call_t *call = &session->pending[session->pending_head];
+    session->pending_head = (session->pending_head + 1) % MAX_PENDING;
+    session->pending_count--;
+
+    struct timespec now;
+    now_monotonic(&now);
+    if (session->latency_count < session->latency_capacity) {
+        session->latencies_ns[session->latency_count++] = diff_ns(&now, &call->sent);
+    }
+
+    if (message.type == MSG_ASSIGNED) {
+        session->cars++;
+        if (session->print_replies) {
+            printf("%s %s: Car %s is on its way to pick you up.\n", call->source, call->destination, message.name);
+        }
+    } else {
+        session->unavailable++;
+        if (session->print_replies) {
+            printf("%s %s: Sorry, no car is available to take this request.\n", call->source, call->destination);
+        }
+    }
+    if (session->print_replies) {
+        fflush(stdout);
+    }
+}
+
+// Handle every reply that has arrived. Returns false once the connection is gone.
+static bool session_receive(session_t *session) {
+    char message[BUFFER_SIZE];
+    connection_status_t status;
+    do {
+        status = connection_fill(session->conn);
+        int frame_length;
+        while ((frame_length = connection_next_frame(session->conn, message, sizeof(message))) > 0) {
+            session_reply(session, message, (size_t)frame_length);
+        }
+        if (frame_length == -1) {
+            printf("Invalid response from elevator system.\n");
+            return false;
+        }
+    } while (status == CONNECTION_FULL);
+
+    if (status != CONNECTION_DRAINED) {
+        printf("Unable to connect to elevator system.\n");
+        return false;
+    }
+    return true;
+}
+
+// Wait up to timeout_ms for replies, then handle them
+static bool session_wait(session_t *session, int timeout_ms) {
+    struct pollfd pfd = {session->conn->fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready == -1 && errno != EINTR) {
+        perror("poll");
+        return false;
+    }
+    return ready <= 0 || session_receive(session);
+}
+
+// Set by --binary
+static bool use_binary = false;
+
+static void session_open(session_t *session, bool print_replies, size_t latency_capacity) {
+    memset(session, 0, sizeof(*session));
+    session->binary = use_binary;
+    int sockfd = connect_to_server();
+    int enable = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl");
+        exit(EXIT_FAILURE);
+    }
+    session->conn = connection_create(sockfd, false);
+    session->pending = malloc(MAX_PENDING * sizeof(pending_call_t));
+    session->latencies_ns = malloc((latency_capacity > 0 ? latency_capacity : 1) * sizeof(int64_t));
+    if (session->conn == NULL || session->pending == NULL || session->latencies_ns == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    session->latency_capacity = latency_capacity;
+    session->print_replies = print_replies;
+}
+
+static void session_close(session_t *session) {
+    close(session->conn->fd);
+    connection_destroy(session->conn);
+    free(session->pending);
+    free(session->latencies_ns);
+}
+
+// Check a pair of floor labels the way the single call does
+static bool valid_call(const char *source, const char *destination) {
+    int sourcefloor = stringToFloor((char *)source);
+    int destinationfloor = stringToFloor((char *)destination);
+    return sourcefloor != INT_MIN && destinationfloor != INT_MIN && sourcefloor != destinationfloor;
+}
+
+// --pad: send a call for every line of input as soon as it is read and print
+// the replies as they come back
+static int run_pad(const char *filename) {
+    int input = STDIN_FILENO;
+    if (filename != NULL && (input = open(filename, O_RDONLY)) == -1) {
+        perror("open");
+        exit(EXIT_FAILURE);
+    }
+
+    session_t session;
+    session_open(&session, true, 0);
+
+    char line[BUFFER_SIZE];
+    size_t line_length = 0;
+    bool input_open = true, connected = true;
+    while (connected && (input_open || session.pending_count > 0)) {
+        struct pollfd fds[2] = {{session.conn->fd, POLLIN, 0}, {input, POLLIN, 0}};
+        // Stop reading input while the pending ring is full
+        nfds_t nfds = (input_open && session.pending_count < MAX_PENDING) ? 2 : 1;
+        if (poll(fds, nfds, input_open ? -1 : DRAIN_MS) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        if (!input_open && fds[0].revents == 0) {
+            printf("No reply to %zu call(s).\n", session.pending_count);
+            break;
+        }
+        if (fds[0].revents != 0) {
+            connected = session_receive(&session);
+        }
+        if (nfds < 2 || fds[1].revents == 0) {
+            continue;
+        }
+
+        ssize_t n = read(input, line + line_length, sizeof(line) - 1 - line_length);
+        if (n <= 0) {
+            input_open = false;
+            if (line_length == 0) {
+                continue;
+            }
+            // Treat a last line without a newline as complete
+            line[line_length++] = '\n';
+        } else {
+            line_length += (size_t)n;
+        }
+
+        char *start = line, *end;
+        while (connected && (end = memchr(start, '\n', line_length - (size_t)(start - line))) != NULL) {
+            *end = '\0';
+            char source[4], destination[4];
+            char *p = start + strspn(start, " \t");
+            if (*p != '#' && *p != '\0') {
+                if (sscanf(p, "%3s %3s", source, destination) != 2 || !valid_call(source, destination)) {
+                    fprintf(stderr, "Invalid call: %s\n", p);
+                } else {
+                    connected = session_call(&session, source, destination);
+                }
+            }
+            start = end + 1;
+        }
+        line_length -= (size_t)(start - line);
+        memmove(line, start, line_length);
+        if (line_length == sizeof(line) - 1) {
+            fprintf(stderr, "Input line too long\n");
+            line_length = 0;
+        }
+    }
+
+    if (input != STDIN_FILENO) {
+        close(input);
+    }
+    session_close(&session);
+    return connected ? 0 : EXIT_FAILURE;
+}
+
+// --rate: make random calls at a fixed rate, whether or not the replies keep
+// up, and report the throughput and latency
+static int run_rate(double rate, int duration, const char *lowest, const char *highest, unsigned int seed) {
+    int low = stringToFloor((char *)lowest), high = stringToFloor((char *)highest);
+    if (rate <= 0 || duration <= 0 || low == INT_MIN || high == INT_MIN || low >= high) {
+        fprintf(stderr, "Invalid load parameters.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t total = (size_t)ceil(rate * duration);
+    session_t session;
+    session_open(&session, false, total);
+
+    struct timespec start, now, next;
+    now_monotonic(&start);
+    next = start;
+    int64_t interval_ns = (int64_t)(1e9 / rate);
+    bool connected = true;
+    while (connected && session.sent < total) {
+        now_monotonic(&now);
+        int64_t wait_ns = diff_ns(&next, &now);
+        if (wait_ns > 0 || session.pending_count == MAX_PENDING) {
+            int timeout = (session.pending_count == MAX_PENDING) ? -1 : (int)((wait_ns + 999999) / 1000000);
+            connected = session_wait(&session, timeout);
+            continue;
+        }
+
+        char source[4], destination[4];
+        int from, to;
+        do {
+            from = low + rand_r(&seed) % (high - low + 1);
+            to = low + rand_r(&seed) % (high - low + 1);
+        } while (from == 0 || to == 0 || from == to);
+        floorToString(source, from);
+        floorToString(destination, to);
+        connected = session_call(&session, source, destination) && session_receive(&session);
+
+        // Schedule from the plan, not from when this call went out
+        next.tv_nsec += interval_ns;
+        next.tv_sec += next.tv_nsec / 1000000000;
+        next.tv_nsec %= 1000000000;
+    }
+    struct timespec sent_all;
+    now_monotonic(&sent_all);
+    while (connected && session.pending_count > 0) {
+        struct timespec before;
+        now_monotonic(&before);
+        connected = session_wait(&session, DRAIN_MS);
+        now_monotonic(&now);
+        if (diff_ns(&now, &before) >= (int64_t)DRAIN_MS * 1000000) {
+            break;
+        }
+    }
+    now_monotonic(&now);
+
+    double sending = (double)diff_ns(&sent_all, &start) / 1e9;
+    double elapsed = (double)diff_ns(&now, &start) / 1e9;
+    size_t replies = session.cars + session.unavailable;
+    printf("Sent %zu calls in %.2fs (%.1f calls/sec, target %.1f)\n", session.sent, sending,
+           sending > 0 ? (double)session.sent / sending : 0.0, rate);
+    printf("Received %zu replies in %.2fs (%.1f replies/sec), %zu unavailable, %zu unanswered\n", replies,
+           elapsed, elapsed > 0 ? (double)replies / elapsed : 0.0, session.unavailable, session.pending_count);
+    if (session.latency_count > 0) {
+        qsort(session.latencies_ns, session.latency_count, sizeof(int64_t), compare_int64);
+        static const double ranks[] = {0.50, 0.95, 0.99, 1.0};
+        static const char *names[] = {"p50", "p95", "p99", "max"};
+        printf("Reply latency:");
+        for (int i = 0; i < 4; i++) {
+            size_t rank = (size_t)ceil(ranks[i] * (double)session.latency_count);
+            printf(" %s %.1fus", names[i], (double)session.latencies_ns[rank > 0 ? rank - 1 : 0] / 1000.0);
+        }
+        printf("\n");
+    }
+    session_close(&session);
+    return connected ? 0 : EXIT_FAILURE;
+}
+
+static int run_session(int argc, char *argv[]) {
+    if (strcmp(argv[1], "--binary") == 0 && argc >= 3) {
+        use_binary = true;
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+    if (strcmp(argv[1], "--pad") == 0) {
+        if (argc > 3) {
+            fprintf(stderr, "Usage: %s --pad [file]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        return run_pad(argc == 3 ? argv[2] : NULL);
+    }
+
+    double rate = 0;
+    int duration = DURATION;
+    const char *lowest = "1", *highest = "10";
+    unsigned int seed = (unsigned int)time(NULL);
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(argv[i], "--rate") == 0) rate = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--duration") == 0) duration = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--lowest-floor") == 0) lowest = argv[i + 1];
+        else if (strcmp(argv[i], "--highest-floor") == 0) highest = argv[i + 1];
+        else if (strcmp(argv[i], "--seed") == 0) seed = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+        else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return run_rate(rate, duration, lowest, highest, seed);
+}
+
 int main(int argc, char *argv[]) {
     signal(SIGINT,handle_sigint);
+    if (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+        return run_session(argc, argv);
+    }
     //TCP Variables
     int clientsockfd;
     char buffer[BUFFER_SIZE];
@@ -89,6 +500,11 @@ int main(int argc, char *argv[]) {
     int destinationfloor = stringToFloor(argv[2]);
     //printf("Destination floor: %d\n", destinationfloor);
 
+    if (sourcefloor == INT_MIN || destinationfloor == INT_MIN) {
+        fprintf(stderr, "Invalid floor(s) specified.\n");
+        exit(EXIT_FAILURE);
+    }
+
     if(sourcefloor == destinationfloor){
         printf("You are already on that floor!\n");
         exit(EXIT_FAILURE);
@@ -11,41 +11,51 @@
 #include <time.h>
 
 #include "sharedmemory.h"
+#include "cartimer.h"
+#include "carcontrol.h"
+#include "protocol.h"
 
 
 // TCP Variables
 #define PORT 3000
 #define BUFFER_SIZE 1024
-int clientsockfd;
+int clientsockfd = -1;            // Connected socket, -1 while disconnected
 char carname[256];
-uint32_t length;
+// Last state reported to the controller and when, protected by the shared
+// memory mutex
+message_t last_report;
+struct timespec last_report_at;
+// Options: resend the whole STATUS every heartbeat_ms even if nothing changed
+// (0 for never), and talk to the controller in the binary encoding
+int heartbeat_ms = 0;
+bool use_binary = false;
 
 // Struct for passing data to threads
 typedef struct {
     char buffer[BUFFER_SIZE];
     int delaytime;
-    ssize_t bytes_read;
     char lowest_floor[4];           // C string in the range B99-B1 and 1-999
     char highest_floor[4];          // Same format as above  
-
-    //flags
-    int read_flag;
+    int lowest_floor_number;        // lowest_floor parsed once at startup
+    int highest_floor_number;       // highest_floor parsed once at startup
 } thread_data_t;
 
 // Shared memory object for this car
 shared_memory_t cardata;
-pthread_t doorcontrol_thread_tid, tcp_communication_tid, process_tid;
+// Door and movement state machine, protected by the shared memory mutex
+car_control_t car_control;
+pthread_t control_tid, tcp_communication_tid;
 volatile int thread_stop_signal = 0;
 volatile int delaytime = 0;
-#define carwait sleep((double)delaytime/1000);
 // TCP Function
 // Function to create a socket and connect to the server
 int connect_to_server() {
     struct sockaddr_in server_address;
+    int sockfd;
 
     // Create socket
-    clientsockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (clientsockfd == -1) {
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
         perror("socket");
         exit(EXIT_FAILURE);
     }
@@ -57,23 +67,21 @@ int connect_to_server() {
     // Convert IPv4 and IPv6 addresses from text to binary form
     if (inet_pton(AF_INET, "127.0.0.1", &server_address.sin_addr) <= 0) {
         perror("inet_pton");
-        close(clientsockfd);
+        close(sockfd);
         exit(EXIT_FAILURE);
     }
 
     // Connect to the server
-    while(connect(clientsockfd, (struct sockaddr *)&server_address, sizeof(server_address)) == -1) {
+    while(connect(sockfd, (struct sockaddr *)&server_address, sizeof(server_address)) == -1) {
         if(thread_stop_signal) {
-            if (clientsockfd != -1){
-            close(clientsockfd);
-            }       
+            close(sockfd);
             exit(EXIT_SUCCESS);
         }
         //printf("Unable to connect to elevator system. Retrying in %0.1lf seconds...\n",(double)delaytime/1000);
-        carwait 
+        cartimer_sleep_ms(delaytime);
     }
 
-    return clientsockfd;
+    return sockfd;
 }
 
 // Signal handler for graceful termination
@@ -86,390 +94,194 @@ void handle_sigint(int sig) {
             close(clientsockfd);
         }
         //terminate threads
-        pthread_cancel(doorcontrol_thread_tid);
+        pthread_cancel(control_tid);
         pthread_cancel(tcp_communication_tid);
-        pthread_cancel(process_tid);
 
-        pthread_join(doorcontrol_thread_tid, NULL);
+        pthread_join(control_tid, NULL);
         pthread_join(tcp_communication_tid, NULL);
-        pthread_join(process_tid, NULL);
 
+        timer_stats_print(stdout, carname, &car_control.jitter);
         destroy_shared_object(&cardata);
         exit(EXIT_SUCCESS);
     }
 }
 
-void add_milliseconds_to_timespec(struct timespec *ts, long milliseconds) {
-    ts->tv_sec += milliseconds / 1000;
-    ts->tv_nsec += (milliseconds % 1000) * 1000000;
-    if (ts->tv_nsec >= 1000000000) {
-        ts->tv_sec += 1;
-        ts->tv_nsec -= 1000000000;
-    }
+// Cancellation cleanup for threads cancelled while waiting on the condition variable
+void unlock_shared_mutex(void *arg) {
+    pthread_mutex_unlock((pthread_mutex_t *)arg);
 }
 
-// Thread function for internal control
-void *doorcontrol_thread(void *arg) {
-    while (thread_stop_signal != 1) {
-        //printf("\e[1;1H\e[2J");
-        //print_shared_memory(&cardata);
-        //carwait
-        if(read_shared_memory(&cardata, OP_GET_OPEN)){
-            operate_door();
-        }
-    }
-    return NULL;
+// Drop the controller connection. The TCP thread sees the socket close,
+// releases it and reconnects once the car is back in normal service.
+void disconnect_from_server(void) {
+    shutdown(clientsockfd, SHUT_RDWR);
+    clientsockfd = -1;
 }
 
-// Thread function for TCP communication
-void *tcp_communication_thread(void *arg) {
-    thread_data_t *threaddata = arg;
-    int connected = 0;
-
-    while (thread_stop_signal != 1) {
-        clientsockfd = connect_to_server();
-
-        pthread_mutex_lock(&cardata.data->mutex);
-        if(cardata.data->emergency_mode != 1 || cardata.data->individual_service_mode != 1){   
-            snprintf(threaddata->buffer, BUFFER_SIZE, "CAR %s %s %s \n", carname, threaddata->lowest_floor, threaddata->highest_floor);
-            length = htonl(strlen(threaddata->buffer));
-            if (send(clientsockfd, &length, sizeof(length), 0) == -1) {
-                perror("send");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
-
-            if (send(clientsockfd, threaddata->buffer, strlen(threaddata->buffer), 0) == -1) {
-                perror("send");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
+// Get the time the next heartbeat is due. Returns false if heartbeats are off.
+bool heartbeat_deadline(struct timespec *deadline) {
+    if (heartbeat_ms <= 0 || clientsockfd == -1) {
+        return false;
+    }
+    *deadline = last_report_at;
+    cartimer_add_ms(deadline, heartbeat_ms);
+    return true;
+}
 
-            snprintf(threaddata->buffer, BUFFER_SIZE, "STATUS %s %s %s \n", cardata.data->status, cardata.data->current_floor, cardata.data->destination_floor);
-            length = htonl(strlen(threaddata->buffer));
-            if (send(clientsockfd, &length, sizeof(length), 0) == -1) {
-                perror("send");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
+// Send the car's state if it changed since the last report, or all of it
+// if the heartbeat is due. Returns false if the send failed.
+bool send_status(int sockfd, const struct timespec *now) {
+    struct timespec heartbeat;
+    bool heartbeat_due = heartbeat_deadline(&heartbeat) && cartimer_reached(now, &heartbeat);
+    message_t report;
+    if (!protocol_status_report(cardata.data, &last_report, use_binary, heartbeat_due, &report)) {
+        return true;
+    }
+    last_report_at = *now;
+    return protocol_send(sockfd, &report, use_binary);
+}
 
-            if (send(clientsockfd, threaddata->buffer, strlen(threaddata->buffer), 0) == -1) {
-                perror("send");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
+// Report the car's state to the controller. Must be called with the shared
+// memory mutex held.
+void report_to_server(const struct timespec *now) {
+    message_t message = {.type = MSG_INVALID};
 
-            connected = 1;
+    if (clientsockfd == -1) {
+        return;
+    }
+    if (cardata.data->emergency_mode == 1) {
+        message.type = MSG_EMERGENCY;
+    } else if (cardata.data->individual_service_mode == 1) {
+        message.type = MSG_SERVICE;
+    }
+    if (message.type != MSG_INVALID) {
+        if (protocol_send(clientsockfd, &message, use_binary) && message.type == MSG_EMERGENCY) {
+            cardata.data->reported_at = shm_timestamp();
         }
-        pthread_mutex_unlock(&cardata.data->mutex);
-
-        while(connected == 1 && thread_stop_signal != 1) {
-            pthread_mutex_lock(&cardata.data->mutex);
-            if(cardata.data->emergency_mode == 1){
-                snprintf(threaddata->buffer, BUFFER_SIZE, "EMERGENCY");
-                length = htonl(strlen(threaddata->buffer));
-                if (send(clientsockfd, &length, sizeof(length), 0) == -1) {
-                    perror("send");
-                    connected = 0;
-                    pthread_mutex_unlock(&cardata.data->mutex);
-                    close(clientsockfd);
-                    continue;
-                }
-
-                if (send(clientsockfd, threaddata->buffer, strlen(threaddata->buffer), 0) == -1) {
-                    perror("send");
-                    connected = 0;
-                    pthread_mutex_unlock(&cardata.data->mutex);
-                    close(clientsockfd);
-                    continue;
-                }
-
-                close(clientsockfd);
-                connected = 0;
-            }
-
-            if(cardata.data->individual_service_mode == 1){
-                snprintf(threaddata->buffer, BUFFER_SIZE, "INDIVIDUAL SERVICE");
-                length = htonl(strlen(threaddata->buffer));
-                if (send(clientsockfd, &length, sizeof(length), 0) == -1) {
-                    perror("send");
-                    connected = 0;
-                    pthread_mutex_unlock(&cardata.data->mutex);
-                    close(clientsockfd);
-                    continue;
-                }
-
-                if (send(clientsockfd, threaddata->buffer, strlen(threaddata->buffer), 0) == -1) {
-                    perror("send");
-                    connected = 0;
-                    pthread_mutex_unlock(&cardata.data->mutex);
-                    close(clientsockfd);
-                    continue;
-                }
-
-                close(clientsockfd);
-                connected = 0;
-            }
-
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            add_milliseconds_to_timespec(&ts, delaytime);
-            while (cardata.shm_send != 1) {
-                int rc = pthread_cond_timedwait(&cardata.data->cond, &cardata.data->mutex, &ts);
-                if (rc == ETIMEDOUT) {
-                    break;
-                } else if (rc != 0) {
-                    perror("pthread_cond_timedwait");
-                    pthread_mutex_unlock(&cardata.data->mutex);
-                    break;
-                }
-            }
-
-            snprintf(threaddata->buffer, BUFFER_SIZE, "STATUS %s %s %s \n", cardata.data->status, cardata.data->current_floor, cardata.data->destination_floor);
-            length = htonl(strlen(threaddata->buffer));
-            if (send(clientsockfd, &length, sizeof(length), 0) == -1) {
-                perror("send");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
-
-            if (send(clientsockfd, threaddata->buffer, strlen(threaddata->buffer), 0) == -1) {
-                perror("send");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
-            
-            //Set the socket to non-blocking mode
-            int flags = fcntl(clientsockfd, F_GETFL, 0);
-            if (flags == -1) {
-                perror("fcntl");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
-            if (fcntl(clientsockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
-                perror("fcntl");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
-            uint32_t full_length;
-            threaddata->bytes_read = recv(clientsockfd, &full_length, sizeof(full_length), MSG_DONTWAIT);
-            if (threaddata->bytes_read <= 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    // No data available, continue the loop
-                    pthread_mutex_unlock(&cardata.data->mutex);
-                    continue;
-                } else {
-                    perror("recv");
-                    connected = 0;
-                    pthread_mutex_unlock(&cardata.data->mutex);
-                    close(clientsockfd);
-                    continue;
-                }
-            }
-            
-            uint32_t response_length = ntohl(full_length);
-            if (response_length == 0 || response_length > BUFFER_SIZE) {
-                perror("recv");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
-
-            threaddata->bytes_read = recv(clientsockfd, threaddata->buffer, response_length, MSG_WAITALL);
-            if (threaddata->bytes_read <= 0) {
-                perror("recv");
-                connected = 0;
-                pthread_mutex_unlock(&cardata.data->mutex);
-                close(clientsockfd);
-                continue;
-            }
-
-            threaddata->buffer[response_length] = '\0';
-            if (threaddata->read_flag == 1) {
-                sscanf(threaddata->buffer, "FLOOR %s ", cardata.data->destination_floor);
-            }
+        disconnect_from_server();
+        return;
+    }
 
-            printf("Received destination floor from server: %s\n", threaddata->buffer);
-            cardata.shm_send = 1;
-            pthread_mutex_unlock(&cardata.data->mutex);
-        }
+    if (!send_status(clientsockfd, now)) {
+        disconnect_from_server();
     }
-    return NULL;
 }
 
+// Thread function for the car's state machine.
+// Sleeps on the shared condition variable until a button, the destination or
+// the status changes, or until the current door/floor step is due, then runs
+// the door and movement transitions and reports any change to the controller.
+void *control_thread(void *arg) {
+    car_control_t *control = arg;
+    struct timespec now, deadline, heartbeat;
 
-
-
-
-
-
-
-
-
-
-void change_status(Status *status, Status new_status) {*status = new_status;}
-void operate_door(void) {
-    Status current_status = Opening;
-    Status next_status;
+    pthread_mutex_lock(&cardata.data->mutex);
+    pthread_cleanup_push(unlock_shared_mutex, &cardata.data->mutex);
     while (thread_stop_signal != 1) {
-        // Check if status is correct
-        if(strcmp(status_names[read_car_status(&cardata)], status_names[current_status]) != 0){
-            edit_shared_memory(&cardata, OP_SET_STATUS, 0, current_status);
+        cartimer_now(&now);
+        if (car_control_step(control, &now)) {
+            pthread_cond_broadcast(&cardata.data->cond);
         }
-        // Check if open button is pressed
-        if(read_shared_memory(&cardata, OP_GET_OPEN) == 1){
-            if(current_status == Closed || current_status == Closing){
-                current_status = Opening;
-                edit_shared_memory(&cardata, OP_CLEAR_OPEN, 0, 0);
-            }
-            if(current_status == Opening || current_status == Between){
-                edit_shared_memory(&cardata, OP_CLEAR_OPEN, 0, 0);
-            }
-            if(current_status == Open){
-                current_status = Closing;
-                carwait
-                edit_shared_memory(&cardata, OP_CLEAR_OPEN, 0, 0);
-            }
+        report_to_server(&now);
+
+        // Wake for the next timed step or heartbeat, whichever is first
+        bool timed = car_control_deadline(control, &deadline);
+        if (heartbeat_deadline(&heartbeat) &&
+            (!timed || cartimer_diff_ns(&heartbeat, &deadline) < 0)) {
+            deadline = heartbeat;
+            timed = true;
         }
-        // Check if close button is pressed
-        if(read_shared_memory(&cardata, OP_GET_CLOSE) == 1){
-            if(current_status == Open){
-                current_status = Closing;
-                edit_shared_memory(&cardata, OP_CLEAR_CLOSE, 0, 0);
-            }
+        if (timed) {
+            pthread_cond_timedwait(&cardata.data->cond, &cardata.data->mutex, &deadline);
+        } else {
+            pthread_cond_wait(&cardata.data->cond, &cardata.data->mutex);
         }
+    }
+    pthread_cleanup_pop(1);
+    return NULL;
+}
 
-        switch (current_status){
-            case Opening:
-                edit_shared_memory(&cardata, OP_SET_STATUS, 0, Opening);
-                //printf("Door is opening\n");
-                next_status = Open;
-                break;
-            case Open:
-                edit_shared_memory(&cardata, OP_SET_STATUS, 0, Open);
-                //printf("Door is open\n");
-                next_status = Closing;
-                break;
-            case Closing:
-                edit_shared_memory(&cardata, OP_SET_STATUS, 0, Closing);
-                //printf("Door is closing\n");
-                next_status = Closed;
-                break;
-            case Closed:
-                edit_shared_memory(&cardata, OP_SET_STATUS, 0, Closed);
-                //printf("Door is closed\n");
-                next_status = Opening;
-                break;
-        }
+// Receive one length-prefixed message, blocking until it arrives.
+// Returns its length, or 0 if the connection was closed.
+uint32_t receive_message(int sockfd, char *buffer, size_t buffer_size) {
+    uint32_t message_length;
 
-        if (current_status == Closed && next_status == Opening) {
-            break;
-        }
-        change_status(&current_status, next_status);
-        carwait
+    if (recv(sockfd, &message_length, sizeof(message_length), MSG_WAITALL) != sizeof(message_length)) {
+        return 0;
     }
+    message_length = ntohl(message_length);
+    if (message_length == 0 || message_length >= buffer_size) {
+        return 0;
+    }
+    if (recv(sockfd, buffer, message_length, MSG_WAITALL) != (ssize_t)message_length) {
+        return 0;
+    }
+    buffer[message_length] = '\0';
+    return message_length;
 }
 
+// Thread function for TCP communication.
+// Connects whenever the car is in normal service, then blocks on the socket
+// and hands each FLOOR command to the state machine. Status updates are sent
+// by control_thread as the car changes.
+void *tcp_communication_thread(void *arg) {
+    thread_data_t *threaddata = arg;
 
-// Thread function for process
-void *process_thread(void *arg){
-    thread_data_t *threaddata;
-    threaddata = arg;
-    threaddata->read_flag = 1;
+    while (thread_stop_signal != 1) {
+        // Stay off the network while in emergency or individual service mode
+        pthread_mutex_lock(&cardata.data->mutex);
+        pthread_cleanup_push(unlock_shared_mutex, &cardata.data->mutex);
+        while (cardata.data->emergency_mode == 1 || cardata.data->individual_service_mode == 1) {
+            pthread_cond_wait(&cardata.data->cond, &cardata.data->mutex);
+        }
+        pthread_cleanup_pop(1);
 
-    while(thread_stop_signal != 1) {
+        int sockfd = connect_to_server();
 
         pthread_mutex_lock(&cardata.data->mutex);
-        int at_destination = strcmp(cardata.data->destination_floor, cardata.data->current_floor);
-        int floordiff = stringToFloor(cardata.data->destination_floor) - stringToFloor(cardata.data->current_floor);
-        //make sure destination is not greater than highest floor
-        if (stringToFloor(cardata.data->destination_floor) > stringToFloor(threaddata->highest_floor)){
-            strcpy(cardata.data->destination_floor, cardata.data->current_floor);
+        message_t car = {.type = MSG_CAR, .floor = {(int16_t)threaddata->lowest_floor_number,
+                                                    (int16_t)threaddata->highest_floor_number}};
+        snprintf(car.name, sizeof(car.name), "%.49s", carname);
+        bool connected = protocol_send(sockfd, &car, use_binary);
+        if (connected) {
+            // A new connection starts with the whole STATUS
+            struct timespec now;
+            cartimer_now(&now);
+            memset(&last_report, 0, sizeof(last_report));
+            connected = send_status(sockfd, &now);
         }
-        //make sure destination is not less than lowest floor
-        if (stringToFloor(cardata.data->destination_floor) < stringToFloor(threaddata->lowest_floor)){
-            strcpy(cardata.data->destination_floor, cardata.data->current_floor);
+        if (connected) {
+            clientsockfd = sockfd;
+            // Let control_thread report anything that changed in the meantime
+            pthread_cond_broadcast(&cardata.data->cond);
         }
-        
         pthread_mutex_unlock(&cardata.data->mutex);
-        if (cardata.shm_send == 1 && at_destination == 0) {
-            operate_door();
-            cardata.shm_send = 0;
-        }
 
-        if (at_destination != 0 && read_car_status(&cardata) == Closed){
-            //move to destination floor process
-            for (int i = 0; i < abs(floordiff); i++) {
-                edit_shared_memory(&cardata, OP_SET_STATUS, 0, Between);
-                threaddata->read_flag = 0;
-                //printf("Car is moving\n");
-                carwait
-                if (floordiff > 0) {
-                    edit_shared_memory(&cardata, OP_MOVE_CURRENT, 1, 0);
-                    edit_shared_memory(&cardata, OP_SET_STATUS, 0, Closed);
-                    threaddata->read_flag = 1;
-                } else{
-                    edit_shared_memory(&cardata, OP_MOVE_CURRENT, -1, 0);
-                    edit_shared_memory(&cardata, OP_SET_STATUS, 0, Closed);
-                    threaddata->read_flag = 1;
-                }
+        uint32_t length;
+        while (connected && (length = receive_message(sockfd, threaddata->buffer, BUFFER_SIZE)) > 0) {
+            message_t message;
+            char floor[4];
+            if (!protocol_decode(threaddata->buffer, length, &message) || message.type != MSG_FLOOR) {
+                continue;
             }
-            operate_door();
-       }
+            floorToString(floor, message.floor[0]);
+            pthread_mutex_lock(&cardata.data->mutex);
+            if (car_control_request_floor(&car_control, floor)) {
+                pthread_cond_broadcast(&cardata.data->cond);
+            }
+            pthread_mutex_unlock(&cardata.data->mutex);
+        }
+
+        pthread_mutex_lock(&cardata.data->mutex);
+        if (clientsockfd == sockfd) {
+            clientsockfd = -1;
+        }
+        pthread_mutex_unlock(&cardata.data->mutex);
+        close(sockfd);
     }
     return NULL;
 }
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
 int main(int argc, char *argv[]) {
     signal(SIGINT,handle_sigint);
     signal(SIGPIPE, SIG_IGN); //-> errno to EPIPE
@@ -481,10 +293,20 @@ int main(int argc, char *argv[]) {
     
     // Input validation
     // Validate right amount of arguments
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s {name} {lowest floor} {highest floor} {delay} \n", argv[0]);
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s {name} {lowest floor} {highest floor} {delay} [--heartbeat ms] [--binary]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
+    for (int i = 5; i < argc; i++) {
+        if (strcmp(argv[i], "--heartbeat") == 0 && i + 1 < argc) {
+            heartbeat_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            use_binary = true;
+        } else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
     // // Validate name to ensure it only contains alphanumeric characters
     // for (int i = 0; argv[1][i] != '\0'; i++) {
@@ -524,6 +346,12 @@ int main(int argc, char *argv[]) {
     // Add lowest and highest floor to thread_data
     strcpy(thread_data.lowest_floor, argv[2]);
     strcpy(thread_data.highest_floor, argv[3]);
+    thread_data.lowest_floor_number = stringToFloor(thread_data.lowest_floor);
+    thread_data.highest_floor_number = stringToFloor(thread_data.highest_floor);
+    if (thread_data.lowest_floor_number == INT_MIN || thread_data.highest_floor_number == INT_MIN) {
+        fprintf(stderr, "Invalid floor(s) specified.\n");
+        exit(EXIT_FAILURE);
+    }
 
     // Create shared memory object
     char shm_name[256];
@@ -538,8 +366,11 @@ int main(int argc, char *argv[]) {
     init_shared_data(&cardata,argv[2]);
     
 
+    car_control_init(&car_control, &cardata, thread_data.lowest_floor_number,
+                     thread_data.highest_floor_number, thread_data.delaytime);
+
     // Create threads
-    if (pthread_create(&doorcontrol_thread_tid, NULL, doorcontrol_thread, NULL) != 0) {
+    if (pthread_create(&control_tid, NULL, control_thread, &car_control) != 0) {
         perror("pthread_create");
         exit(EXIT_FAILURE);
     }
@@ -549,17 +380,11 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (pthread_create(&process_tid, NULL, process_thread, &thread_data) != 0) {
-        perror("pthread_create");
-        exit(EXIT_FAILURE);
-    }
-
     
     
     //this will be waiting for the threads to finish so like a for loop
-    pthread_join(doorcontrol_thread_tid, NULL);
+    pthread_join(control_tid, NULL);
     pthread_join(tcp_communication_tid, NULL);
-    pthread_join(process_tid, NULL);
     destroy_shared_object(&cardata);
     if (clientsockfd != -1) {
         close(clientsockfd);
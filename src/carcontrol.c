@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+#include "cartimer.h"
+#include "carcontrol.h"
+
+/**
+ * The status shown in shared memory for each state.
+ */
+static const Status state_status[] = {
+    Closed,  // CAR_IDLE
+    Opening, // CAR_OPENING
+    Open,    // CAR_OPEN
+    Closing, // CAR_CLOSING
+    Between  // CAR_MOVING
+};
+
+/**
+ * Check whether the current timed step is due. When it is, the lateness is
+ * recorded and due is set to the step's deadline, so the next step can be
+ * scheduled from when this one should have happened rather than from now and
+ * the error does not build up. A car that has fallen more than a whole step
+ * behind starts again from now instead of rushing to catch up.
+ */
+static bool timer_fired(car_control_t *car, const struct timespec *now, struct timespec *due)
+{
+    if (!car->timer_armed || !cartimer_reached(now, &car->deadline))
+    {
+        return false;
+    }
+    timer_stats_record(&car->jitter, &car->deadline, now);
+    *due = car->deadline;
+    if (cartimer_diff_ns(now, due) >= (int64_t)car->delay_ms * 1000000)
+    {
+        *due = *now;
+    }
+    return true;
+}
+
+static void arm_timer(car_control_t *car, const struct timespec *start)
+{
+    car->deadline = *start;
+    cartimer_add_ms(&car->deadline, car->delay_ms);
+    car->timer_armed = true;
+}
+
+/**
+ * Enter a state, publishing its status and starting its timer from start. The
+ * doors stay open without a timer in individual service mode.
+ */
+static void enter_state(car_control_t *car, car_state_t state, const struct timespec *start)
+{
+    car->state = state;
+    strcpy(car->shm->data->status, status_names[state_status[state]]);
+    shm_mark_dirty(car->shm, SHM_DIRTY_STATUS);
+    if (state == CAR_IDLE || (state == CAR_OPEN && car->shm->data->individual_service_mode == 1))
+    {
+        car->timer_armed = false;
+    }
+    else
+    {
+        arm_timer(car, start);
+    }
+}
+
+/**
+ * The floor one step from floor in direction, skipping the non-existent floor 0.
+ */
+static int next_floor(int floor, int direction)
+{
+    int next = floor + direction;
+    if (next == 0)
+    {
+        next += direction;
+    }
+    return next;
+}
+
+/**
+ * Pick up a status written by another process (the safety system reopens
+ * closing doors when they are obstructed).
+ */
+static bool adopt_external_status(car_control_t *car, const struct timespec *now)
+{
+    Status status = stringToStatus(car->shm->data->status);
+    if ((int)status < 0 || status == state_status[car->state])
+    {
+        return false;
+    }
+    switch (status)
+    {
+        case Opening:
+            enter_state(car, CAR_OPENING, now);
+            break;
+        case Open:
+            enter_state(car, CAR_OPEN, now);
+            break;
+        case Closing:
+            enter_state(car, CAR_CLOSING, now);
+            break;
+        case Closed:
+            enter_state(car, CAR_IDLE, now);
+            break;
+        default:
+            // Only the car itself moves between floors
+            strcpy(car->shm->data->status, status_names[state_status[car->state]]);
+            shm_mark_dirty(car->shm, SHM_DIRTY_STATUS);
+            break;
+    }
+    return true;
+}
+
+/**
+ * Run one transition.
+ *
+ * @return true if something changed, in which case it should be called again.
+ */
+static bool step_once(car_control_t *car, const struct timespec *now)
+{
+    car_shared_data_t *data = car->shm->data;
+    bool open_request = data->open_button == 1 || car->floor_requested;
+    struct timespec due;
+
+    switch (car->state)
+    {
+        case CAR_IDLE:
+        {
+            if (open_request)
+            {
+                data->open_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_OPEN_BUTTON);
+                car->floor_requested = false;
+                enter_state(car, CAR_OPENING, now);
+                return true;
+            }
+            if (data->close_button == 1)
+            {
+                data->close_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_CLOSE_BUTTON);
+                return true;
+            }
+
+            int current = stringToFloor(data->current_floor);
+            int destination = stringToFloor(data->destination_floor);
+            if (destination == current)
+            {
+                return false;
+            }
+            if (destination == INT_MIN || destination < car->lowest_floor || destination > car->highest_floor)
+            {
+                strcpy(data->destination_floor, data->current_floor);
+                shm_mark_dirty(car->shm, SHM_DIRTY_DESTINATION_FLOOR);
+                return true;
+            }
+            if (data->emergency_mode == 1)
+            {
+                return false;
+            }
+            car->direction = (destination > current) ? 1 : -1;
+            enter_state(car, CAR_MOVING, now);
+            return true;
+        }
+
+        case CAR_OPENING:
+            if (open_request)
+            {
+                data->open_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_OPEN_BUTTON);
+                car->floor_requested = false;
+                return true;
+            }
+            if (timer_fired(car, now, &due))
+            {
+                enter_state(car, CAR_OPEN, &due);
+                return true;
+            }
+            return false;
+
+        case CAR_OPEN:
+            if (open_request)
+            {
+                // Hold the doors open for another full period
+                data->open_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_OPEN_BUTTON);
+                car->floor_requested = false;
+                enter_state(car, CAR_OPEN, now);
+                return true;
+            }
+            if (data->close_button == 1)
+            {
+                data->close_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_CLOSE_BUTTON);
+                enter_state(car, CAR_CLOSING, now);
+                return true;
+            }
+            if (car->timer_armed == (data->individual_service_mode == 1))
+            {
+                // Service mode was switched while the doors were open
+                enter_state(car, CAR_OPEN, now);
+                return true;
+            }
+            if (timer_fired(car, now, &due))
+            {
+                enter_state(car, CAR_CLOSING, &due);
+                return true;
+            }
+            return false;
+
+        case CAR_CLOSING:
+            if (open_request || data->door_obstruction == 1)
+            {
+                data->open_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_OPEN_BUTTON);
+                car->floor_requested = false;
+                enter_state(car, CAR_OPENING, now);
+                return true;
+            }
+            if (timer_fired(car, now, &due))
+            {
+                enter_state(car, CAR_IDLE, &due);
+                return true;
+            }
+            return false;
+
+        case CAR_MOVING:
+        {
+            if (data->open_button == 1 || data->close_button == 1)
+            {
+                // Doors can't be operated between floors
+                data->open_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_OPEN_BUTTON);
+                data->close_button = 0;
+                shm_mark_dirty(car->shm, SHM_DIRTY_CLOSE_BUTTON);
+                return true;
+            }
+            if (!timer_fired(car, now, &due))
+            {
+                return false;
+            }
+
+            int current = next_floor(stringToFloor(data->current_floor), car->direction);
+            int destination = stringToFloor(data->destination_floor);
+            floorToString(data->current_floor, current);
+            shm_mark_dirty(car->shm, SHM_DIRTY_CURRENT_FLOOR);
+
+            if (data->emergency_mode == 1 || current == destination ||
+                destination == INT_MIN || destination < car->lowest_floor || destination > car->highest_floor)
+            {
+                strcpy(data->destination_floor, data->current_floor);
+                shm_mark_dirty(car->shm, SHM_DIRTY_DESTINATION_FLOOR);
+                if (data->emergency_mode == 1 || data->individual_service_mode == 1)
+                {
+                    enter_state(car, CAR_IDLE, &due);
+                }
+                else
+                {
+                    enter_state(car, CAR_OPENING, &due);
+                }
+                return true;
+            }
+
+            // Keep going, turning around if the destination moved behind the car
+            car->direction = (destination > current) ? 1 : -1;
+            arm_timer(car, &due);
+            return true;
+        }
+    }
+    return false;
+}
+
+void car_control_init(car_control_t *car, shared_memory_t *shm, int lowest_floor, int highest_floor, int delay_ms)
+{
+    car->shm = shm;
+    car->lowest_floor = lowest_floor;
+    car->highest_floor = highest_floor;
+    car->delay_ms = delay_ms;
+    car->state = CAR_IDLE;
+    car->direction = 0;
+    car->timer_armed = false;
+    car->floor_requested = false;
+    timer_stats_init(&car->jitter);
+}
+
+bool car_control_step(car_control_t *car, const struct timespec *now)
+{
+    shm_write_begin(car->shm);
+    bool changed = adopt_external_status(car, now);
+    while (step_once(car, now))
+    {
+        changed = true;
+    }
+    shm_write_end(car->shm);
+    return changed;
+}
+
+bool car_control_deadline(const car_control_t *car, struct timespec *deadline)
+{
+    if (!car->timer_armed)
+    {
+        return false;
+    }
+    *deadline = car->deadline;
+    return true;
+}
+
+bool car_control_request_floor(car_control_t *car, char floorlabel[4])
+{
+    int floor = stringToFloor(floorlabel);
+    if (floor == INT_MIN || floor < car->lowest_floor || floor > car->highest_floor)
+    {
+        return false;
+    }
+
+    shm_write_begin(car->shm);
+    floorToString(car->shm->data->destination_floor, floor);
+    shm_mark_dirty(car->shm, SHM_DIRTY_DESTINATION_FLOOR);
+    shm_write_end(car->shm);
+    if (car->state != CAR_MOVING && floor == stringToFloor(car->shm->data->current_floor))
+    {
+        // Already here, just let the passengers on
+        car->floor_requested = true;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include "cartimer.h"
+
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_MSEC 1000000L
+
+void cartimer_now(struct timespec *ts) {
+    clock_gettime(CARTIMER_CLOCK, ts);
+}
+
+void cartimer_add_ms(struct timespec *ts, long milliseconds) {
+    ts->tv_sec += milliseconds / 1000;
+    ts->tv_nsec += (milliseconds % 1000) * NSEC_PER_MSEC;
+    if (ts->tv_nsec >= NSEC_PER_SEC) {
+        ts->tv_sec += 1;
+        ts->tv_nsec -= NSEC_PER_SEC;
+    }
+}
+
+int64_t cartimer_diff_ns(const struct timespec *a, const struct timespec *b) {
+    return (int64_t)(a->tv_sec - b->tv_sec) * NSEC_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+bool cartimer_reached(const struct timespec *now, const struct timespec *deadline) {
+    return now->tv_sec > deadline->tv_sec ||
+           (now->tv_sec == deadline->tv_sec && now->tv_nsec >= deadline->tv_nsec);
+}
+
+void cartimer_sleep_until(const struct timespec *deadline) {
+    // clock_nanosleep returns the error rather than setting errno
+    while (clock_nanosleep(CARTIMER_CLOCK, TIMER_ABSTIME, deadline, NULL) == EINTR) {
+    }
+}
+
+void cartimer_sleep_ms(long milliseconds) {
+    struct timespec deadline;
+    cartimer_now(&deadline);
+    cartimer_add_ms(&deadline, milliseconds);
+    cartimer_sleep_until(&deadline);
+}
+
+void timer_stats_init(timer_stats_t *stats) {
+    stats->count = 0;
+    stats->total_ns = 0;
+    stats->min_ns = INT64_MAX;
+    stats->max_ns = INT64_MIN;
+}
+
+void timer_stats_record(timer_stats_t *stats, const struct timespec *deadline, const struct timespec *fired) {
+    int64_t late = cartimer_diff_ns(fired, deadline);
+    stats->count++;
+    stats->total_ns += late;
+    if (late < stats->min_ns) {
+        stats->min_ns = late;
+    }
+    if (late > stats->max_ns) {
+        stats->max_ns = late;
+    }
+}
+
+void timer_stats_print(FILE *stream, const char *name, const timer_stats_t *stats) {
+    if (stats->count == 0) {
+        fprintf(stream, "%s: no timed steps\n", name);
+        return;
+    }
+    fprintf(stream, "%s: %llu timed steps, lateness min %.1f us, mean %.1f us, max %.1f us\n",
+            name, (unsigned long long)stats->count,
+            stats->min_ns / 1000.0,
+            (double)stats->total_ns / stats->count / 1000.0,
+            stats->max_ns / 1000.0);
+}
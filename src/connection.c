@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "connection.h"
+
+/**
+ * @brief Allocates a connection context for a socket.
+ * 
+ * @param fd The socket file descriptor.
+ * @param listener true if the socket is a listening socket.
+ * @return The new connection, or NULL on allocation failure.
+ */
+connection_t *connection_create(int fd, bool listener) {
+    connection_t *conn = malloc(sizeof(connection_t));
+    if (conn == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    conn->fd = fd;
+    conn->listener = listener;
+    conn->buffer = NULL;
+    conn->capacity = 0;
+    conn->length = 0;
+    conn->offset = 0;
+    conn->state = FRAME_READ_LENGTH;
+    conn->frame_length = 0;
+    conn->binary = false;
+    pthread_mutex_init(&conn->out_lock, NULL);
+    conn->out = NULL;
+    conn->out_capacity = 0;
+    conn->out_length = 0;
+    conn->epoll_fd = -1;
+    conn->events = 0;
+    return conn;
+}
+
+/**
+ * @brief Frees a connection context. The socket is not closed.
+ * 
+ * @param conn The connection to free.
+ */
+void connection_destroy(connection_t *conn) {
+    if (conn == NULL) return;
+    pthread_mutex_destroy(&conn->out_lock);
+    free(conn->out);
+    free(conn->buffer);
+    free(conn);
+}
+
+/**
+ * @brief Makes room at the end of the receive buffer, first by discarding
+ * parsed bytes and then by growing the allocation.
+ * 
+ * @param conn The connection.
+ * @return false if the buffer is already at its maximum size and full.
+ */
+static bool connection_reserve(connection_t *conn) {
+    if (conn->offset > 0) {
+        memmove(conn->buffer, conn->buffer + conn->offset, conn->length - conn->offset);
+        conn->length -= conn->offset;
+        conn->offset = 0;
+    }
+    if (conn->length < conn->capacity) {
+        return true;
+    }
+    if (conn->capacity >= CONNECTION_MAX_CAPACITY) {
+        return false;
+    }
+
+    size_t new_capacity = (conn->capacity == 0) ? CONNECTION_INITIAL_CAPACITY : conn->capacity * 2;
+    char *new_buffer = realloc(conn->buffer, new_capacity);
+    if (new_buffer == NULL) {
+        perror("realloc");
+        return false;
+    }
+    conn->buffer = new_buffer;
+    conn->capacity = new_capacity;
+    return true;
+}
+
+/**
+ * @brief Reads everything the (non-blocking) socket has into the receive buffer.
+ * 
+ * @param conn The connection to read into.
+ * @return The state of the socket after reading.
+ */
+connection_status_t connection_fill(connection_t *conn) {
+    while (true) {
+        if (!connection_reserve(conn)) {
+            return CONNECTION_FULL;
+        }
+
+        ssize_t bytes_read = recv(conn->fd, conn->buffer + conn->length, conn->capacity - conn->length, 0);
+        if (bytes_read > 0) {
+            conn->length += (size_t)bytes_read;
+        } else if (bytes_read == 0) {
+            return CONNECTION_CLOSED;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return CONNECTION_DRAINED;
+        } else if (errno != EINTR) {
+            perror("recv");
+            return CONNECTION_ERROR;
+        }
+    }
+}
+
+/**
+ * @brief Extracts the next complete frame from the receive buffer.
+ * 
+ * @param conn The connection to parse.
+ * @param out Buffer that receives the NUL-terminated frame body.
+ * @param out_size The size of out. Longer frames are a protocol error.
+ * @return The frame length, 0 if no complete frame is buffered, or -1 on a protocol error.
+ */
+int connection_next_frame(connection_t *conn, char *out, size_t out_size) {
+    size_t available = conn->length - conn->offset;
+
+    if (conn->state == FRAME_READ_LENGTH) {
+        uint32_t full_length;
+        if (available < sizeof(full_length)) {
+            return 0;
+        }
+        memcpy(&full_length, conn->buffer + conn->offset, sizeof(full_length));
+        conn->offset += sizeof(full_length);
+        available -= sizeof(full_length);
+
+        conn->frame_length = ntohl(full_length);
+        if (conn->frame_length == 0 || conn->frame_length >= out_size) {
+            return -1;
+        }
+        conn->state = FRAME_READ_BODY;
+    }
+
+    if (available < conn->frame_length) {
+        return 0;
+    }
+
+    memcpy(out, conn->buffer + conn->offset, conn->frame_length);
+    out[conn->frame_length] = '\0';
+    conn->offset += conn->frame_length;
+    conn->state = FRAME_READ_LENGTH;
+
+    if (conn->offset == conn->length) {
+        conn->offset = 0;
+        conn->length = 0;
+    }
+    return (int)conn->frame_length;
+}
+
+/**
+ * @brief Points the connection's epoll watch at the events it needs now:
+ * EPOLLOUT only while something is queued. Must be called with out_lock held.
+ * 
+ * @param conn The connection.
+ * @param op EPOLL_CTL_ADD or EPOLL_CTL_MOD.
+ * @return false if epoll_ctl failed.
+ */
+static bool connection_rearm(connection_t *conn, int op) {
+    struct epoll_event event;
+    event.events = conn->events | ((conn->out_length > 0) ? EPOLLOUT : 0);
+    event.data.ptr = conn;
+    return epoll_ctl(conn->epoll_fd, op, conn->fd, &event) == 0;
+}
+
+bool connection_watch(connection_t *conn, int epoll_fd, uint32_t events) {
+    pthread_mutex_lock(&conn->out_lock);
+    conn->epoll_fd = epoll_fd;
+    conn->events = events;
+    bool watched = connection_rearm(conn, EPOLL_CTL_ADD);
+    if (!watched) {
+        perror("epoll_ctl");
+        conn->epoll_fd = -1;
+    }
+    pthread_mutex_unlock(&conn->out_lock);
+    return watched;
+}
+
+void connection_unwatch(connection_t *conn) {
+    pthread_mutex_lock(&conn->out_lock);
+    if (conn->epoll_fd != -1) {
+        epoll_ctl(conn->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+        conn->epoll_fd = -1;
+    }
+    pthread_mutex_unlock(&conn->out_lock);
+}
+
+/**
+ * @brief Sends bytes until they're all out or the socket is full. Must be
+ * called with out_lock held.
+ * 
+ * @param conn The connection.
+ * @param data The bytes.
+ * @param length The number of bytes.
+ * @return How many bytes were sent, or -1 if the send failed.
+ */
+static ssize_t connection_write(connection_t *conn, const char *data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = send(conn->fd, data + done, length - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            done += (size_t)n;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n == -1 && errno != EINTR) {
+            perror("send");
+            return -1;
+        }
+    }
+    return (ssize_t)done;
+}
+
+bool connection_send(connection_t *conn, const void *data, size_t length) {
+    bool sent = true;
+    pthread_mutex_lock(&conn->out_lock);
+
+    // Nothing may overtake what's already queued
+    ssize_t done = 0;
+    if (conn->out_length == 0) {
+        done = connection_write(conn, data, length);
+    }
+    if (done == -1) {
+        sent = false;
+    } else if ((size_t)done < length) {
+        size_t rest = length - (size_t)done;
+        size_t needed = conn->out_length + rest;
+        if (needed > CONNECTION_MAX_CAPACITY) {
+            fprintf(stderr, "send: peer stopped reading\n");
+            sent = false;
+        } else {
+            if (needed > conn->out_capacity) {
+                size_t new_capacity = (conn->out_capacity == 0) ? CONNECTION_INITIAL_CAPACITY : conn->out_capacity;
+                while (new_capacity < needed) {
+                    new_capacity *= 2;
+                }
+                char *new_out = realloc(conn->out, new_capacity);
+                if (new_out == NULL) {
+                    perror("realloc");
+                    pthread_mutex_unlock(&conn->out_lock);
+                    return false;
+                }
+                conn->out = new_out;
+                conn->out_capacity = new_capacity;
+            }
+            bool was_empty = (conn->out_length == 0);
+            memcpy(conn->out + conn->out_length, (const char *)data + done, rest);
+            conn->out_length = needed;
+            if (was_empty && conn->epoll_fd != -1) {
+                // A failure here means the socket is between epoll instances;
+                // connection_watch adds EPOLLOUT when it lands
+                connection_rearm(conn, EPOLL_CTL_MOD);
+            }
+        }
+    }
+    pthread_mutex_unlock(&conn->out_lock);
+    return sent;
+}
+
+bool connection_flush(connection_t *conn) {
+    pthread_mutex_lock(&conn->out_lock);
+    ssize_t done = 0;
+    if (conn->out_length > 0) {
+        done = connection_write(conn, conn->out, conn->out_length);
+    }
+    if (done > 0) {
+        memmove(conn->out, conn->out + done, conn->out_length - (size_t)done);
+        conn->out_length -= (size_t)done;
+        if (conn->out_length == 0 && conn->epoll_fd != -1) {
+            connection_rearm(conn, EPOLL_CTL_MOD);
+        }
+    }
+    pthread_mutex_unlock(&conn->out_lock);
+    return done != -1;
+}
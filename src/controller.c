@@ -7,27 +7,71 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <signal.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <pthread.h>
 #include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 #include "controllermemory.h"
+#include "connection.h"
+#include "protocol.h"
 
 #define PORT 3000
 #define BACKLOG 10
 #define BUFFER_SIZE 1024
+#define MAX_EVENTS 64
+#define MAX_SHARDS 64
+#define MAX_BANKS 1024
+
+/**
+ * The connected cars are split into shards, each with its own thread, epoll
+ * loop and controller_t behind its own lock. A car belongs to the shard of its
+ * bank, the cars serving the same floors, and banks are dealt out to the
+ * shards in the order they first appear, so different banks' STATUS traffic
+ * is handled on different cores without sharing anything. Every shard also
+ * watches the listening socket, so new connections go to whichever shard is
+ * free; a car's connection is handed to its bank's shard when its CAR message
+ * arrives, and call pads stay where they were accepted.
+ *
+ * A CALL is resolved by a small assignment stage on the pad's thread (see
+ * handle_elevator_call), which only locks the shards that could take it.
+ *
+ * Usage: controller [--shards n]    (default 1, a single event loop)
+ */
+typedef struct {
+    pthread_t tid;
+    int epoll_fd;
+    pthread_mutex_t lock;       // Held while the controller or its cars' sockets are used
+    controller_t controller;
+    // Floors served by any of the shard's cars, read without the lock by the
+    // assignment stage. lowest > highest while the shard has no cars.
+    _Atomic int lowest_floor;
+    _Atomic int highest_floor;
+} shard_t;
 
+typedef struct {
+    int16_t lowest_floor;
+    int16_t highest_floor;
+    shard_t *shard;
+} bank_t;
 
 typedef struct {
     int server_sockfd;
-    controller_t controller;
-    char buffer[BUFFER_SIZE];
-    ssize_t bytes_read;
+    int stop_fd;                // eventfd that wakes every shard to stop
+    size_t shard_count;
+    shard_t shards[MAX_SHARDS];
+    // Banks seen so far and their shards, only used when a car registers
+    pthread_mutex_t bank_lock;
+    size_t bank_count;
+    bank_t banks[MAX_BANKS];
 }controller_data_t;
 
 controller_data_t controller_data;
-pthread_t  tcp_communication_tid, process_tid;
+pthread_t process_tid;
 volatile int thread_stop_signal = 0;
 
 
@@ -68,121 +112,169 @@ void listen_socket(int sockfd) {
     }
 }
 
-// Function to accept an incoming connection
+// Function to accept an incoming connection, returns -1 once the backlog is empty
 int accept_connection(int sockfd, struct sockaddr_in *client_address) {
     socklen_t client_len = sizeof(*client_address);
     int client_sockfd = accept(sockfd, (struct sockaddr *)client_address, &client_len);
     if (client_sockfd == -1) {
-        perror("accept");
-        close(sockfd);
-        exit(EXIT_FAILURE);
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+            perror("accept");
+        }
+        return -1;
     }
     return client_sockfd;
 }
 
-bool handle_elevator_call(controller_data_t *controller_data, int source_floor, int dest_floor, char* selected_car_name, fd_set *master_set) {
-    if (controller_data == NULL) {
-        fprintf(stderr, "Invalid controller_data pointer\n");
-        return false;
-    }
-    if (controller_data->controller.data == NULL) {
-        fprintf(stderr, "Invalid controller data\n");
-        return false;
+// Function to put a socket into non-blocking mode
+int set_nonblocking(int sockfd) {
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl");
+        return -1;
     }
+    return 0;
+}
 
-    connectedcar_t* best_car = NULL;
-    int min_distance = 100;
+// Function to get the time in milliseconds for timing car STATUS reports
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    // Find the best car to handle the request
-    for (size_t i = 0; i < controller_data->controller.size; i++) {
-        connectedcar_t* car = &controller_data->controller.data[i];
+// Function to recompute the floors a shard's cars serve. Must be called with
+// the shard's lock held.
+void shard_update_floors(shard_t *shard) {
+    int lowest = INT16_MAX, highest = INT16_MIN;
+    for (size_t i = 0; i < shard->controller.size; i++) {
+        connectedcar_t *car = &shard->controller.data[i];
+        lowest = (car->lowest_floor < lowest) ? car->lowest_floor : lowest;
+        highest = (car->highest_floor > highest) ? car->highest_floor : highest;
+    }
+    atomic_store(&shard->lowest_floor, lowest);
+    atomic_store(&shard->highest_floor, highest);
+}
 
-        if (!can_service_request(car, source_floor, dest_floor)) {
-            continue;
+// Function to pick the shard for a car's bank, the cars serving the same
+// floors. A new bank goes to the next shard in turn. Must be called with the
+// bank lock held.
+shard_t *shard_for_bank(controller_data_t *controller_data, int lowest_floor, int highest_floor) {
+    shard_t *shard = NULL;
+    for (size_t b = 0; b < controller_data->bank_count && shard == NULL; b++) {
+        bank_t *bank = &controller_data->banks[b];
+        if (bank->lowest_floor == lowest_floor && bank->highest_floor == highest_floor) {
+            shard = bank->shard;
+        }
+    }
+    if (shard == NULL) {
+        size_t b = controller_data->bank_count;
+        shard = &controller_data->shards[b % controller_data->shard_count];
+        if (b < MAX_BANKS) {
+            controller_data->banks[b] = (bank_t){(int16_t)lowest_floor, (int16_t)highest_floor, shard};
+            controller_data->bank_count++;
         }
+    }
+    return shard;
+}
 
-        // Calculate distance score
-        int current_floor = stringToFloor(car->currentfloor);
-        int distance = abs(current_floor - source_floor);
+// Function to add a registering car to its bank's shard, unless a car with
+// the same name is connected to any shard. Registrations hold the bank lock
+// throughout, so two cars with one name can't both get in.
+// Returns the shard, or NULL if the name is taken.
+shard_t *register_car(controller_data_t *controller_data, connectedcar_t *car) {
+    shard_t *shard = NULL;
+    bool taken = false;
+    pthread_mutex_lock(&controller_data->bank_lock);
+    for (size_t s = 0; s < controller_data->shard_count && !taken; s++) {
+        pthread_mutex_lock(&controller_data->shards[s].lock);
+        taken = controller_find_by_name(&controller_data->shards[s].controller, car->name) != NULL;
+        pthread_mutex_unlock(&controller_data->shards[s].lock);
+    }
+    if (!taken) {
+        shard = shard_for_bank(controller_data, car->lowest_floor, car->highest_floor);
+        pthread_mutex_lock(&shard->lock);
+        controller_push(&shard->controller, car);
+        shard_update_floors(shard);
+        pthread_mutex_unlock(&shard->lock);
+    }
+    pthread_mutex_unlock(&controller_data->bank_lock);
+    return shard;
+}
 
-        // Prefer cars already moving in the right direction
-        Direction request_direction = (dest_floor > source_floor) ? DIRECTION_UP : DIRECTION_DOWN;
-        if (car->current_direction == request_direction) {
-            distance -= 5; // Bonus for matching direction
-        }
+// Function to send a message to a client without waiting, so it can be
+// called with a shard locked. Whatever the socket won't take now is queued on
+// the connection and sent by its loop on EPOLLOUT.
+bool send_message(connection_t *conn, const message_t *message, bool binary) {
+    char frame[sizeof(uint32_t) + PROTOCOL_MAX_FRAME];
+    size_t length = protocol_frame(message, binary, frame);
+    return connection_send(conn, frame, length);
+}
 
-        // Prefer cars with shorter queues
-        QueueNode* temp = car->queue_head;
-        int queue_length = 0;
-        while (temp) {
-            queue_length++;
-            if (temp != NULL) {
-                temp = temp->next;
-            }
-        }
-        distance += queue_length * 2;
+// Assignment stage for a CALL, run on the thread of the pad that sent it.
+// Only shards with cars covering both floors are looked at. They are locked
+// in index order, so concurrent calls can't deadlock, and only the shard
+// holding the cheapest car so far stays locked, until that car has been
+// queued and its FLOOR handed to its connection.
+bool handle_elevator_call(controller_data_t *controller_data, int source_floor, int dest_floor, char* selected_car_name) {
+    int low = (source_floor < dest_floor) ? source_floor : dest_floor;
+    int high = (source_floor < dest_floor) ? dest_floor : source_floor;
+    shard_t *best_shard = NULL;
+    connectedcar_t* best_car = NULL;
+    int64_t best_cost = 0;
 
-        if (distance < min_distance) {
-            min_distance = distance;
+    for (size_t s = 0; s < controller_data->shard_count; s++) {
+        shard_t *shard = &controller_data->shards[s];
+        if (atomic_load(&shard->lowest_floor) > low || atomic_load(&shard->highest_floor) < high) {
+            continue;
+        }
+        pthread_mutex_lock(&shard->lock);
+        int64_t cost;
+        connectedcar_t* car = controller_best_car(&shard->controller, source_floor, dest_floor, &cost);
+        if (car != NULL && (best_car == NULL || cost < best_cost)) {
+            if (best_shard != NULL) {
+                pthread_mutex_unlock(&best_shard->lock);
+            }
+            best_shard = shard;
             best_car = car;
+            best_cost = cost;
+        } else {
+            pthread_mutex_unlock(&shard->lock);
         }
     }
 
-    if (best_car) {
-        if (add_to_car_queue(best_car, source_floor, dest_floor)) {
-            strcpy(selected_car_name, best_car->name);
-            printf("Selected car: %s\n", best_car->name);
-
-            // Send new destination if queue was empty
-            if (strcmp(best_car->destinationfloor, best_car->currentfloor) == 0) {
-                int next_dest = get_next_destination(best_car);
-                char next_dest_string[4];
-                floorToString(next_dest_string, next_dest);
-                printf("Next destination: %s\n", next_dest_string);
-
-                if (next_dest != -1) {
-                    snprintf(best_car->destinationfloor, sizeof(best_car->destinationfloor), "%d", next_dest);
-                    snprintf(controller_data->buffer, BUFFER_SIZE, "FLOOR %s", next_dest_string);
-
-                    int car_socket = controller_get_socket_by_name(&controller_data->controller, best_car->name);
-                    if (car_socket == -1) {
-                        fprintf(stderr, "Error: Could not find socket for car %s\n", best_car->name);
-                        return false;
-                    }
-
-                    uint32_t length = htonl(strlen(controller_data->buffer));
-                    if (send(car_socket, &length, sizeof(length), 0) == -1) {
-                        perror("send");
-                        close(car_socket);
-                        FD_CLR(car_socket, master_set);
-                    }
-                    if (send(car_socket, controller_data->buffer, strlen(controller_data->buffer), 0) == -1) {
-                        perror("send");
-                        close(car_socket);
-                        FD_CLR(car_socket, master_set);
-                    }  
-                }
+    bool assigned = (best_car != NULL && add_to_car_queue(best_car, source_floor, dest_floor));
+    if (assigned) {
+        strcpy(selected_car_name, best_car->name);
+        printf("Selected car: %s\n", best_car->name);
+
+        int next_dest;
+        if (car_dispatch_call(best_car, &next_dest)) {
+            message_t floor = {.type = MSG_FLOOR, .floor = {(int16_t)next_dest}};
+            char next_dest_string[4];
+            floorToString(next_dest_string, next_dest);
+            printf("Next destination: %s\n", next_dest_string);
+
+            if (!send_message(best_car->connection, &floor, best_car->binary)) {
+                // Let the event loop reap the connection so its context is freed once
+                shutdown(best_car->connectionsocket, SHUT_RDWR);
             }
-            return true;
         }
     }
-
-    return false;
+    if (best_shard != NULL) {
+        pthread_mutex_unlock(&best_shard->lock);
+    }
+    return assigned;
 }
 
-
-
-// Signal handler for graceful termination
+// Signal handler for graceful termination. The shards may hold each other's
+// locks, so rather than being cancelled they are woken to stop by themselves.
 void handle_sigint(int sig) {
     printf("\nCaught signal %d, closing server socket and exiting...\n", sig);
     thread_stop_signal = 1;
-    // pthread_cancel(diagnostic_thread_tid);
-    pthread_cancel(tcp_communication_tid);
-    pthread_cancel(process_tid);
-    pthread_join(tcp_communication_tid, NULL);
-    pthread_join(process_tid, NULL);
-    controller_destroy(&controller_data.controller);
-    exit(EXIT_SUCCESS);
+    uint64_t one = 1;
+    if (write(controller_data.stop_fd, &one, sizeof(one)) == -1) {
+        _exit(EXIT_FAILURE);
+    }
 }
 
 
@@ -200,250 +292,287 @@ void *process_thread(void *arg){
     return NULL;
 }
 
-void *tcp_communication_thread(void *arg) {
-    controller_data_t *controller_data;
-    controller_data = arg;
-
-    int client_sockfd;
-    struct sockaddr_in server_address, client_address;
-    controller_data->server_sockfd = create_socket();
-    
-    // Prepare the sockaddr_in structure
-    server_address.sin_family = AF_INET;
-    server_address.sin_addr.s_addr = INADDR_ANY;
-    server_address.sin_port = htons(PORT);
+// Function to act on one complete frame received from a client, in either
+// encoding. Replies go out in the encoding the client asked for. A CAR moves
+// the connection to its bank's shard, which owner is set to.
+// Returns false if the connection should be closed.
+bool handle_client_frame(controller_data_t *controller_data, shard_t **owner, connection_t *conn,
+                         const char *frame, size_t length) {
+    int i = conn->fd;
+    message_t message, reply;
+    bool sent = true;
+
+    if (!protocol_decode(frame, length, &message)) {
+        return true;
+    }
+    if (message.binary) {
+        conn->binary = true;
+    }
 
-    // Bind the socket
-    bind_socket(controller_data->server_sockfd, &server_address);
+    switch (message.type) {
+        case MSG_CALL: {
+            char selected_car[50];
+            memset(&reply, 0, sizeof(reply));
+            if (handle_elevator_call(controller_data, message.floor[0], message.floor[1], selected_car)) {
+                reply.type = MSG_ASSIGNED;
+                strcpy(reply.name, selected_car);
+            } else {
+                reply.type = MSG_UNAVAILABLE;
+            }
+            return send_message(conn, &reply, conn->binary);
+        }
+        case MSG_CAR: {
+            connectedcar_t car;
+            // protocol_decode has already refused floors outside the labelled
+            // range, in either encoding, so only the order is left to check
+            if (message.floor[0] >= message.floor[1]) {
+                printf("Car %s has no floors to serve\n", message.name);
+                return false;
+            }
+            connectedcar_init(&car, message.name, message.floor[0], message.floor[1], i);
+            car.connection = conn;
+            car.binary = conn->binary;
+            shard_t *shard = register_car(controller_data, &car);
+            if (shard == NULL) {
+                printf("Car %s is already connected\n", message.name);
+                return false;
+            }
+            *owner = shard;
+            break;
+        }
+        case MSG_STATUS:
+        case MSG_STATUS_ONLY: {
+            shard_t *shard = *owner;
+            pthread_mutex_lock(&shard->lock);
+            connectedcar_t* car = controller_find_by_socket(&shard->controller, i);
+            if (car != NULL) {
+                int next_dest;
+                if (message.type == MSG_STATUS_ONLY) {
+                    message.floor[0] = car->currentfloor;
+                    message.floor[1] = car->reported_destination;
+                }
+                if (car_update_status(car, status_names[message.status], message.floor[0], message.floor[1],
+                                      monotonic_ms(), &next_dest)) {
+                    memset(&reply, 0, sizeof(reply));
+                    reply.type = MSG_FLOOR;
+                    reply.floor[0] = (int16_t)next_dest;
+                    sent = send_message(conn, &reply, conn->binary);
+                }
+            }
+            pthread_mutex_unlock(&shard->lock);
+            break;
+        }
+        default:
+            break;
+    }
+    return sent;
+}
 
-    // Listen for incoming connections
-    listen_socket(controller_data->server_sockfd);
-    printf("Server listening on port %d\n", PORT);
+// Function to add a connection to an epoll instance. The connection is handed
+// back by epoll_wait so dispatch never has to search for the socket. Every
+// shard watches the listening socket, but only one is woken per connection.
+// A client is also watched for EPOLLOUT while it has replies queued.
+bool watch_connection(int epoll_fd, connection_t *conn) {
+    uint32_t events = EPOLLIN | EPOLLET;
+    events |= conn->listener ? EPOLLEXCLUSIVE : EPOLLRDHUP;
+    return connection_watch(conn, epoll_fd, events);
+}
 
-    // Initialize the master and temp sets
-    fd_set master_set, read_fds;
-    int fdmax, i;
-    
+// Function to register a socket with the epoll instance
+connection_t *register_connection(int epoll_fd, int sockfd, bool listener) {
+    connection_t *conn = connection_create(sockfd, listener);
+    if (conn != NULL && !watch_connection(epoll_fd, conn)) {
+        connection_destroy(conn);
+        return NULL;
+    }
+    return conn;
+}
 
-    FD_ZERO(&master_set);
-    FD_ZERO(&read_fds);
+// Function to drop a client, forgetting the car registered on it (if any).
+// owner is the shard the car belongs to. Once the car is gone no other thread
+// can queue on the connection, so it is freed.
+void close_connection(shard_t *owner, connection_t *conn) {
+    pthread_mutex_lock(&owner->lock);
+    const char* name = controller_get_name_by_socket(&owner->controller, conn->fd);
+    if (name != NULL) {
+        printf("Socket %s hung up \n", name);
+        controller_remove_by_socket(&owner->controller, conn->fd);
+        shard_update_floors(owner);
+    } else {
+        printf("Socket callpad hung up \n");
+    }
+    pthread_mutex_unlock(&owner->lock);
+    connection_unwatch(conn);
+    close(conn->fd);
+    connection_destroy(conn);
+}
 
-    // Add the server socket to the master set
-    FD_SET(controller_data->server_sockfd, &master_set);
-    fdmax = controller_data->server_sockfd;
+// Function to handle readiness on a client socket. Queued replies are sent
+// first when it is writable. The socket is registered edge-triggered, so it
+// is read until recv() would block. Every complete
+// frame is handled and a trailing partial frame waits in the connection's
+// buffer for the next edge. A car connection that registered on another
+// shard's bank is only handed over once the socket has been drained, so the
+// two loops never read it at the same time.
+void handle_client_events(controller_data_t *controller_data, shard_t *shard, connection_t *conn, uint32_t events) {
+    shard_t *owner = shard;
+    if ((events & EPOLLERR) || ((events & EPOLLOUT) && !connection_flush(conn))) {
+        close_connection(owner, conn);
+        return;
+    }
 
-    while (thread_stop_signal != 1) {
-        read_fds = master_set; // Copy the master set to the temp set
+    char message[BUFFER_SIZE];
+    connection_status_t status;
+    do {
+        status = connection_fill(conn);
 
-        // Use select to wait for activity on any of the sockets
-        if (select(fdmax + 1, &read_fds, NULL, NULL, NULL) == -1) {
-            perror("select");
-            exit(EXIT_FAILURE);
+        int frame_length;
+        while ((frame_length = connection_next_frame(conn, message, sizeof(message))) > 0) {
+            if (!handle_client_frame(controller_data, &owner, conn, message, (size_t)frame_length)) {
+                close_connection(owner, conn);
+                return;
+            }
         }
+        if (frame_length == -1) {
+            printf("Socket %d sent an invalid message length\n", conn->fd);
+            close_connection(owner, conn);
+            return;
+        }
+    } while (status == CONNECTION_FULL);
 
-        // Loop through the file descriptors to check which ones are ready
-        for (i = 0; i <= fdmax; i++) {
-            if (FD_ISSET(i, &read_fds)) {
-                if (i == controller_data->server_sockfd) {
-                    // Handle new connections
-                    client_sockfd = accept_connection(controller_data->server_sockfd, &client_address);
-                    printf("New connection accepted\n");
-
-                    // Add the new client socket to the master set
-                    FD_SET(client_sockfd, &master_set);
-                    if (client_sockfd > fdmax) {
-                        fdmax = client_sockfd;
-                    }
-                } else {
-                    // Handle data from a client
-                    
-                    uint32_t full_length;
-                    controller_data->bytes_read = recv(i, &full_length, sizeof(full_length), MSG_WAITALL);
-                    if (controller_data->bytes_read <= 0) {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                        // No data available, continue the loop
-                        continue;
-                        } else 
-                        if (controller_data->bytes_read == 0) {
-                           
-                            char* name = controller_get_name_by_socket(&controller_data->controller, i);
-                            controller_remove_by_name(&controller_data->controller, name);
-                            if (name != NULL){printf("Socket %s hung up \n", name);}else{printf("Socket callpad hung up \n");}
-                            close(i);
-                            FD_CLR(i, &master_set);
-                        } else {
-                            perror("recv");
-                        }
-                        close(i);
-                        FD_CLR(i, &master_set);
-                        continue;
-                    }
-              
-
-
+    if (status != CONNECTION_DRAINED) {
+        close_connection(owner, conn);
+        return;
+    }
+    if (owner != shard) {
+        // Anything that arrived since the last read is reported by the new
+        // loop as soon as the socket is added to it
+        connection_unwatch(conn);
+        if (!watch_connection(owner->epoll_fd, conn)) {
+            close_connection(owner, conn);
+        }
+    }
+}
 
+// Thread function for one shard's event loop
+void *shard_thread(void *arg) {
+    shard_t *shard = arg;
+    struct epoll_event events[MAX_EVENTS];
+    struct sockaddr_in client_address;
+    int client_sockfd;
 
-                    uint32_t response_length = ntohl(full_length);
-                    if (response_length == 0) {
-                        printf("Socket %d hung up \n", i);
-                        close(i);
-                        FD_CLR(i, &master_set);
-                    }
+    while (thread_stop_signal != 1) {
+        // Wait for activity, only ready sockets are returned
+        int ready = epoll_wait(shard->epoll_fd, events, MAX_EVENTS, -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
 
-                    // Null-terminate the buffer
-                    controller_data->buffer[response_length + 1];
-
-                    controller_data->bytes_read = recv(i, controller_data->buffer, response_length, MSG_WAITALL);
-                    if (controller_data->bytes_read <= 0) {
-                        if (controller_data->bytes_read == 0) {
-                            printf("Socket %d hung up \n", i);
-                            close(i);
-                            FD_CLR(i, &master_set);
-                        } else {
-                            perror("recv");
-                        }
-                        close(i);
-                        FD_CLR(i, &master_set);
-                    }
-                    controller_data->buffer[response_length] = '\0';  // Null-terminate response string
-
-                    // Process the received data
-                    char command[5];
-                    strncpy(command, controller_data->buffer, 4);
-                    command[4] = '\0';
-
-                    switch (command[0]) {
-                        case 'C':
-                            if (strcmp(command, "CALL") == 0) {
-                                char source[4], destination[4], selected_car[50];
-                                sscanf(controller_data->buffer, "CALL %s %s", source, destination);
-
-                                if (handle_elevator_call(controller_data, stringToFloor(source), stringToFloor(destination), selected_car,&master_set)) {
-                                    snprintf(controller_data->buffer, BUFFER_SIZE, "CAR %s", selected_car);
-                                } else {
-                                    strncpy(controller_data->buffer, "UNAVAILABLE", BUFFER_SIZE);
-                                }
-
-                                uint32_t length = htonl(strlen(controller_data->buffer));
-                                if (send(i, &length, sizeof(length), 0) == -1) {
-                                    perror("send");
-                                    close(i);
-                                    FD_CLR(i, &master_set);
-                                    continue;
-                                }
-                                if (send(i, controller_data->buffer, strlen(controller_data->buffer), 0) == -1) {
-                                    perror("send");
-                                    close(i);
-                                    FD_CLR(i, &master_set);
-                                    continue;
-                                }
-                            } else if (strcmp(command, "CAR ") == 0) {
-                                char name[50], lowest_floor[4], highest_floor[4];
-                                sscanf(controller_data->buffer, "CAR %s %s %s", name, lowest_floor, highest_floor);
-
-                                connectedcar_t car;
-                                strncpy(car.name, name, sizeof(car.name) - 1);
-                                strncpy(car.lowest_floor, lowest_floor, sizeof(car.lowest_floor) - 1);
-                                strncpy(car.highest_floor, highest_floor, sizeof(car.highest_floor) - 1);
-                                strncpy(car.previous_status, "IDLE", sizeof(car.previous_status) - 1);
-                                car.previous_status[sizeof(car.previous_status) - 1] = '\0';
-                                car.name[sizeof(car.name) - 1] = '\0';
-                                car.lowest_floor[sizeof(car.lowest_floor) - 1] = '\0';
-                                car.highest_floor[sizeof(car.highest_floor) - 1] = '\0';
-                                car.connectionsocket = i;
-                                controller_push(&controller_data->controller, &car);
-                            }
-                            break;
-                        case 'S':
-                            if (strcmp(command, "STAT") == 0) {
-                                char status[8], current_floor[4], destination_floor[4];
-                                const char* name = controller_get_name_by_socket(&controller_data->controller, i);
-                                if (name != NULL) {
-                                    sscanf(controller_data->buffer, "STATUS %7s %3s %3s", status, current_floor, destination_floor);
-
-                                    // Update car status
-                                    controller_set(&controller_data->controller, name, 3, status);
-                                    controller_set(&controller_data->controller, name, 4, current_floor);
-                                    controller_set(&controller_data->controller, name, 5, destination_floor);
-
-                                    for (size_t j = 0; j < controller_data->controller.size; j++) {
-                                        if (strcmp(controller_data->controller.data[j].name, name) == 0) {
-                                            connectedcar_t* car = &controller_data->controller.data[j];
-
-                                            // Update elevator status
-                                            // If car has arrived at destination, remove from queue and get next destination
-                                            if (strcmp(car->previous_status, "Closing") == 0 && strcmp(car->status, "Closed") == 0) {
-                                                remove_from_car_queue(car);
-                                                int next_dest = get_next_destination(car);
-                                                char next_dest_str[4];
-                                                floorToString(next_dest_str, next_dest);
-                                                if (next_dest != -1) {
-                                                    snprintf(controller_data->buffer, BUFFER_SIZE, "FLOOR %s", next_dest_str);
-
-                                                    uint32_t length = htonl(strlen(controller_data->buffer));
-                                                    if (send(i, &length, sizeof(length), 0) == -1) {
-                                                        perror("send");
-                                                        close(i);
-                                                        FD_CLR(i, &master_set);
-                                                        continue;
-                                                    }
-                                                    if (send(i, controller_data->buffer, strlen(controller_data->buffer), 0) == -1) {
-                                                        perror("send");
-                                                        close(i);
-                                                        FD_CLR(i, &master_set);
-                                                        continue;
-                                                    }
-                                                }
-                                            }
-                                            break;
-                                        }
-                                    }
-                                    controller_set(&controller_data->controller, name, 7, status);
-                                }
-                            }
-                            break;
-                        default:
-                            break;
+        for (int n = 0; n < ready; n++) {
+            connection_t *conn = events[n].data.ptr;
+            if (conn == NULL) {
+                // Woken to stop
+                continue;
+            }
+            if (conn->listener) {
+                // Handle new connections until the backlog is empty
+                while ((client_sockfd = accept_connection(controller_data.server_sockfd, &client_address)) != -1) {
+                    printf("New connection accepted\n");
+                    if (set_nonblocking(client_sockfd) == -1 ||
+                        register_connection(shard->epoll_fd, client_sockfd, false) == NULL) {
+                        close(client_sockfd);
                     }
                 }
+            } else {
+                // Handle data from a client
+                handle_client_events(&controller_data, shard, conn, events[n].events);
             }
         }
     }
+    return NULL;
 }
 
+// Function to set up a shard's loop, watching the listening socket and the
+// stop eventfd
+void shard_init(controller_data_t *controller_data, shard_t *shard) {
+    pthread_mutex_init(&shard->lock, NULL);
+    controller_init(&shard->controller);
+    shard_update_floors(shard);
 
+    shard->epoll_fd = epoll_create1(0);
+    if (shard->epoll_fd == -1) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event stop_event;
+    stop_event.events = EPOLLIN;
+    stop_event.data.ptr = NULL;
+    if (register_connection(shard->epoll_fd, controller_data->server_sockfd, true) == NULL ||
+        epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, controller_data->stop_fd, &stop_event) == -1) {
+        exit(EXIT_FAILURE);
+    }
+}
 
+int main(int argc, char *argv[]){
+    signal(SIGINT, handle_sigint);
 
+    controller_data.shard_count = 1;
+    if (argc == 3 && strcmp(argv[1], "--shards") == 0) {
+        controller_data.shard_count = (size_t)atoi(argv[2]);
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--shards n]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (controller_data.shard_count < 1 || controller_data.shard_count > MAX_SHARDS) {
+        fprintf(stderr, "Error: Shards must be between 1 and %d.\n", MAX_SHARDS);
+        exit(EXIT_FAILURE);
+    }
 
+    struct sockaddr_in server_address;
+    controller_data.server_sockfd = create_socket();
 
+    // Prepare the sockaddr_in structure
+    server_address.sin_family = AF_INET;
+    server_address.sin_addr.s_addr = INADDR_ANY;
+    server_address.sin_port = htons(PORT);
 
+    // Bind the socket
+    bind_socket(controller_data.server_sockfd, &server_address);
 
+    // Listen for incoming connections
+    listen_socket(controller_data.server_sockfd);
+    printf("Server listening on port %d\n", PORT);
 
-
-
-
-
-
-int main(void){
-    signal(SIGINT, handle_sigint);
-
-    
-    // Register signal handler for SIGINT (CTRL + C)
-    controller_init(&controller_data.controller);
-    // Create socket
-    if (pthread_create(&tcp_communication_tid, NULL, tcp_communication_thread, &controller_data) != 0) {
-        perror("pthread_create");
+    pthread_mutex_init(&controller_data.bank_lock, NULL);
+    controller_data.stop_fd = eventfd(0, EFD_NONBLOCK);
+    if (controller_data.stop_fd == -1 || set_nonblocking(controller_data.server_sockfd) == -1) {
+        perror("eventfd");
         exit(EXIT_FAILURE);
     }
+    for (size_t s = 0; s < controller_data.shard_count; s++) {
+        shard_init(&controller_data, &controller_data.shards[s]);
+        if (pthread_create(&controller_data.shards[s].tid, NULL, shard_thread, &controller_data.shards[s]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
     if (pthread_create(&process_tid, NULL, process_thread, &controller_data) != 0) {
         perror("pthread_create");
         exit(EXIT_FAILURE);
     }
 
-    pthread_join(tcp_communication_tid, NULL);
+    for (size_t s = 0; s < controller_data.shard_count; s++) {
+        pthread_join(controller_data.shards[s].tid, NULL);
+    }
+    pthread_cancel(process_tid);
     pthread_join(process_tid, NULL);
-    controller_destroy(&controller_data.controller);
-    // Close the server socket (this line will never be reached due to the infinite loop)
-
+    for (size_t s = 0; s < controller_data.shard_count; s++) {
+        controller_destroy(&controller_data.shards[s].controller);
+    }
+    close(controller_data.server_sockfd);
     return 0;
 }
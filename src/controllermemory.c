@@ -8,130 +8,664 @@
 #include "sharedmemory.h"
 #include "controllermemory.h"
 
-#define INITIAL_CAPACITY 10
 #define GROWTH_FACTOR 2
-#define MAX_QUEUE_SIZE 50
 
 void queue_init(connectedcar_t* car) {
-    car->queue_head = NULL;
+    car->queue_start = 0;
+    car->queue_length = 0;
+    memset(car->stops, 0, sizeof(car->stops));
     car->current_direction = DIRECTION_IDLE;
     car->elevator_status = stringToStatus(car->status);
 }
 
 bool can_service_request(connectedcar_t* car, int source_floor, int dest_floor) {
-    if (car == NULL || car->highest_floor == NULL || car->lowest_floor == NULL) {
+    if (car == NULL) {
         return false;
     }
-    printf("source floor: %s\n", car->highest_floor);   
-    printf("dest floor: %s\n", car->lowest_floor);
-
-    int highest = stringToFloor(car->highest_floor);
-    int lowest = stringToFloor(car->lowest_floor);
-    return source_floor >= lowest && source_floor <= highest &&
-           dest_floor >= lowest && dest_floor <= highest;
+    return source_floor >= car->lowest_floor && source_floor <= car->highest_floor &&
+           dest_floor >= car->lowest_floor && dest_floor <= car->highest_floor;
 }
 
 
 
-bool add_to_car_queue(connectedcar_t* car, int source_floor, int dest_floor) {
-    Direction request_direction = (dest_floor > source_floor) ? DIRECTION_UP : DIRECTION_DOWN;
-    int current_floor = stringToFloor(car->currentfloor);
-    
-    // Create new nodes
-    QueueNode* source_node = malloc(sizeof(QueueNode));
-    QueueNode* dest_node = malloc(sizeof(QueueNode));
-    if (!source_node || !dest_node) {
-        free(source_node);
-        free(dest_node);
+// Function to get the queue entry at a position counted from the head
+static QueueNode* queue_at(connectedcar_t* car, size_t pos) {
+    return &car->queue[(car->queue_start + pos) % MAX_QUEUE_SIZE];
+}
+
+// Function to set or clear a floor's bit in a car's stop bitsets. Floors
+// without a label have no bit, and are only ever found by walking the queue.
+// The controller never registers such a car; the check stays for other
+// users of controller_t, such as the simulator.
+static void stop_bit_set(connectedcar_t* car, int floor, Direction direction, bool set) {
+    if (floor < FLOOR_LOWEST || floor > FLOOR_HIGHEST || direction == DIRECTION_IDLE) {
+        return;
+    }
+    size_t bit = (size_t)(floor - FLOOR_LOWEST);
+    uint64_t mask = (uint64_t)1 << (bit % 64);
+    if (set) {
+        car->stops[direction][bit / 64] |= mask;
+    } else {
+        car->stops[direction][bit / 64] &= ~mask;
+    }
+}
+
+bool car_has_stop(const connectedcar_t* car, int floor, Direction direction) {
+    if (floor < FLOOR_LOWEST || floor > FLOOR_HIGHEST || direction == DIRECTION_IDLE) {
         return false;
     }
-    
-    source_node->floor = source_floor;
-    source_node->direction = request_direction;
-    dest_node->floor = dest_floor;
-    dest_node->direction = request_direction;
-    
-    // Empty queue case
-    if (!car->queue_head) {
-        source_node->next = dest_node;
-        dest_node->next = NULL;
-        car->queue_head = source_node;
-        return true;
+    size_t bit = (size_t)(floor - FLOOR_LOWEST);
+    return (car->stops[direction][bit / 64] >> (bit % 64)) & 1;
+}
+
+// Function to insert a stop at a position in the queue
+static void queue_insert(connectedcar_t* car, size_t pos, const QueueNode* stop) {
+    for (size_t i = car->queue_length; i > pos; i--) {
+        *queue_at(car, i) = *queue_at(car, i - 1);
     }
-    
-    // Find appropriate position in queue based on direction blocks
-    QueueNode* current = car->queue_head;
-    QueueNode* prev = NULL;
-    Direction current_block_direction = car->current_direction;
-    
-    // Special case: if current floor equals source floor
-    if (current_floor == source_floor && 
-        car->elevator_status != Closing) {
-        // Insert at beginning if going in same direction
-        if (car->current_direction == request_direction || 
-            car->current_direction == DIRECTION_IDLE) {
-            source_node->next = car->queue_head;
-            dest_node->next = source_node->next;
-            car->queue_head = source_node;
-            return true;
+    *queue_at(car, pos) = *stop;
+    car->queue_length++;
+    stop_bit_set(car, stop->floor, stop->direction, true);
+}
+
+// Function to make the queue entries for a passenger's pickup and drop-off
+static void call_stops(int source_floor, int dest_floor, QueueNode* pickup, QueueNode* dropoff) {
+    Direction direction = (dest_floor > source_floor) ? DIRECTION_UP : DIRECTION_DOWN;
+    *pickup = (QueueNode){source_floor, direction, true, source_floor};
+    *dropoff = (QueueNode){dest_floor, direction, false, source_floor};
+}
+
+// Function to count the floors between two floors, remembering there is no floor 0
+static int floor_distance(int from, int to) {
+    int distance = abs(to - from);
+    if ((from < 0) != (to < 0)) {
+        distance--;
+    }
+    return distance;
+}
+
+// Function to get where and when, in car delays, a car's stops are timed
+// from: the floor it's on once its doors are shut, or the floor it's about
+// to reach if it's moving
+static void plan_start(const connectedcar_t* car, int* start_floor, int* start_time) {
+    int floor = car->currentfloor;
+    int time;
+
+    switch (car->elevator_status) {
+        case Opening: time = DOOR_STEPS; break;
+        case Open:    time = DOOR_STEPS - 1; break;
+        case Closing: time = 1; break;
+        case Between:
+            // Already on the way to the next floor, which it has to reach first
+            time = 1;
+            if (car->destinationfloor != car->currentfloor) {
+                floor += (car->destinationfloor > car->currentfloor) ? 1 : -1;
+                if (floor == 0) {
+                    floor += (car->destinationfloor > 0) ? 1 : -1;
+                }
+            }
+            break;
+        default:      time = 0; break;
+    }
+    *start_floor = floor;
+    *start_time = time;
+}
+
+// Function to play a stop list forward, giving the time in car delays at
+// which the car reaches each stop
+static void plan_arrivals(const connectedcar_t* car, const QueueNode* stops, size_t count, int* arrivals) {
+    int floor, time;
+
+    plan_start(car, &floor, &time);
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && stops[i].floor == stops[i - 1].floor) {
+            // Served by the same door cycle as the stop before
+            arrivals[i] = arrivals[i - 1];
+            continue;
         }
+        time += floor_distance(floor, stops[i].floor);
+        arrivals[i] = time;
+        time += DOOR_STEPS;
+        floor = stops[i].floor;
     }
-    
-    // Find appropriate block for insertion
-    while (current != NULL) {
-        // Check if we can insert in current direction block
-        if (current_block_direction == request_direction) {
-            if ((request_direction == DIRECTION_UP && 
-                 source_floor >= current->floor) ||
-                (request_direction == DIRECTION_DOWN && 
-                 source_floor <= current->floor)) {
-                // Insert here
-                source_node->next = current->next;
-                dest_node->next = source_node->next;
-                current->next = source_node;
-                return true;
+}
+
+// Function to check that nobody is ever carried away from where they are
+// going: between getting on and off, every stop lies between their two floors.
+// That also makes the car leave each pickup heading the passenger's way, which
+// is the only way they will board.
+static bool route_keeps_riders_on_course(const QueueNode* stops, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        if (stops[k].pickup) {
+            continue;
+        }
+        int low = (stops[k].origin < stops[k].floor) ? stops[k].origin : stops[k].floor;
+        int high = (stops[k].origin > stops[k].floor) ? stops[k].origin : stops[k].floor;
+
+        // Back to where they get on, or the start if they're already aboard
+        for (size_t i = k; i-- > 0;) {
+            if (stops[i].pickup && stops[i].floor == stops[k].origin && stops[i].direction == stops[k].direction) {
+                break;
+            }
+            if (stops[i].floor < low || stops[i].floor > high) {
+                return false;
             }
         }
-        
-        // Check for direction change
-        if (current->next && 
-            current->direction != current->next->direction) {
-            current_block_direction = current->next->direction;
+    }
+    return true;
+}
+
+// Function to build the queue with a new pickup at pickup_pos, then its
+// drop-off at dropoff_pos counted after the pickup went in
+static void route_with_call(const QueueNode* stops, size_t count, size_t pickup_pos, size_t dropoff_pos,
+                            const QueueNode* pickup, const QueueNode* dropoff, QueueNode* route) {
+    size_t from = 0;
+    for (size_t i = 0; i < count + 2; i++) {
+        if (i == pickup_pos) {
+            route[i] = *pickup;
+        } else if (i == dropoff_pos) {
+            route[i] = *dropoff;
+        } else {
+            route[i] = stops[from++];
         }
-        
-        prev = current;
-        current = current->next;
     }
-    
-    // If no suitable position found, add to end
-    if (prev) {
-        prev->next = source_node;
-        source_node->next = dest_node;
-        dest_node->next = NULL;
+}
+
+// Function to find a passenger already queued to get on where a new one
+// is waiting and off where they are going: a drop-off at the destination for
+// someone from the source, after a pickup at the source heading the same way.
+// The nearest such pickup is the one the queue already keeps on course. The
+// bitsets rule out most calls before the queue is walked.
+static bool find_same_journey(const connectedcar_t* car, const QueueNode* pickup, const QueueNode* dropoff,
+                              size_t* pickup_pos, size_t* dropoff_pos) {
+    if (!car_has_stop(car, pickup->floor, pickup->direction) ||
+        !car_has_stop(car, dropoff->floor, dropoff->direction)) {
+        return false;
     }
-    
+    bool picked_up = false;
+    for (size_t i = 0; i < car->queue_length; i++) {
+        const QueueNode* stop = &car->queue[(car->queue_start + i) % MAX_QUEUE_SIZE];
+        if (stop->direction != pickup->direction) {
+            continue;
+        }
+        if (stop->pickup && stop->floor == pickup->floor) {
+            picked_up = true;
+            *pickup_pos = i;
+        } else if (picked_up && !stop->pickup && stop->floor == dropoff->floor && stop->origin == pickup->floor) {
+            *dropoff_pos = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to find the cheapest places in the queue for a pickup and its
+// drop-off, in car delays. The cost is the time until the new passenger is
+// picked up plus the time until they get off, so waiting counts twice (people
+// mind waiting for a car more than riding in one), plus whatever the detour
+// adds to every stop already queued for someone else. A passenger making the
+// same journey as one already queued just rides along with them, for no
+// detour, and *joined is set instead of searching the queue.
+static int64_t cheapest_insertion(const connectedcar_t* car, int source_floor, int dest_floor,
+                                  size_t* pickup_pos, size_t* dropoff_pos, bool* joined) {
+    size_t count = car->queue_length;
+    QueueNode pickup, dropoff;
+    QueueNode stops[MAX_QUEUE_SIZE], with_pickup[MAX_QUEUE_SIZE + 1], route[MAX_QUEUE_SIZE + 2];
+    int arrivals[MAX_QUEUE_SIZE], new_arrivals[MAX_QUEUE_SIZE + 1];
+    int64_t best_cost = -1;
+
+    call_stops(source_floor, dest_floor, &pickup, &dropoff);
+    for (size_t i = 0; i < count; i++) {
+        stops[i] = car->queue[(car->queue_start + i) % MAX_QUEUE_SIZE];
+    }
+    plan_arrivals(car, stops, count, arrivals);
+
+    *joined = find_same_journey(car, &pickup, &dropoff, pickup_pos, dropoff_pos);
+    if (*joined) {
+        return arrivals[*pickup_pos] + arrivals[*dropoff_pos];
+    }
+
+    // From the back, so a tie leaves the stops already queued undisturbed
+    for (size_t i = count + 1; i-- > 0;) {
+        for (size_t k = 0; k < count; k++) {
+            with_pickup[(k < i) ? k : k + 1] = stops[k];
+        }
+        with_pickup[i] = pickup;
+        plan_arrivals(car, with_pickup, count + 1, new_arrivals);
+
+        // How much the pickup alone delays the stops after it
+        int64_t pickup_delay = 0;
+        for (size_t k = i + 1; k < count + 1; k++) {
+            pickup_delay += new_arrivals[k] - arrivals[k - 1];
+        }
+
+        for (size_t j = count + 2; j-- > i + 1;) {
+            // The drop-off goes between with_pickup[j - 1] and with_pickup[j],
+            // moving every later stop by the same amount
+            int previous = with_pickup[j - 1].floor;
+            int64_t arrival = new_arrivals[j - 1];
+            int64_t shift = 0;
+            if (dest_floor != previous) {
+                arrival += DOOR_STEPS + floor_distance(previous, dest_floor);
+                if (j <= count) {
+                    int next = with_pickup[j].floor;
+                    int64_t next_arrival = (next == dest_floor) ? arrival :
+                                           arrival + DOOR_STEPS + floor_distance(dest_floor, next);
+                    shift = next_arrival - new_arrivals[j];
+                }
+            }
+
+            int64_t cost = new_arrivals[i] + arrival + pickup_delay + shift * (int64_t)(count + 1 - j);
+            if (best_cost >= 0 && cost >= best_cost) {
+                continue;
+            }
+            route_with_call(stops, count, i, j, &pickup, &dropoff, route);
+            if (route_keeps_riders_on_course(route, count + 2)) {
+                best_cost = cost;
+                *pickup_pos = i;
+                *dropoff_pos = j;
+            }
+        }
+    }
+
+    if (best_cost < 0) {
+        // Nowhere keeps everyone on course, so the call waits until the rest
+        // are done and costs more than any car that can take it properly
+        *pickup_pos = count;
+        *dropoff_pos = count + 1;
+        best_cost = INT32_MAX;
+    }
+    return best_cost;
+}
+
+static void car_table_sync(const connectedcar_t* car);
+
+bool add_to_car_queue(connectedcar_t* car, int source_floor, int dest_floor) {
+    QueueNode pickup, dropoff;
+    size_t pickup_pos, dropoff_pos;
+    bool joined;
+
+    if (car->queue_length + 2 > MAX_QUEUE_SIZE) {
+        return false;
+    }
+    call_stops(source_floor, dest_floor, &pickup, &dropoff);
+    cheapest_insertion(car, source_floor, dest_floor, &pickup_pos, &dropoff_pos, &joined);
+    if (joined) {
+        return true;
+    }
+    queue_insert(car, pickup_pos, &pickup);
+    queue_insert(car, dropoff_pos, &dropoff);
+    car_table_sync(car);
     return true;
 }
 
+int car_delay_estimate(const connectedcar_t* car) {
+    return (car->delay_ms > 0) ? car->delay_ms : DEFAULT_CAR_DELAY_MS;
+}
+
+// Function to copy a car's dispatch state into its controller's car table
+static void car_table_sync(const connectedcar_t* car) {
+    car_table_t* table = car->table;
+    int floor, time;
+
+    if (table == NULL) {
+        return;
+    }
+    plan_start(car, &floor, &time);
+    table->lowest_floor[car->row] = car->lowest_floor;
+    table->highest_floor[car->row] = car->highest_floor;
+    table->start_floor[car->row] = (int16_t)floor;
+    table->start_time[car->row] = (int16_t)time;
+    table->queue_length[car->row] = (int16_t)car->queue_length;
+    table->delay_ms[car->row] = car_delay_estimate(car);
+}
+
+int64_t car_call_cost(const connectedcar_t* car, int source_floor, int dest_floor) {
+    size_t pickup_pos, dropoff_pos;
+    bool joined;
+    return cheapest_insertion(car, source_floor, dest_floor, &pickup_pos, &dropoff_pos, &joined) *
+           car_delay_estimate(car);
+}
+
 
 // Function to get next destination floor for a car
 int get_next_destination(connectedcar_t* car) {
-    if (!car->queue_head) return -1;
-    return car->queue_head->floor;
+    if (car->queue_length == 0) return -1;
+    return queue_at(car, 0)->floor;
 }
 
 // Function to remove current floor from queue when reached
 void remove_from_car_queue(connectedcar_t* car) {
-    if (!car->queue_head) return;
+    if (car->queue_length == 0) return;
     
-    QueueNode* temp = car->queue_head;
-    car->queue_head = car->queue_head->next;
-    free(temp);
+    QueueNode removed = *queue_at(car, 0);
+    car->queue_start = (car->queue_start + 1) % MAX_QUEUE_SIZE;
+    car->queue_length--;
+
+    // The floor keeps its bit while another stop there heads the same way
+    bool still_queued = false;
+    for (size_t i = 0; i < car->queue_length && !still_queued; i++) {
+        const QueueNode* stop = queue_at(car, i);
+        still_queued = stop->floor == removed.floor && stop->direction == removed.direction;
+    }
+    if (!still_queued) {
+        stop_bit_set(car, removed.floor, removed.direction, false);
+    }
+    car_table_sync(car);
+}
+
+void connectedcar_init(connectedcar_t* car, const char* name, int lowest_floor, int highest_floor, int connection_socket) {
+    memset(car, 0, sizeof(*car));
+    strncpy(car->name, name, sizeof(car->name) - 1);
+    car->lowest_floor = (int16_t)lowest_floor;
+    car->highest_floor = (int16_t)highest_floor;
+    car->currentfloor = car->lowest_floor;
+    car->destinationfloor = car->lowest_floor;
+    car->reported_destination = car->lowest_floor;
+    strncpy(car->previous_status, "IDLE", sizeof(car->previous_status) - 1);
+    car->connectionsocket = connection_socket;
+    car->status_changed_ms = -1;
+    queue_init(car);
+}
+
+connectedcar_t* controller_best_car(const controller_t* controller, int source_floor, int dest_floor, int64_t* cost) {
+    const car_table_t* table = &controller->table;
+    size_t count = controller->size;
+    int low = (source_floor < dest_floor) ? source_floor : dest_floor;
+    int high = (source_floor < dest_floor) ? dest_floor : source_floor;
+    int ride = DOOR_STEPS + floor_distance(source_floor, dest_floor);
+
+    // Whoever gets the passenger has to reach them first, then carry them,
+    // and the call's cost counts the wait twice, so this is the least it can
+    // cost in car delays, or -1 if the car can't take it. No branches, so it
+    // vectorises across all the cars.
+    const int16_t* restrict lowest = table->lowest_floor;
+    const int16_t* restrict highest = table->highest_floor;
+    const int16_t* restrict start_floor = table->start_floor;
+    const int16_t* restrict start_time = table->start_time;
+    const int16_t* restrict queue_length = table->queue_length;
+    int32_t* restrict bounds = table->bound;
+    int source_basement = (source_floor < 0);
+    for (size_t i = 0; i < count; i++) {
+        int from = start_floor[i];
+        int distance = abs(from - source_floor) - ((from < 0) ^ source_basement);
+        int fits = -((lowest[i] <= low) & (highest[i] >= high) & (queue_length[i] <= MAX_QUEUE_SIZE - 2));
+        bounds[i] = ((2 * (start_time[i] + distance) + ride) & fits) | ~fits;
+    }
+
+    // Cost the car with the lowest bound first, then only the cars whose
+    // bound could still beat it. Ties go to the earlier car, as if every car
+    // were costed in order.
+    size_t best = count;
+    int64_t best_bound = 0;
+    for (size_t i = 0; i < count; i++) {
+        int64_t bound = (int64_t)table->bound[i] * table->delay_ms[i];
+        if (table->bound[i] >= 0 && (best == count || bound < best_bound)) {
+            best = i;
+            best_bound = bound;
+        }
+    }
+    if (best == count) {
+        *cost = 0;
+        return NULL;
+    }
+
+    // Find the car that can fit this passenger in for the least waiting and
+    // riding across everyone it is carrying
+    int64_t best_cost = car_call_cost(&controller->data[best], source_floor, dest_floor);
+    for (size_t i = 0; i < count; i++) {
+        int64_t bound = (int64_t)table->bound[i] * table->delay_ms[i];
+        if (table->bound[i] < 0 || i == best || bound > best_cost || (bound == best_cost && i > best)) {
+            continue;
+        }
+        int64_t car_cost = car_call_cost(&controller->data[i], source_floor, dest_floor);
+        if (car_cost < best_cost || (car_cost == best_cost && i < best)) {
+            best_cost = car_cost;
+            best = i;
+        }
+    }
+
+    *cost = best_cost;
+    return &controller->data[best];
+}
+
+connectedcar_t* controller_assign_call(controller_t* controller, int source_floor, int dest_floor) {
+    int64_t cost;
+    connectedcar_t* best_car = controller_best_car(controller, source_floor, dest_floor, &cost);
+    if (best_car == NULL || !add_to_car_queue(best_car, source_floor, dest_floor)) {
+        return NULL;
+    }
+    return best_car;
+}
+
+// Function to remove the stops at the floor a car's doors are open on
+static void remove_stops_at(connectedcar_t* car, int floor) {
+    while (car->queue_length > 0 && queue_at(car, 0)->floor == floor) {
+        remove_from_car_queue(car);
+    }
+}
+
+bool car_dispatch_call(connectedcar_t* car, int* next_floor) {
+    bool doors_open = car->elevator_status == Opening || car->elevator_status == Open;
+
+    // A passenger calling from where the doors are already open just gets on
+    if (doors_open) {
+        remove_stops_at(car, car->currentfloor);
+    }
+    if (car->queue_length == 0) {
+        return false;
+    }
+
+    // Send a car at rest to its first stop, and redirect any other car whose
+    // first stop changed
+    int head = queue_at(car, 0)->floor;
+    bool at_rest = !doors_open && car->destinationfloor == car->currentfloor;
+    if (!at_rest && head == car->destinationfloor) {
+        return false;
+    }
+    *next_floor = head;
+    car->destinationfloor = (int16_t)head;
+    car_table_sync(car);
+    return true;
+}
+
+// Function to tell whether a status change took exactly one car delay
+static bool is_timed_step(const connectedcar_t* car, Status status, int current_floor) {
+    switch (car->elevator_status) {
+        case Opening: return status == Open;
+        case Closing: return status == Closed;
+        case Between: return (status == Between && current_floor != car->currentfloor) || status == Opening;
+        default:      return false;
+    }
+}
+
+bool car_update_status(connectedcar_t* car, const char* status, int current_floor, int destination_floor, int64_t now_ms, int* next_floor) {
+    bool dispatch = false;
+    Status new_status = stringToStatus(status);
+
+    // Learn the car's delay from how far apart its timed steps are reported
+    if (is_timed_step(car, new_status, current_floor) && car->status_changed_ms >= 0) {
+        int sample = (int)(now_ms - car->status_changed_ms);
+        car->delay_ms = (car->delay_ms > 0) ? (3 * car->delay_ms + sample) / 4 : sample;
+    }
+    if (new_status != car->elevator_status || current_floor != car->currentfloor) {
+        car->status_changed_ms = now_ms;
+    }
+
+    strncpy(car->status, status, sizeof(car->status) - 1);
+    car->status[sizeof(car->status) - 1] = '\0';
+    car->elevator_status = new_status;
+    car->currentfloor = (int16_t)current_floor;
+    car->destinationfloor = (int16_t)destination_floor;
+    car->reported_destination = (int16_t)destination_floor;
+
+    // When the doors start opening at a queued stop, that stop is done and the
+    // car is told where to go next while its passengers board
+    if (car->elevator_status == Opening && strcmp(car->previous_status, "Opening") != 0 &&
+        car->queue_length > 0 && queue_at(car, 0)->floor == current_floor) {
+        remove_stops_at(car, current_floor);
+        if (car->queue_length > 0) {
+            *next_floor = queue_at(car, 0)->floor;
+            car->destinationfloor = (int16_t)*next_floor;
+            dispatch = true;
+        }
+    }
+
+    memcpy(car->previous_status, car->status, sizeof(car->previous_status));
+    car_table_sync(car);
+    return dispatch;
+}
+
+
+
+
+/**
+ * @brief Hashes a car name (FNV-1a).
+ * 
+ * @param name The car name.
+ * @return The hash value.
+ */
+static size_t hash_name(const char* name) {
+    size_t hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)name; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
+/**
+ * @brief Finds the name index slot holding a name, or the empty slot where it would go.
+ * 
+ * @param controller A pointer to the controller.
+ * @param name The car name.
+ * @return The slot number.
+ */
+static size_t name_index_slot(const controller_t* controller, const char* name) {
+    size_t mask = controller->name_index_capacity - 1;
+    size_t slot = hash_name(name) & mask;
+    while (controller->name_index[slot] != -1 &&
+           strcmp(controller->data[controller->name_index[slot]].name, name) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
 
+/**
+ * @brief Makes sure the socket index can hold an entry for a socket.
+ * 
+ * @param controller A pointer to the controller.
+ * @param connection_socket The socket that needs a slot.
+ */
+static void socket_index_reserve(controller_t* controller, int connection_socket) {
+    if ((size_t)connection_socket < controller->socket_index_capacity) return;
+    size_t new_capacity = controller->socket_index_capacity * GROWTH_FACTOR;
+    if (new_capacity <= (size_t)connection_socket) {
+        new_capacity = (size_t)connection_socket + 1;
+    }
+    int* new_index = (int*)realloc(controller->socket_index, new_capacity * sizeof(int));
+    if (new_index == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = controller->socket_index_capacity; i < new_capacity; i++) {
+        new_index[i] = -1;
+    }
+    controller->socket_index = new_index;
+    controller->socket_index_capacity = new_capacity;
+}
 
+/**
+ * @brief Adds the car at a position to the name and socket indexes, and
+ * gives it its row in the car table.
+ * 
+ * @param controller A pointer to the controller.
+ * @param pos The position of the car in data.
+ */
+static void controller_index_car(controller_t* controller, size_t pos) {
+    connectedcar_t* car = &controller->data[pos];
+    car->table = &controller->table;
+    car->row = pos;
+    car_table_sync(car);
+    controller->name_index[name_index_slot(controller, car->name)] = (int)pos;
+    if (car->connectionsocket >= 0) {
+        socket_index_reserve(controller, car->connectionsocket);
+        controller->socket_index[car->connectionsocket] = (int)pos;
+    }
+}
 
+/**
+ * @brief Sizes the car table's arrays to the controller's capacity.
+ * 
+ * @param controller A pointer to the controller.
+ */
+static void controller_table_reserve(controller_t* controller) {
+    car_table_t* table = &controller->table;
+    size_t capacity = controller->capacity;
+    if (table->capacity == capacity) {
+        return;
+    }
+    table->lowest_floor = (int16_t*)realloc(table->lowest_floor, capacity * sizeof(int16_t));
+    table->highest_floor = (int16_t*)realloc(table->highest_floor, capacity * sizeof(int16_t));
+    table->start_floor = (int16_t*)realloc(table->start_floor, capacity * sizeof(int16_t));
+    table->start_time = (int16_t*)realloc(table->start_time, capacity * sizeof(int16_t));
+    table->queue_length = (int16_t*)realloc(table->queue_length, capacity * sizeof(int16_t));
+    table->delay_ms = (int32_t*)realloc(table->delay_ms, capacity * sizeof(int32_t));
+    table->bound = (int32_t*)realloc(table->bound, capacity * sizeof(int32_t));
+    if (table->lowest_floor == NULL || table->highest_floor == NULL || table->start_floor == NULL ||
+        table->start_time == NULL || table->queue_length == NULL || table->delay_ms == NULL ||
+        table->bound == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    table->capacity = capacity;
+}
+
+/**
+ * @brief Rebuilds both indexes and the car table from the car array. Used
+ * after cars change position.
+ * 
+ * @param controller A pointer to the controller.
+ */
+static void controller_rebuild_index(controller_t* controller) {
+    size_t needed = 1;
+    controller_table_reserve(controller);
+    while (needed < controller->capacity * 2) {
+        needed <<= 1;
+    }
+    if (needed != controller->name_index_capacity) {
+        int* new_index = (int*)realloc(controller->name_index, needed * sizeof(int));
+        if (new_index == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        controller->name_index = new_index;
+        controller->name_index_capacity = needed;
+    }
+    for (size_t i = 0; i < controller->name_index_capacity; i++) {
+        controller->name_index[i] = -1;
+    }
+    for (size_t i = 0; i < controller->socket_index_capacity; i++) {
+        controller->socket_index[i] = -1;
+    }
+    for (size_t i = 0; i < controller->size; i++) {
+        controller_index_car(controller, i);
+    }
+}
+
+/**
+ * @brief Removes the car at a position, shifting the following cars down.
+ * 
+ * @param controller A pointer to the controller.
+ * @param pos The position of the car to remove.
+ */
+static void controller_remove_at(controller_t* controller, size_t pos) {
+    for (size_t j = pos; j < controller->size - 1; ++j) {
+        controller->data[j] = controller->data[j + 1];
+    }
+    controller->size--;
+    controller_rebuild_index(controller);
+}
 
 /**
  * @brief Initializes the controller with an initial capacity.
@@ -147,10 +681,12 @@ void controller_init(controller_t* controller) {
         perror("malloc");
         exit(EXIT_FAILURE);
     }
-    // Initialize queues for all cars
-    for (size_t i = 0; i < controller->capacity; i++) {
-        queue_init(&controller->data[i]);
-    }
+    controller->name_index = NULL;
+    controller->name_index_capacity = 0;
+    controller->socket_index = NULL;
+    controller->socket_index_capacity = 0;
+    memset(&controller->table, 0, sizeof(controller->table));
+    controller_rebuild_index(controller);
 }
 
 /**
@@ -170,6 +706,8 @@ void controller_ensure_capacity(controller_t* controller, size_t new_size) {
         }
         controller->data = new_data;
         controller->capacity = new_capacity;
+        // Positions survive the move, but the name table is sized to the capacity
+        controller_rebuild_index(controller);
     }
 }
 
@@ -181,9 +719,23 @@ void controller_ensure_capacity(controller_t* controller, size_t new_size) {
 void controller_destroy(controller_t* controller) {
     if (controller == NULL) return;
     free(controller->data);
+    free(controller->name_index);
+    free(controller->socket_index);
+    free(controller->table.lowest_floor);
+    free(controller->table.highest_floor);
+    free(controller->table.start_floor);
+    free(controller->table.start_time);
+    free(controller->table.queue_length);
+    free(controller->table.delay_ms);
+    free(controller->table.bound);
+    memset(&controller->table, 0, sizeof(controller->table));
     controller->data = NULL;
+    controller->name_index = NULL;
+    controller->socket_index = NULL;
     controller->size = 0;
     controller->capacity = 0;
+    controller->name_index_capacity = 0;
+    controller->socket_index_capacity = 0;
 }
 
 /**
@@ -194,11 +746,12 @@ void controller_destroy(controller_t* controller) {
  */
 void controller_copy(const controller_t* src, controller_t* dest) {
     if (src == NULL || dest == NULL) return;
-    dest->size = src->size;
     controller_ensure_capacity(dest, src->size);
+    dest->size = src->size;
     for (size_t i = 0; i < src->size; ++i) {
         dest->data[i] = src->data[i];
     }
+    controller_rebuild_index(dest);
 }
 
 /**
@@ -209,19 +762,26 @@ void controller_copy(const controller_t* src, controller_t* dest) {
 void controller_clear(controller_t* controller) {
     if (controller == NULL) return;
     controller->size = 0;
+    controller_rebuild_index(controller);
 }
 
 /**
- * @brief Adds a new car to the controller.
+ * @brief Adds a new car to the controller, unless one with the same name is
+ * already in it.
  * 
  * @param controller A pointer to the controller.
  * @param new_car The new car to add.
+ * @return false if the car wasn't added.
  */
-void controller_push(controller_t* controller, const connectedcar_t* new_car) {
-    if (controller == NULL || new_car == NULL) return;
+bool controller_push(controller_t* controller, const connectedcar_t* new_car) {
+    if (controller == NULL || new_car == NULL || controller_find_by_name(controller, new_car->name) != NULL) {
+        return false;
+    }
     controller_ensure_capacity(controller, controller->size + 1);
     controller->data[controller->size] = *new_car;
     controller->size++;
+    controller_index_car(controller, controller->size - 1);
+    return true;
 }
 
 /**
@@ -232,6 +792,7 @@ void controller_push(controller_t* controller, const connectedcar_t* new_car) {
 void controller_pop(controller_t* controller) {
     if (controller == NULL || controller->size == 0) return;
     controller->size--;
+    controller_rebuild_index(controller);
 }
 
 /**
@@ -246,14 +807,18 @@ connectedcar_t* controller_last(const controller_t* controller) {
 }
 
 /**
- * @brief Inserts a new car at a specific position in the controller.
+ * @brief Inserts a new car at a specific position in the controller, unless
+ * one with the same name is already in it.
  * 
  * @param controller A pointer to the controller.
  * @param pos The position to insert the new car.
  * @param new_car The new car to insert.
+ * @return false if the car wasn't inserted.
  */
-void controller_insert_at(controller_t* controller, size_t pos, const connectedcar_t* new_car) {
-    if (controller == NULL || new_car == NULL) return;
+bool controller_insert_at(controller_t* controller, size_t pos, const connectedcar_t* new_car) {
+    if (controller == NULL || new_car == NULL || controller_find_by_name(controller, new_car->name) != NULL) {
+        return false;
+    }
     if (pos > controller->size) {
         pos = controller->size;
     }
@@ -263,6 +828,35 @@ void controller_insert_at(controller_t* controller, size_t pos, const connectedc
     }
     controller->data[pos] = *new_car;
     controller->size++;
+    controller_rebuild_index(controller);
+    return true;
+}
+
+/**
+ * @brief Finds a car by name using the name index.
+ * 
+ * @param controller A pointer to the controller.
+ * @param name The name of the car to search for.
+ * @return A pointer to the car, or NULL if not found. Only valid until the controller is next modified.
+ */
+connectedcar_t* controller_find_by_name(const controller_t* controller, const char* name) {
+    if (controller == NULL || name == NULL || controller->name_index == NULL) return NULL;
+    int pos = controller->name_index[name_index_slot(controller, name)];
+    return (pos == -1) ? NULL : &controller->data[pos];
+}
+
+/**
+ * @brief Finds a car by its connection socket using the socket index.
+ * 
+ * @param controller A pointer to the controller.
+ * @param connection_socket The connection socket value to search for.
+ * @return A pointer to the car, or NULL if not found. Only valid until the controller is next modified.
+ */
+connectedcar_t* controller_find_by_socket(const controller_t* controller, int connection_socket) {
+    if (controller == NULL || connection_socket < 0 ||
+        (size_t)connection_socket >= controller->socket_index_capacity) return NULL;
+    int pos = controller->socket_index[connection_socket];
+    return (pos == -1) ? NULL : &controller->data[pos];
 }
 
 /**
@@ -273,13 +867,8 @@ void controller_insert_at(controller_t* controller, size_t pos, const connectedc
  * @return A pointer to the name of the car, or NULL if not found.
  */
 const char* controller_get_name_by_socket(const controller_t* controller, int connection_socket) {
-    if (controller == NULL) return NULL;
-    for (size_t i = 0; i < controller->size; ++i) {
-        if (controller->data[i].connectionsocket == connection_socket) {
-            return controller->data[i].name;
-        }
-    }
-    return NULL;
+    connectedcar_t* car = controller_find_by_socket(controller, connection_socket);
+    return (car == NULL) ? NULL : car->name;
 }
 
 /**
@@ -289,16 +878,15 @@ const char* controller_get_name_by_socket(const controller_t* controller, int co
  * @param name The name of the car to search for.
  * @return The connection socket of the car, or -1 if not found.
  */
-int controller_get_socket_by_name(const controller_t* controller,char name[50]) {
+int controller_get_socket_by_name(const controller_t* controller, const char* name) {
     if (controller == NULL || name == NULL) {
         fprintf(stderr, "Error: controller or name is NULL\n");
         return -1;
     }
 
-    for (size_t i = 0; i < controller->size; ++i) {
-        if (controller->data[i].name != NULL && strcmp(controller->data[i].name, name) == 0) {
-            return controller->data[i].connectionsocket;
-        }
+    connectedcar_t* car = controller_find_by_name(controller, name);
+    if (car != NULL) {
+        return car->connectionsocket;
     }
 
     fprintf(stderr, "Error: Car with name %s not found\n", name);
@@ -312,16 +900,21 @@ int controller_get_socket_by_name(const controller_t* controller,char name[50])
  * @param pos The position of the car to remove.
  */
 void controller_remove_by_name(controller_t* controller, const char* name) {
-    if (controller == NULL || name == NULL) return;
-    for (size_t i = 0; i < controller->size; ++i) {
-        if (strcmp(controller->data[i].name, name) == 0) {
-            for (size_t j = i; j < controller->size - 1; ++j) {
-                controller->data[j] = controller->data[j + 1];
-            }
-            controller->size--;
-            return;
-        }
-    }
+    connectedcar_t* car = controller_find_by_name(controller, name);
+    if (car == NULL) return;
+    controller_remove_at(controller, (size_t)(car - controller->data));
+}
+
+/**
+ * @brief Removes the car registered on a connection socket.
+ * 
+ * @param controller A pointer to the controller.
+ * @param connection_socket The connection socket of the car to remove.
+ */
+void controller_remove_by_socket(controller_t* controller, int connection_socket) {
+    connectedcar_t* car = controller_find_by_socket(controller, connection_socket);
+    if (car == NULL) return;
+    controller_remove_at(controller, (size_t)(car - controller->data));
 }
 
 /**
@@ -348,42 +941,43 @@ void controller_foreach(controller_t* controller, void (*callback)(connectedcar_
  */
 void controller_set(controller_t* controller, const char* name, int op_code, const char* new_value) {
     if (controller == NULL || name == NULL || new_value == NULL) return;
-    for (size_t i = 0; i < controller->size; ++i) {
-        if (strcmp(controller->data[i].name, name) == 0) {
-            switch (op_code) {
-                case 1:
-                    strncpy(controller->data[i].highest_floor, new_value, sizeof(controller->data[i].highest_floor) - 1);
-                    controller->data[i].highest_floor[sizeof(controller->data[i].highest_floor) - 1] = '\0';
-                    break;
-                case 2:
-                    strncpy(controller->data[i].lowest_floor, new_value, sizeof(controller->data[i].lowest_floor) - 1);
-                    controller->data[i].lowest_floor[sizeof(controller->data[i].lowest_floor) - 1] = '\0';
-                    break;
-                case 3:
-                    strncpy(controller->data[i].status, new_value, sizeof(controller->data[i].status) - 1);
-                    controller->data[i].status[sizeof(controller->data[i].status) - 1] = '\0';
-                    break;
-                case 7:
-                    strncpy(controller->data[i].previous_status, new_value, sizeof(controller->data[i].previous_status) - 1);
-                    controller->data[i].status[sizeof(controller->data[i].previous_status) - 1] = '\0';
-                    break;
-                case 4:
-                    strncpy(controller->data[i].currentfloor, new_value, sizeof(controller->data[i].currentfloor) - 1);
-                    controller->data[i].currentfloor[sizeof(controller->data[i].currentfloor) - 1] = '\0';
-                    break;
-                case 5:
-                    strncpy(controller->data[i].destinationfloor, new_value, sizeof(controller->data[i].destinationfloor) - 1);
-                    controller->data[i].destinationfloor[sizeof(controller->data[i].destinationfloor) - 1] = '\0';
-                    break;
-                case 6:
-                    controller->data[i].connectionsocket = atoi(new_value);
-                    break;
-                default:
-                    printf("Invalid operation code.\n");
-                    break;
-            }
-            break;
+    connectedcar_t* car = controller_find_by_name(controller, name);
+    if (car != NULL) {
+        size_t i = (size_t)(car - controller->data);
+        switch (op_code) {
+            case 1:
+                controller->data[i].highest_floor = (int16_t)stringToFloor((char*)new_value);
+                break;
+            case 2:
+                controller->data[i].lowest_floor = (int16_t)stringToFloor((char*)new_value);
+                break;
+            case 3:
+                strncpy(controller->data[i].status, new_value, sizeof(controller->data[i].status) - 1);
+                controller->data[i].status[sizeof(controller->data[i].status) - 1] = '\0';
+                break;
+            case 7:
+                strncpy(controller->data[i].previous_status, new_value, sizeof(controller->data[i].previous_status) - 1);
+                controller->data[i].status[sizeof(controller->data[i].previous_status) - 1] = '\0';
+                break;
+            case 4:
+                controller->data[i].currentfloor = (int16_t)stringToFloor((char*)new_value);
+                break;
+            case 5:
+                controller->data[i].destinationfloor = (int16_t)stringToFloor((char*)new_value);
+                break;
+            case 6:
+                if (controller->data[i].connectionsocket >= 0 &&
+                    (size_t)controller->data[i].connectionsocket < controller->socket_index_capacity) {
+                    controller->socket_index[controller->data[i].connectionsocket] = -1;
+                }
+                controller->data[i].connectionsocket = atoi(new_value);
+                controller_index_car(controller, i);
+                break;
+            default:
+                printf("Invalid operation code.\n");
+                break;
         }
+        car_table_sync(car);
     }
 }
 
@@ -398,37 +992,41 @@ void controller_set(controller_t* controller, const char* name, int op_code, con
  */
 void controller_get(const controller_t* controller, const char* name, int op_code, char* out_value, size_t buffer_size) {
     if (controller == NULL || name == NULL || out_value == NULL) return;
-    for (size_t i = 0; i < controller->size; ++i) {
-        if (strcmp(controller->data[i].name, name) == 0) {
-            switch (op_code) {
-                case 1:
-                    strncpy(out_value, controller->data[i].highest_floor, buffer_size - 1);
-                    out_value[buffer_size - 1] = '\0';
-                    break;
-                case 2:
-                    strncpy(out_value, controller->data[i].lowest_floor, buffer_size - 1);
-                    out_value[buffer_size - 1] = '\0';
-                    break;
-                case 3:
-                    strncpy(out_value, controller->data[i].status, buffer_size - 1);
-                    out_value[buffer_size - 1] = '\0';
-                    break;
-                case 4:
-                    strncpy(out_value, controller->data[i].currentfloor, buffer_size - 1);
-                    out_value[buffer_size - 1] = '\0';
-                    break;
-                case 5:
-                    strncpy(out_value, controller->data[i].destinationfloor, buffer_size - 1);
-                    out_value[buffer_size - 1] = '\0';
-                    break;
-                case 6:
-                    snprintf(out_value, buffer_size, "%d", controller->data[i].connectionsocket);
-                    break;
-                default:
-                    printf("Invalid operation code.\n");
-                    break;
-            }
-            break;
+    connectedcar_t* car = controller_find_by_name(controller, name);
+    if (car != NULL) {
+        size_t i = (size_t)(car - controller->data);
+        char floor_label[4];
+        switch (op_code) {
+            case 1:
+                floorToString(floor_label, controller->data[i].highest_floor);
+                strncpy(out_value, floor_label, buffer_size - 1);
+                out_value[buffer_size - 1] = '\0';
+                break;
+            case 2:
+                floorToString(floor_label, controller->data[i].lowest_floor);
+                strncpy(out_value, floor_label, buffer_size - 1);
+                out_value[buffer_size - 1] = '\0';
+                break;
+            case 3:
+                strncpy(out_value, controller->data[i].status, buffer_size - 1);
+                out_value[buffer_size - 1] = '\0';
+                break;
+            case 4:
+                floorToString(floor_label, controller->data[i].currentfloor);
+                strncpy(out_value, floor_label, buffer_size - 1);
+                out_value[buffer_size - 1] = '\0';
+                break;
+            case 5:
+                floorToString(floor_label, controller->data[i].destinationfloor);
+                strncpy(out_value, floor_label, buffer_size - 1);
+                out_value[buffer_size - 1] = '\0';
+                break;
+            case 6:
+                snprintf(out_value, buffer_size, "%d", controller->data[i].connectionsocket);
+                break;
+            default:
+                printf("Invalid operation code.\n");
+                break;
         }
     }
 }
@@ -448,14 +1046,19 @@ void controller_print(const controller_t* controller) {
     printf("Cars:\n");
     for (size_t i = 0; i < controller->size; ++i) {
         connectedcar_t* car = &controller->data[i];
+        char highest[4], lowest[4], current[4], destination[4];
+        floorToString(highest, car->highest_floor);
+        floorToString(lowest, car->lowest_floor);
+        floorToString(current, car->currentfloor);
+        floorToString(destination, car->destinationfloor);
         printf("Car %zu:\n", i + 1);
         printf("-----------------------\n");
         printf("Name: %s\n", car->name);
-        printf("Top Floor: %s\n", car->highest_floor);
-        printf("Bottom Floor: %s\n", car->lowest_floor);
+        printf("Top Floor: %s\n", highest);
+        printf("Bottom Floor: %s\n", lowest);
         printf("Status: %s\n", car->status);
-        printf("Current Floor: %s\n", car->currentfloor);
-        printf("Destination Floor: %s\n", car->destinationfloor);
+        printf("Current Floor: %s\n", current);
+        printf("Destination Floor: %s\n", destination);
         printf("Connection Status: %d\n", car->connectionsocket);
         printf("-----------------------\n");
     }
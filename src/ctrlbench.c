@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "sharedmemory.h"
+#include "connection.h"
+#include "protocol.h"
+#include "histogram.h"
+
+/**
+ * Benchmark for the controller's network path. For every combination of car
+ * and call pad counts it starts a fresh controller, connects that many
+ * synthetic cars and call pads over loopback and runs them for --duration
+ * seconds:
+ *
+ * - Each car sends a STATUS every --status-interval ms, moving towards the
+ *   floors the controller sends it and cycling its doors, or repeating its
+ *   idle status when it has nowhere to go.
+ * - Each call pad keeps one CALL outstanding, sending the next as soon as the
+ *   reply arrives, so the round trip time is measured under the car load.
+ *
+ * Once the cars stop, the pads' last replies show the controller has caught
+ * up. The throughput counts every STATUS and CALL handled up to then, and the
+ * controller's CPU time is read from /proc over the same window.
+ *
+ * Usage: ctrlbench [--controller path] [--cars list] [--pads list]
+ *                  [--protocols list] [--shards list] [--banks n]
+ *                  [--duration s] [--status-interval ms] [--seed n]
+ *
+ * Lists are comma separated, e.g. --cars 10,100,1000 --pads 1,8
+ * --protocols text,binary (see protocol.h) --shards 1,4 (the controller's
+ * --shards). The cars are dealt into --banks banks, bank b serving floors
+ * LOWEST_FLOOR to HIGHEST_FLOOR - b, since the controller shards by bank. One CSV line
+ * is printed per combination, after a header line, so results can be
+ * collected and compared between versions.
+ */
+
+#define PORT 3000
+#define BUFFER_SIZE 1024
+#define MAX_EVENTS 256
+#define MAX_LIST 16
+#define DURATION 5            // seconds
+#define STATUS_INTERVAL 50    // milliseconds
+#define LOWEST_FLOOR 1
+#define HIGHEST_FLOOR 20
+#define DRAIN_MS 5000         // Longest wait for the controller to catch up
+#define SEED 1
+
+typedef enum {
+    DOORS_CLOSED,
+    DOORS_OPENING,
+    DOORS_OPEN,
+    DOORS_CLOSING
+} doors_t;
+
+typedef struct {
+    connection_t *conn;
+    bool pad;
+    bool binary;
+    // Cars
+    int current;
+    int destination;
+    doors_t doors;
+    // Pads
+    bool waiting;
+    struct timespec sent;
+} client_t;
+
+typedef struct {
+    size_t status_sent;
+    size_t calls;
+    size_t unavailable;
+    int64_t *rtt_ns;
+    size_t rtt_count;
+    size_t rtt_capacity;
+} results_t;
+
+static const char *controller_path = "./controller";
+static int car_list[MAX_LIST] = {10, 100, 1000};
+static size_t car_count = 3;
+static int pad_list[MAX_LIST] = {1, 8};
+static size_t pad_count = 2;
+static bool protocol_list[MAX_LIST] = {false};   // true for binary
+static size_t protocol_count = 1;
+static int shard_list[MAX_LIST] = {1};
+static size_t shard_count = 1;
+static int banks = 1;
+static int duration = DURATION;
+static int status_interval = STATUS_INTERVAL;
+static unsigned int seed = SEED;
+
+static size_t parse_ints(const char *arg, int *list) {
+    char copy[256];
+    size_t count = 0;
+    snprintf(copy, sizeof(copy), "%s", arg);
+    for (char *save, *item = strtok_r(copy, ",", &save); item != NULL && count < MAX_LIST;
+         item = strtok_r(NULL, ",", &save)) {
+        list[count++] = atoi(item);
+    }
+    return count;
+}
+
+static size_t parse_protocols(const char *arg, bool *list) {
+    char copy[256];
+    size_t count = 0;
+    snprintf(copy, sizeof(copy), "%s", arg);
+    for (char *save, *item = strtok_r(copy, ",", &save); item != NULL && count < MAX_LIST;
+         item = strtok_r(NULL, ",", &save)) {
+        if (strcmp(item, "text") != 0 && strcmp(item, "binary") != 0) {
+            fprintf(stderr, "Unknown protocol: %s\n", item);
+            exit(EXIT_FAILURE);
+        }
+        list[count++] = (strcmp(item, "binary") == 0);
+    }
+    return count;
+}
+
+static void init_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(argv[i], "--controller") == 0) controller_path = argv[i + 1];
+        else if (strcmp(argv[i], "--cars") == 0) car_count = parse_ints(argv[i + 1], car_list);
+        else if (strcmp(argv[i], "--pads") == 0) pad_count = parse_ints(argv[i + 1], pad_list);
+        else if (strcmp(argv[i], "--protocols") == 0) protocol_count = parse_protocols(argv[i + 1], protocol_list);
+        else if (strcmp(argv[i], "--shards") == 0) shard_count = parse_ints(argv[i + 1], shard_list);
+        else if (strcmp(argv[i], "--banks") == 0) banks = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--duration") == 0) duration = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--status-interval") == 0) status_interval = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--seed") == 0) seed = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+        else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void now_monotonic(struct timespec *ts) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static int64_t diff_ns(const struct timespec *a, const struct timespec *b) {
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+}
+
+static void add_ns(struct timespec *ts, int64_t ns) {
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+// The controller's user plus system time so far, from /proc
+static int64_t controller_cpu_ns(pid_t pid) {
+    char path[64], line[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char *fields = NULL;
+    if (fgets(line, sizeof(line), file) != NULL) {
+        // Skip past the command name, which may contain spaces
+        fields = strrchr(line, ')');
+    }
+    fclose(file);
+    unsigned long utime, stime;
+    if (fields == NULL ||
+        sscanf(fields, ") %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        return -1;
+    }
+    return (int64_t)(utime + stime) * (1000000000 / sysconf(_SC_CLK_TCK));
+}
+
+static pid_t start_controller(int shards) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        // The controller logs every message, keep that out of the results
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        char shards_arg[16];
+        snprintf(shards_arg, sizeof(shards_arg), "%d", shards);
+        execl(controller_path, controller_path, "--shards", shards_arg, (char *)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop_controller(pid_t pid) {
+    kill(pid, SIGINT);
+    if (waitpid(pid, NULL, 0) == -1) {
+        perror("waitpid");
+    }
+}
+
+// Connect to the controller, retrying while it starts up
+static int connect_to_server(void) {
+    struct sockaddr_in server_address;
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(PORT);
+    inet_pton(AF_INET, "127.0.0.1", &server_address.sin_addr);
+
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd == -1) {
+            perror("socket");
+            exit(EXIT_FAILURE);
+        }
+        if (connect(sockfd, (struct sockaddr *)&server_address, sizeof(server_address)) == 0) {
+            int enable = 1;
+            setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            return sockfd;
+        }
+        close(sockfd);
+        struct timespec pause = {0, 10000000};
+        nanosleep(&pause, NULL);
+    }
+    fprintf(stderr, "Unable to connect to the controller\n");
+    exit(EXIT_FAILURE);
+}
+
+
+// The floor one step from floor towards destination, skipping floor 0
+static int step_towards(int floor, int destination) {
+    int next = floor + ((destination > floor) ? 1 : -1);
+    return (next == 0) ? next + ((destination > floor) ? 1 : -1) : next;
+}
+
+// Send a car's next STATUS, advancing it one step
+static bool send_car_status(client_t *car) {
+    static const Status door_status[] = {Closed, Opening, Open, Closing};
+    Status status;
+    if (car->doors != DOORS_CLOSED) {
+        car->doors = (car->doors + 1) % 4;
+        status = door_status[car->doors];
+    } else if (car->current != car->destination) {
+        car->current = step_towards(car->current, car->destination);
+        if (car->current == car->destination) {
+            car->doors = DOORS_OPENING;
+            status = door_status[car->doors];
+        } else {
+            status = Between;
+        }
+    } else {
+        status = Closed;
+    }
+
+    message_t message = {.type = MSG_STATUS, .status = status,
+                         .floor = {(int16_t)car->current, (int16_t)car->destination}};
+    return protocol_send(car->conn->fd, &message, car->binary);
+}
+
+static bool send_pad_call(client_t *pad, unsigned int *state) {
+    int from, to;
+    do {
+        from = LOWEST_FLOOR + rand_r(state) % (HIGHEST_FLOOR - LOWEST_FLOOR + 1);
+        to = LOWEST_FLOOR + rand_r(state) % (HIGHEST_FLOOR - LOWEST_FLOOR + 1);
+    } while (from == to);
+    message_t message = {.type = MSG_CALL, .floor = {(int16_t)from, (int16_t)to}};
+    now_monotonic(&pad->sent);
+    pad->waiting = true;
+    return protocol_send(pad->conn->fd, &message, pad->binary);
+}
+
+// Handle FLOOR commands to a car or a reply to a pad
+static bool handle_frames(client_t *client, results_t *results, bool sending, unsigned int *state) {
+    char message[BUFFER_SIZE];
+    connection_status_t status;
+    do {
+        status = connection_fill(client->conn);
+        int frame_length;
+        while ((frame_length = connection_next_frame(client->conn, message, sizeof(message))) > 0) {
+            message_t decoded;
+            if (!protocol_decode(message, (size_t)frame_length, &decoded)) {
+                continue;
+            }
+            if (!client->pad) {
+                if (decoded.type == MSG_FLOOR) {
+                    client->destination = decoded.floor[0];
+                }
+                continue;
+            }
+
+            struct timespec now;
+            now_monotonic(&now);
+            client->waiting = false;
+            results->calls++;
+            if (decoded.type != MSG_ASSIGNED) {
+                results->unavailable++;
+            }
+            if (results->rtt_count == results->rtt_capacity) {
+                results->rtt_capacity = results->rtt_capacity ? results->rtt_capacity * 2 : 1024;
+                results->rtt_ns = realloc(results->rtt_ns, results->rtt_capacity * sizeof(int64_t));
+                if (results->rtt_ns == NULL) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            results->rtt_ns[results->rtt_count++] = diff_ns(&now, &client->sent);
+            if (sending && !send_pad_call(client, state)) {
+                return false;
+            }
+        }
+        if (frame_length == -1) {
+            return false;
+        }
+    } while (status == CONNECTION_FULL);
+    return status == CONNECTION_DRAINED;
+}
+
+static double percentile_us(const int64_t *sorted, size_t count, double rank) {
+    if (count == 0) {
+        return 0;
+    }
+    size_t index = (size_t)ceil(rank * (double)count);
+    return (double)sorted[index > 0 ? index - 1 : 0] / 1000.0;
+}
+
+static void run_point(int cars, int pads, bool binary, int shards) {
+    pid_t pid = start_controller(shards);
+    int epoll_fd = epoll_create1(0);
+    int clients = cars + pads;
+    client_t *client = calloc((size_t)clients, sizeof(client_t));
+    results_t results = {0};
+    unsigned int state = seed;
+    if (epoll_fd == -1 || client == NULL) {
+        perror("setup");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < clients; i++) {
+        int sockfd = connect_to_server();
+        client[i].pad = (i >= cars);
+        client[i].binary = binary;
+        client[i].conn = connection_create(sockfd, false);
+        if (client[i].conn == NULL) {
+            exit(EXIT_FAILURE);
+        }
+        if (!client[i].pad) {
+            message_t message = {.type = MSG_CAR, .floor = {LOWEST_FLOOR, (int16_t)(HIGHEST_FLOOR - i % banks)}};
+            snprintf(message.name, sizeof(message.name), "Bench%d", i + 1);
+            client[i].current = client[i].destination = LOWEST_FLOOR;
+            if (!protocol_send(sockfd, &message, binary) || !send_car_status(&client[i])) {
+                fprintf(stderr, "Unable to register car %d\n", i + 1);
+                exit(EXIT_FAILURE);
+            }
+        }
+        int flags = fcntl(sockfd, F_GETFL, 0);
+        fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = &client[i];
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockfd, &event);
+    }
+
+    // Let the controller take in the registrations before timing
+    struct timespec settle = {0, 200000000};
+    nanosleep(&settle, NULL);
+
+    struct timespec start, end, now, next_status;
+    int64_t cpu_start = controller_cpu_ns(pid);
+    now_monotonic(&start);
+    end = start;
+    add_ns(&end, (int64_t)duration * 1000000000);
+    next_status = start;
+    // Cars report in turn, spread evenly over the interval
+    int64_t status_gap_ns = cars > 0 ? (int64_t)status_interval * 1000000 / cars : 0;
+    int next_car = 0;
+    for (int i = cars; i < clients; i++) {
+        send_pad_call(&client[i], &state);
+    }
+
+    bool ok = true, sending = true;
+    struct epoll_event events[MAX_EVENTS];
+    struct timespec drain_end = end;
+    add_ns(&drain_end, (int64_t)DRAIN_MS * 1000000);
+    for (;;) {
+        now_monotonic(&now);
+        if (sending && diff_ns(&now, &end) >= 0) {
+            sending = false;
+        }
+        if (!sending) {
+            int waiting = 0;
+            for (int i = cars; i < clients; i++) {
+                waiting += client[i].waiting;
+            }
+            if (waiting == 0 || diff_ns(&now, &drain_end) >= 0) {
+                break;
+            }
+        }
+
+        while (sending && cars > 0 && diff_ns(&now, &next_status) >= 0 && ok) {
+            ok = send_car_status(&client[next_car]);
+            results.status_sent++;
+            next_car = (next_car + 1) % cars;
+            add_ns(&next_status, status_gap_ns);
+        }
+        if (!ok) {
+            break;
+        }
+
+        int64_t wait_ns = sending && cars > 0 ? diff_ns(&next_status, &now) : 1000000;
+        int timeout = wait_ns > 0 ? (int)((wait_ns + 999999) / 1000000) : 0;
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        for (int n = 0; n < ready && ok; n++) {
+            ok = handle_frames(events[n].data.ptr, &results, sending, &state);
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    now_monotonic(&now);
+    int64_t cpu_end = controller_cpu_ns(pid);
+
+    int unanswered = 0;
+    for (int i = cars; i < clients; i++) {
+        unanswered += client[i].waiting;
+    }
+    for (int i = 0; i < clients; i++) {
+        close(client[i].conn->fd);
+        connection_destroy(client[i].conn);
+    }
+    free(client);
+    close(epoll_fd);
+    stop_controller(pid);
+
+    double elapsed = (double)diff_ns(&now, &start) / 1e9;
+    size_t messages = results.status_sent + results.calls;
+    qsort(results.rtt_ns, results.rtt_count, sizeof(int64_t), compare_int64);
+    double cpu_per_message = (cpu_start >= 0 && cpu_end >= 0 && messages > 0)
+                                 ? (double)(cpu_end - cpu_start) / 1000.0 / (double)messages
+                                 : -1;
+    printf("%s,%d,%d,%d,%.3f,%zu,%zu,%zu,%d,%.1f,%.1f,%.1f,%.1f,%.3f,%s\n", binary ? "binary" : "text", shards, cars, pads, elapsed,
+           results.status_sent, results.calls, results.unavailable, unanswered,
+           elapsed > 0 ? (double)messages / elapsed : 0.0, percentile_us(results.rtt_ns, results.rtt_count, 0.50),
+           percentile_us(results.rtt_ns, results.rtt_count, 0.99),
+           percentile_us(results.rtt_ns, results.rtt_count, 1.0), cpu_per_message, ok ? "ok" : "disconnected");
+    fflush(stdout);
+    free(results.rtt_ns);
+}
+
+int main(int argc, char **argv) {
+    init_args(argc, argv);
+    if (duration <= 0 || status_interval <= 0 || car_count == 0 || pad_count == 0 || protocol_count == 0 ||
+        shard_count == 0 || banks <= 0 || banks >= HIGHEST_FLOOR - LOWEST_FLOOR) {
+        fprintf(stderr, "Invalid benchmark parameters\n");
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // Thousands of connections need thousands of descriptors, here and in
+    // the controller, which inherits the limit
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    printf("protocol,shards,cars,pads,seconds,status_msgs,calls,unavailable,unanswered,msgs_per_sec,"
+           "call_p50_us,call_p99_us,call_max_us,controller_cpu_us_per_msg,result\n");
+    for (size_t c = 0; c < car_count; c++) {
+        for (size_t p = 0; p < pad_count; p++) {
+            for (size_t b = 0; b < protocol_count; b++) {
+                for (size_t s = 0; s < shard_count; s++) {
+                    if (car_list[c] < 0 || pad_list[p] <= 0) {
+                        fprintf(stderr, "Invalid point: %d cars, %d pads\n", car_list[c], pad_list[p]);
+                        exit(EXIT_FAILURE);
+                    }
+                    run_point(car_list[c], pad_list[p], protocol_list[b], shard_list[s]);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sharedmemory.h"
+#include "histogram.h"
+
+/**
+ * Measures how quickly a running car goes into emergency mode. Injects an
+ * emergency stop or an overload (alternately) into the car's shared memory,
+ * waits for the emergency to be reported, then clears it, over and over.
+ * Each stage is timestamped in the shared memory by the process that does it:
+ *
+ *   fault_at      the fault was set (edit_shared_memory)
+ *   emergency_at  the safety checks set emergency_mode (safety or supervisor)
+ *   reported_at   the car sent EMERGENCY to the controller
+ *
+ * and the latency of each stage is printed as a histogram. The car, a
+ * safety process or the supervisor, and the controller (for the report
+ * stage) must already be running.
+ *
+ * Usage: faultbench {car name} [--faults n] [--gap ms] [--timeout ms]
+ *                   [--histogram-len n]
+ *
+ * --gap is the pause after clearing each fault, long enough for the car to
+ * reconnect to the controller. A fault that isn't reported within --timeout
+ * still counts towards the detection histogram.
+ */
+
+#define FAULTS          100
+#define GAP_MS          200
+#define TIMEOUT_MS      1000
+#define HISTOGRAM_LEN   10
+#define WAIT_NS         100000      // How often to look for the next stage
+
+static int faults = FAULTS;
+static int gap_ms = GAP_MS;
+static int timeout_ms = TIMEOUT_MS;
+static int histogram_len = HISTOGRAM_LEN;
+
+static void sleep_ns(long nanoseconds) {
+    struct timespec ts = {nanoseconds / 1000000000L, nanoseconds % 1000000000L};
+    nanosleep(&ts, NULL);
+}
+
+// Print a summary and histogram of latencies in nanoseconds, in microseconds
+static void report(const char *title, int64_t *values, int count) {
+    printf("%s:\n", title);
+    if (count == 0) {
+        printf("No samples\n\n");
+        return;
+    }
+    qsort(values, (size_t)count, sizeof(values[0]), compare_int64);
+    int64_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += values[i];
+    }
+    int64_t max = values[count - 1];
+    printf("%d samples, mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n", count,
+           (double)total / count / 1000.0, (double)values[(count - 1) / 2] / 1000.0,
+           (double)values[(count * 99 + 99) / 100 - 1] / 1000.0, (double)max / 1000.0);
+
+    histogram_print(values, count, histogram_len);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s {car name} [--faults n] [--gap ms] [--timeout ms] [--histogram-len n]\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(argv[i], "--faults") == 0) faults = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--gap") == 0) gap_ms = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--timeout") == 0) timeout_ms = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--histogram-len") == 0) histogram_len = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (faults <= 0 || gap_ms < 0 || timeout_ms <= 0 || histogram_len <= 0) {
+        fprintf(stderr, "Error: Faults, timeout and histogram length must be positive integers.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    shared_memory_t cardata;
+    char shm_name[256];
+    snprintf(shm_name, sizeof(shm_name), "/car%s", argv[1]);
+    if (!get_shared_object(&cardata, shm_name)) {
+        printf("Unable to access car %s.\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    car_shared_data_t *data = cardata.data;
+
+    int64_t *detect = calloc((size_t)faults, sizeof(int64_t));
+    int64_t *reported = calloc((size_t)faults, sizeof(int64_t));
+    int64_t *total = calloc((size_t)faults, sizeof(int64_t));
+    int detect_count = 0, report_count = 0, missed = 0;
+
+    for (int i = 0; i < faults; i++) {
+        car_op_t set = (i % 2 == 0) ? OP_SET_EMERGENCY_STOP : OP_SET_OVERLOAD;
+        car_op_t clear = (i % 2 == 0) ? OP_CLEAR_EMERGENCY_STOP : OP_CLEAR_OVERLOAD;
+
+        pthread_mutex_lock(&data->mutex);
+        data->fault_at = 0;
+        data->emergency_at = 0;
+        data->reported_at = 0;
+        pthread_mutex_unlock(&data->mutex);
+        edit_shared_memory(&cardata, set, 0, 0);
+
+        // Wait for the report, or the timeout
+        uint64_t fault_at = 0, emergency_at = 0, reported_at = 0;
+        uint64_t deadline = shm_timestamp() + (uint64_t)timeout_ms * 1000000u;
+        do {
+            sleep_ns(WAIT_NS);
+            pthread_mutex_lock(&data->mutex);
+            fault_at = data->fault_at;
+            emergency_at = data->emergency_at;
+            reported_at = data->reported_at;
+            pthread_mutex_unlock(&data->mutex);
+        } while (reported_at == 0 && shm_timestamp() < deadline);
+
+        if (emergency_at >= fault_at && fault_at != 0) {
+            detect[detect_count++] = (int64_t)(emergency_at - fault_at);
+        }
+        if (reported_at >= emergency_at && emergency_at >= fault_at && fault_at != 0) {
+            reported[report_count] = (int64_t)(reported_at - emergency_at);
+            total[report_count++] = (int64_t)(reported_at - fault_at);
+        } else {
+            missed++;
+        }
+
+        shm_edit_t reset[] = {
+            {clear, 0, 0},
+            {OP_CLEAR_EMERGENCY, 0, 0},
+        };
+        edit_shared_memory_batch(&cardata, reset, 2);
+        sleep_ns((long)gap_ms * 1000000L);
+    }
+
+    printf("Car %s: %d faults, %d not reported within %d ms\n\n", argv[1], faults, missed, timeout_ms);
+    report("Fault to emergency mode (us)", detect, detect_count);
+    report("Emergency mode to EMERGENCY sent (us)", reported, report_count);
+    report("Fault to EMERGENCY sent (us)", total, report_count);
+
+    free(detect);
+    free(reported);
+    free(total);
+    munmap(cardata.data, sizeof(car_shared_data_t));
+    close(cardata.fd);
+    return 0;
+}
@@ -0,0 +1,413 @@
+#define _XOPEN_SOURCE 700
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+#include "cartimer.h"
+#include "carcontrol.h"
+#include "connection.h"
+#include "protocol.h"
+
+/**
+ * Runs many cars in one process for load testing the controller. Every car
+ * has its own /car{name} shared memory and its own controller connection,
+ * exactly like a car process, but all of them are driven by one thread: an
+ * epoll loop that sleeps until the next door/floor deadline (on a timerfd,
+ * so deadlines keep their nanoseconds), a FLOOR command, or the next poll of
+ * shared memory.
+ *
+ * Usage: fleet {name prefix} {count} {lowest floor} {highest floor} {delay} [poll ms]
+ *              [--heartbeat ms] [--binary]
+ *
+ * The cars are named {prefix}1 to {prefix}{count}. A car process is woken by
+ * the shared condition variable when another process changes its shared
+ * memory, but one thread can't wait on many condition variables, so the
+ * fleet checks every car's shared memory each poll interval (default 10ms)
+ * instead, with lock-free snapshots, and only steps the cars that changed.
+ *
+ * Like the car process, each car only reports what changed, plus the whole
+ * STATUS every --heartbeat ms if set, and --binary uses the binary encoding.
+ */
+
+#define PORT 3000
+#define BUFFER_SIZE 1024
+#define MAX_EVENTS 64
+#define POLL_MS 10
+
+typedef struct {
+    char name[256];
+    shared_memory_t cardata;
+    car_control_t control;           // Door and movement state machine
+    connection_t *conn;              // Controller connection, NULL while disconnected
+    struct timespec retry;           // When to next try to connect
+    car_snapshot_t seen;             // Shared data when the car was last stepped
+    // Last state reported to the controller and when
+    message_t last_report;
+    struct timespec last_report_at;
+} fleet_car_t;
+
+static char lowest_floor[4];
+static char highest_floor[4];
+static int delaytime;
+static int heartbeat_ms = 0;
+static bool use_binary = false;
+static int epoll_fd;
+static int timer_fd;
+static volatile sig_atomic_t stop_signal = 0;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    stop_signal = 1;
+}
+
+// Drop the controller connection and try again after a delay
+static void disconnect_car(fleet_car_t *car) {
+    if (car->conn == NULL) {
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, car->conn->fd, NULL);
+    close(car->conn->fd);
+    connection_destroy(car->conn);
+    car->conn = NULL;
+    cartimer_now(&car->retry);
+    cartimer_add_ms(&car->retry, delaytime);
+}
+
+// Get the time the car's next heartbeat is due. Returns false if heartbeats
+// are off or the car is disconnected.
+static bool heartbeat_deadline(const fleet_car_t *car, struct timespec *deadline) {
+    if (heartbeat_ms <= 0 || car->conn == NULL) {
+        return false;
+    }
+    *deadline = car->last_report_at;
+    cartimer_add_ms(deadline, heartbeat_ms);
+    return true;
+}
+
+// Send the car's state if it changed since the last report, or all of it
+// if the heartbeat is due. Returns false if the send failed.
+static bool send_status(fleet_car_t *car, int sockfd, const struct timespec *now) {
+    struct timespec heartbeat;
+    bool heartbeat_due = heartbeat_deadline(car, &heartbeat) && cartimer_reached(now, &heartbeat);
+    message_t report;
+    if (!protocol_status_report(car->cardata.data, &car->last_report, use_binary, heartbeat_due, &report)) {
+        return true;
+    }
+    car->last_report_at = *now;
+    return protocol_send(sockfd, &report, use_binary);
+}
+
+// Report the car's state to the controller. Must be called with the shared
+// memory mutex held.
+static void report_to_server(fleet_car_t *car, const struct timespec *now) {
+    car_shared_data_t *data = car->cardata.data;
+    message_t message = {.type = MSG_INVALID};
+
+    if (car->conn == NULL) {
+        return;
+    }
+    if (data->emergency_mode == 1) {
+        message.type = MSG_EMERGENCY;
+    } else if (data->individual_service_mode == 1) {
+        message.type = MSG_SERVICE;
+    }
+    if (message.type != MSG_INVALID) {
+        if (protocol_send(car->conn->fd, &message, use_binary) && message.type == MSG_EMERGENCY) {
+            data->reported_at = shm_timestamp();
+        }
+        disconnect_car(car);
+        return;
+    }
+
+    if (!send_status(car, car->conn->fd, now)) {
+        disconnect_car(car);
+    }
+}
+
+// Run the car's due transitions and report any change. Must be called with
+// the shared memory mutex held.
+static void step_car(fleet_car_t *car) {
+    struct timespec now;
+    cartimer_now(&now);
+    if (car_control_step(&car->control, &now)) {
+        pthread_cond_broadcast(&car->cardata.data->cond);
+    }
+    report_to_server(car, &now);
+    copy_car_snapshot(car->cardata.data, &car->seen);
+}
+
+// Connect to the controller and register the car, as the car process does
+// whenever it is in normal service
+static void connect_car(fleet_car_t *car) {
+    struct sockaddr_in server_address;
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(PORT);
+    inet_pton(AF_INET, "127.0.0.1", &server_address.sin_addr);
+    if (connect(sockfd, (struct sockaddr *)&server_address, sizeof(server_address)) == -1) {
+        close(sockfd);
+        cartimer_now(&car->retry);
+        cartimer_add_ms(&car->retry, delaytime);
+        return;
+    }
+
+    car_shared_data_t *data = car->cardata.data;
+    message_t message = {.type = MSG_CAR, .floor = {(int16_t)car->control.lowest_floor,
+                                                    (int16_t)car->control.highest_floor}};
+    snprintf(message.name, sizeof(message.name), "%.49s", car->name);
+    pthread_mutex_lock(&data->mutex);
+    bool connected = protocol_send(sockfd, &message, use_binary);
+    if (connected) {
+        // A new connection starts with the whole STATUS
+        struct timespec now;
+        cartimer_now(&now);
+        memset(&car->last_report, 0, sizeof(car->last_report));
+        connected = send_status(car, sockfd, &now);
+    }
+    pthread_mutex_unlock(&data->mutex);
+
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (connected && (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1)) {
+        perror("fcntl");
+        connected = false;
+    }
+    if (connected && (car->conn = connection_create(sockfd, false)) != NULL) {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+        event.data.ptr = car;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockfd, &event) == 0) {
+            return;
+        }
+        perror("epoll_ctl");
+        connection_destroy(car->conn);
+        car->conn = NULL;
+    }
+    close(sockfd);
+    cartimer_now(&car->retry);
+    cartimer_add_ms(&car->retry, delaytime);
+}
+
+// Handle FLOOR commands from the controller. The socket is edge-triggered,
+// so it is read until recv() would block.
+static void handle_car_events(fleet_car_t *car, uint32_t events) {
+    if (events & EPOLLERR) {
+        disconnect_car(car);
+        return;
+    }
+
+    char message[BUFFER_SIZE];
+    connection_status_t status;
+    do {
+        status = connection_fill(car->conn);
+
+        int frame_length;
+        while ((frame_length = connection_next_frame(car->conn, message, sizeof(message))) > 0) {
+            message_t decoded;
+            char floor[4];
+            if (!protocol_decode(message, (size_t)frame_length, &decoded) || decoded.type != MSG_FLOOR) {
+                continue;
+            }
+            floorToString(floor, decoded.floor[0]);
+            pthread_mutex_lock(&car->cardata.data->mutex);
+            car_control_request_floor(&car->control, floor);
+            step_car(car);
+            pthread_mutex_unlock(&car->cardata.data->mutex);
+            if (car->conn == NULL) {
+                // Went into emergency or service mode while stepping
+                return;
+            }
+        }
+        if (frame_length == -1) {
+            disconnect_car(car);
+            return;
+        }
+    } while (status == CONNECTION_FULL);
+
+    if (status != CONNECTION_DRAINED) {
+        disconnect_car(car);
+    }
+}
+
+// Step a car if its shared memory changed or its timed step or heartbeat is
+// due, and reconnect it once it is back in normal service
+static void service_car(fleet_car_t *car, const struct timespec *now) {
+    car_snapshot_t snapshot;
+    struct timespec deadline;
+
+    read_car_snapshot(&car->cardata, &snapshot);
+    if (memcmp(&snapshot, &car->seen, sizeof(snapshot)) != 0 ||
+        (car_control_deadline(&car->control, &deadline) && cartimer_reached(now, &deadline)) ||
+        (heartbeat_deadline(car, &deadline) && cartimer_reached(now, &deadline))) {
+        pthread_mutex_lock(&car->cardata.data->mutex);
+        step_car(car);
+        pthread_mutex_unlock(&car->cardata.data->mutex);
+    }
+
+    if (car->conn == NULL && car->seen.emergency_mode != 1 && car->seen.individual_service_mode != 1 &&
+        cartimer_reached(now, &car->retry)) {
+        connect_car(car);
+    }
+}
+
+static bool earlier(const struct timespec *a, const struct timespec *b) {
+    return cartimer_diff_ns(a, b) < 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 6) {
+        fprintf(stderr, "Usage: %s {name prefix} {count} {lowest floor} {highest floor} {delay} [poll ms] "
+                "[--heartbeat ms] [--binary]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int count = atoi(argv[2]);
+    delaytime = atoi(argv[5]);
+    int poll_ms = POLL_MS;
+    for (int i = 6; i < argc; i++) {
+        if (i == 6 && strncmp(argv[i], "--", 2) != 0) {
+            poll_ms = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--heartbeat") == 0 && i + 1 < argc) {
+            heartbeat_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            use_binary = true;
+        } else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (count <= 0 || delaytime <= 0 || poll_ms <= 0) {
+        fprintf(stderr, "Error: Count, delay and poll time must be positive integers.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (strlen(argv[1]) > 200 || strlen(argv[3]) >= 4 || strlen(argv[4]) >= 4) {
+        fprintf(stderr, "Invalid name or floor(s) length specified.\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(lowest_floor, argv[3]);
+    strcpy(highest_floor, argv[4]);
+    int lowest_floor_number = stringToFloor(lowest_floor);
+    int highest_floor_number = stringToFloor(highest_floor);
+    if (lowest_floor_number == INT_MIN || highest_floor_number == INT_MIN ||
+        lowest_floor_number > highest_floor_number) {
+        fprintf(stderr, "Invalid floor(s) specified.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    // Registered with a NULL pointer to tell it apart from the cars
+    timer_fd = timerfd_create(CARTIMER_CLOCK, TFD_NONBLOCK);
+    struct epoll_event timer_event;
+    timer_event.events = EPOLLIN;
+    timer_event.data.ptr = NULL;
+    if (timer_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_event) == -1) {
+        perror("timerfd");
+        exit(EXIT_FAILURE);
+    }
+
+    fleet_car_t *cars = calloc((size_t)count, sizeof(fleet_car_t));
+    if (cars == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    struct timespec now;
+    cartimer_now(&now);
+    for (int i = 0; i < count; i++) {
+        fleet_car_t *car = &cars[i];
+        char shm_name[300];
+        snprintf(car->name, sizeof(car->name), "%s%d", argv[1], i + 1);
+        snprintf(shm_name, sizeof(shm_name), "/car%s", car->name);
+        if (create_shared_object(&car->cardata, shm_name) == false) {
+            fprintf(stderr, "Error: Failed to create shared memory object.\n");
+            exit(EXIT_FAILURE);
+        }
+        init_shared_data(&car->cardata, lowest_floor);
+        car_control_init(&car->control, &car->cardata, lowest_floor_number, highest_floor_number, delaytime);
+        copy_car_snapshot(car->cardata.data, &car->seen);
+        car->retry = now;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stop_signal) {
+        // Sleep until the next deadline, reconnect or poll of shared memory
+        cartimer_now(&now);
+        struct timespec wake = now;
+        cartimer_add_ms(&wake, poll_ms);
+        for (int i = 0; i < count; i++) {
+            struct timespec deadline;
+            service_car(&cars[i], &now);
+            if (car_control_deadline(&cars[i].control, &deadline) && earlier(&deadline, &wake)) {
+                wake = deadline;
+            }
+            if (heartbeat_deadline(&cars[i], &deadline) && earlier(&deadline, &wake)) {
+                wake = deadline;
+            }
+            if (cars[i].conn == NULL && earlier(&cars[i].retry, &wake)) {
+                wake = cars[i].retry;
+            }
+        }
+
+        struct itimerspec timer = {{0, 0}, wake};
+        if (timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0) {
+            // Zero would disarm the timer
+            timer.it_value.tv_nsec = 1;
+        }
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+        for (int n = 0; n < ready; n++) {
+            fleet_car_t *car = events[n].data.ptr;
+            if (car == NULL) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+                    perror("read");
+                }
+            } else if (car->conn != NULL) {
+                handle_car_events(car, events[n].events);
+            }
+        }
+    }
+
+    printf("\nCaught signal, closing %d cars and exiting...\n", count);
+    for (int i = 0; i < count; i++) {
+        disconnect_car(&cars[i]);
+        timer_stats_print(stdout, cars[i].name, &cars[i].control.jitter);
+        destroy_shared_object(&cars[i].cardata);
+    }
+    free(cars);
+    close(timer_fd);
+    close(epoll_fd);
+    return 0;
+}
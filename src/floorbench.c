@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+
+/**
+ * Microbenchmark for the floor label codec. Compares floorToString and
+ * stringToFloor against the sscanf/snprintf versions they replaced.
+ *
+ * Usage: floorbench [rounds]
+ */
+
+#define DEFAULT_ROUNDS 2000
+
+// The original snprintf based implementation, with the floor bounded to
+// what fits in a label so the formats can't truncate. That is every floor
+// the benchmark converts.
+static void legacy_floorToString(char floorlabel[4], int floor)
+{
+    if (floor < 0)
+    {
+        snprintf(floorlabel, 4, "B%u", (unsigned)abs(floor) % 100u);
+    }
+    else if (floor == 0)
+    {
+        snprintf(floorlabel, 4, "%d", 1);
+    }
+    else
+    {
+        snprintf(floorlabel, 4, "%u", (unsigned)floor % 1000u);
+    }
+}
+
+// The original sscanf based implementation
+static int legacy_stringToFloor(char floorlabel[4])
+{
+    int floor = INT_MIN;
+
+    if (floorlabel[0] == 'B')
+    {
+        if (sscanf(floorlabel + 1, "%d", &floor) == 1)
+        {
+            floor = -floor;
+        }
+    }
+    else if (sscanf(floorlabel, "%d", &floor) != 1)
+    {
+        floor = INT_MIN;
+    }
+    return floor;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : DEFAULT_ROUNDS;
+    if (rounds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [rounds]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Every labelled floor, skipping 0 which has no label of its own
+    static char labels[FLOOR_COUNT][4];
+    int floors[FLOOR_COUNT];
+    int count = 0;
+    for (int floor = FLOOR_LOWEST; floor <= FLOOR_HIGHEST; floor++)
+    {
+        if (floor == 0)
+        {
+            continue;
+        }
+        floors[count] = floor;
+        legacy_floorToString(labels[count], floor);
+        count++;
+    }
+
+    // Both codecs must agree on every valid label before timing anything
+    for (int i = 0; i < count; i++)
+    {
+        char label[4];
+        floorToString(label, floors[i]);
+        if (strcmp(label, labels[i]) != 0 || stringToFloor(labels[i]) != legacy_stringToFloor(labels[i]))
+        {
+            fprintf(stderr, "Mismatch for floor %d: %s\n", floors[i], label);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct timespec start, end;
+    volatile int sink = 0;
+    char label[4];
+    long operations = (long)rounds * count;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < count; i++)
+            sink += legacy_stringToFloor(labels[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy_parse = elapsed_ns(&start, &end) / operations;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < count; i++)
+            sink += stringToFloor(labels[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double table_parse = elapsed_ns(&start, &end) / operations;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < count; i++)
+        {
+            legacy_floorToString(label, floors[i]);
+            sink += label[0];
+        }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy_format = elapsed_ns(&start, &end) / operations;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < count; i++)
+        {
+            floorToString(label, floors[i]);
+            sink += label[0];
+        }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double table_format = elapsed_ns(&start, &end) / operations;
+
+    printf("%ld conversions per function (%d labels x %d rounds)\n", operations, count, rounds);
+    printf("stringToFloor  sscanf: %7.2f ns/op  table: %7.2f ns/op  (%.1fx)\n",
+           legacy_parse, table_parse, legacy_parse / table_parse);
+    printf("floorToString snprintf: %7.2f ns/op  table: %7.2f ns/op  (%.1fx)\n",
+           legacy_format, table_format, legacy_format / table_format);
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+typedef struct {
+    int64_t minval;
+    int64_t maxval;
+    int count;
+} histogram;
+
+int compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void draw_histogram(histogram *h, int bars) {
+    int max_count = 0;
+    for (int i = 0; i < bars; i++) {
+        max_count = MAX(max_count, h[i].count);
+    }
+
+    for (int i = 0; i < bars; i++) {
+        printf("%7.2f - %-7.2f ", (double)h[i].minval / 1000.0, (double)h[i].maxval / 1000.0);
+        int len = h[i].count;
+        if (max_count > 60) {
+            len = (len * 60 + max_count - 1) / max_count;
+        }
+        for (int j = 0; j < len; j++) {
+            printf("#");
+        }
+        printf(" (%d)\n", h[i].count);
+    }
+}
+
+void histogram_print(const int64_t *values, int count, int bars) {
+    int64_t min = INT64_MAX, max = INT64_MIN;
+    for (int i = 0; i < count; i++) {
+        min = MIN(min, values[i]);
+        max = MAX(max, values[i]);
+    }
+
+    bars = MIN(bars, count);
+    histogram histo[bars];
+    for (int i = 0; i < bars; i++) {
+        histo[i].minval = min + ((max - min + 1) * i / bars);
+        histo[i].maxval = min + ((max - min + 1) * (i + 1) / bars - 1);
+        histo[i].count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < bars; j++) {
+            if (values[i] >= histo[j].minval && values[i] <= histo[j].maxval) histo[j].count++;
+        }
+    }
+    draw_histogram(histo, bars);
+}
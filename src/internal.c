@@ -111,12 +111,17 @@ int main(int argc, char *argv[]) {
             edit_shared_memory(&cardata,OP_SET_EMERGENCY_STOP,0,0);
             break;
         case serviceon:
-            edit_shared_memory(&cardata,OP_SET_SERVICE,0,0);
-            edit_shared_memory(&cardata,OP_CLEAR_EMERGENCY,0,0);
-            edit_shared_memory(&cardata,OP_CLEAR_EMERGENCY_STOP,0,0);
-            edit_shared_memory(&cardata,OP_CLEAR_OVERLOAD,0,0);
-            edit_shared_memory(&cardata,OP_CLEAR_DOOR_OBSTRUCTION,0,0);
+        {
+            shm_edit_t edits[] = {
+                {OP_SET_SERVICE, 0, 0},
+                {OP_CLEAR_EMERGENCY, 0, 0},
+                {OP_CLEAR_EMERGENCY_STOP, 0, 0},
+                {OP_CLEAR_OVERLOAD, 0, 0},
+                {OP_CLEAR_DOOR_OBSTRUCTION, 0, 0},
+            };
+            edit_shared_memory_batch(&cardata, edits, sizeof(edits) / sizeof(edits[0]));
             break;
+        }
         case serviceoff:
             edit_shared_memory(&cardata,OP_CLEAR_SERVICE,0,0);
             break;
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <limits.h>
+#include <poll.h>
+#include <errno.h>
+
+#include "sharedmemory.h"
+#include "protocol.h"
+
+/**
+ * Fixed layout of each binary message: its shortest length and where its
+ * fields are. Fields a message doesn't have are at NONE, past the end of any
+ * frame, where the decoder's zero-padded copy reads back 0.
+ */
+#define NONE (PROTOCOL_MAX_FRAME - 2)
+
+typedef struct {
+    uint8_t length;       // Length without the name
+    uint8_t status;       // Offset of the status byte
+    uint8_t floor[2];     // Offsets of the floors
+    bool name;            // A name fills the rest of the frame
+} layout_t;
+
+static const layout_t layouts[MSG_TYPE_COUNT] = {
+    [MSG_CALL]        = {5, NONE, {1, 3}, false},
+    [MSG_CAR]         = {5, NONE, {1, 3}, true},
+    [MSG_STATUS]      = {6, 1, {2, 4}, false},
+    [MSG_FLOOR]       = {3, NONE, {1, NONE}, false},
+    [MSG_ASSIGNED]    = {1, NONE, {NONE, NONE}, true},
+    [MSG_UNAVAILABLE] = {1, NONE, {NONE, NONE}, false},
+    [MSG_EMERGENCY]   = {1, NONE, {NONE, NONE}, false},
+    [MSG_SERVICE]     = {1, NONE, {NONE, NONE}, false},
+    [MSG_STATUS_ONLY] = {2, 1, {NONE, NONE}, false},
+};
+
+static int16_t read_int16(const unsigned char *p) {
+    return (int16_t)(((unsigned)p[0] << 8) | p[1]);
+}
+
+static void write_int16(unsigned char *p, int16_t value) {
+    p[0] = (unsigned char)((uint16_t)value >> 8);
+    p[1] = (unsigned char)value;
+}
+
+// Function to check a floor is one a label can name. stringToFloor's
+// INT_MIN for a bad label is outside the range too.
+static bool is_labelled_floor(int floor) {
+    return floor != 0 && floor >= FLOOR_LOWEST && floor <= FLOOR_HIGHEST;
+}
+
+// Every field is read from a zero-padded copy at its table offset, so the
+// only checks are the opcode, the length, the status range and the floors
+static bool decode_binary(const unsigned char *frame, size_t length, message_t *message) {
+    unsigned opcode = frame[0];
+    if (opcode == MSG_INVALID || opcode >= MSG_TYPE_COUNT || length < layouts[opcode].length ||
+        (!layouts[opcode].name && length != layouts[opcode].length) ||
+        length - layouts[opcode].length >= PROTOCOL_NAME_LENGTH) {
+        return false;
+    }
+    const layout_t *layout = &layouts[opcode];
+    unsigned char padded[PROTOCOL_MAX_FRAME] = {0};
+    memcpy(padded, frame, length);
+
+    message->type = (message_type_t)opcode;
+    message->binary = true;
+    message->status = (Status)padded[layout->status];
+    message->floor[0] = read_int16(&padded[layout->floor[0]]);
+    message->floor[1] = read_int16(&padded[layout->floor[1]]);
+    size_t name_length = layout->name ? length - layout->length : 0;
+    memcpy(message->name, &padded[layout->length], name_length);
+    message->name[name_length] = '\0';
+    for (int i = 0; i < 2; i++) {
+        if (layout->floor[i] != NONE && !is_labelled_floor(message->floor[i])) {
+            return false;
+        }
+    }
+    return message->status < NUM_STATUSES;
+}
+
+// Function to decode a text message's floor labels, false if either isn't
+// one, so a text frame is rejected wherever the binary one would be
+static bool decode_labels(message_t *message, char *first, char *second) {
+    char *labels[2] = {first, second};
+    for (int i = 0; i < 2 && labels[i] != NULL; i++) {
+        int floor = stringToFloor(labels[i]);
+        if (!is_labelled_floor(floor)) {
+            return false;
+        }
+        message->floor[i] = (int16_t)floor;
+    }
+    return true;
+}
+
+static bool decode_text(const char *frame, message_t *message) {
+    char a[8], b[4], c[4], binary[7];
+    int fields;
+
+    if ((fields = sscanf(frame, "CALL %3s %3s %6s", b, c, binary)) >= 2) {
+        message->type = MSG_CALL;
+        message->binary = (fields == 3 && strcmp(binary, "BINARY") == 0);
+        return decode_labels(message, b, c);
+    }
+    if ((fields = sscanf(frame, "CAR %49s %3s %3s %6s", message->name, b, c, binary)) >= 1) {
+        if (fields == 1) {
+            message->type = MSG_ASSIGNED;
+            return true;
+        }
+        if (fields < 3) {
+            return false;
+        }
+        message->type = MSG_CAR;
+        message->binary = (fields == 4 && strcmp(binary, "BINARY") == 0);
+        return decode_labels(message, b, c);
+    }
+    if (sscanf(frame, "STATUS %7s %3s %3s", a, b, c) == 3) {
+        Status status = stringToStatus(a);
+        if ((int)status < 0) {
+            return false;
+        }
+        message->type = MSG_STATUS;
+        message->status = status;
+        return decode_labels(message, b, c);
+    }
+    if (sscanf(frame, "FLOOR %3s", b) == 1) {
+        message->type = MSG_FLOOR;
+        return decode_labels(message, b, NULL);
+    }
+    if (strncmp(frame, "UNAVAILABLE", 11) == 0) {
+        message->type = MSG_UNAVAILABLE;
+    } else if (strncmp(frame, "EMERGENCY", 9) == 0) {
+        message->type = MSG_EMERGENCY;
+    } else if (strncmp(frame, "INDIVIDUAL SERVICE", 18) == 0) {
+        message->type = MSG_SERVICE;
+    }
+    return message->type != MSG_INVALID;
+}
+
+bool protocol_decode(const char *frame, size_t length, message_t *message) {
+    memset(message, 0, sizeof(*message));
+    if (length == 0 || length >= PROTOCOL_MAX_FRAME) {
+        return false;
+    }
+    if ((unsigned char)frame[0] < 0x20) {
+        return decode_binary((const unsigned char *)frame, length, message);
+    }
+    return decode_text(frame, message);
+}
+
+size_t protocol_encode(const message_t *message, bool binary, char *frame) {
+    if (binary) {
+        const layout_t *layout = &layouts[message->type];
+        unsigned char *out = (unsigned char *)frame;
+        size_t name_length = layout->name ? strnlen(message->name, PROTOCOL_NAME_LENGTH - 1) : 0;
+        out[0] = (unsigned char)message->type;
+        if (layout->status != NONE) {
+            out[layout->status] = (unsigned char)message->status;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (layout->floor[i] != NONE) {
+                write_int16(&out[layout->floor[i]], message->floor[i]);
+            }
+        }
+        memcpy(&out[layout->length], message->name, name_length);
+        return layout->length + name_length;
+    }
+
+    char a[4], b[4];
+    floorToString(a, message->floor[0]);
+    floorToString(b, message->floor[1]);
+    int length = 0;
+    switch (message->type) {
+        case MSG_CALL:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "CALL %s %s", a, b);
+            break;
+        case MSG_CAR:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "CAR %s %s %s", message->name, a, b);
+            break;
+        case MSG_STATUS:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "STATUS %s %s %s", status_names[message->status], a, b);
+            break;
+        case MSG_FLOOR:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "FLOOR %s", a);
+            break;
+        case MSG_ASSIGNED:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "CAR %s", message->name);
+            break;
+        case MSG_UNAVAILABLE:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "UNAVAILABLE");
+            break;
+        case MSG_EMERGENCY:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "EMERGENCY");
+            break;
+        case MSG_SERVICE:
+            length = snprintf(frame, PROTOCOL_MAX_FRAME, "INDIVIDUAL SERVICE");
+            break;
+        default:
+            break;
+    }
+    return (length > 0) ? (size_t)length : 0;
+}
+
+size_t protocol_frame(const message_t *message, bool binary, char *frame) {
+    size_t length = protocol_encode(message, binary, frame + sizeof(uint32_t));
+    uint32_t prefix = htonl((uint32_t)length);
+    memcpy(frame, &prefix, sizeof(prefix));
+    return sizeof(prefix) + length;
+}
+
+bool protocol_send(int sockfd, const message_t *message, bool binary) {
+    char frame[sizeof(uint32_t) + PROTOCOL_MAX_FRAME];
+    size_t total = protocol_frame(message, binary, frame), done = 0;
+
+    // A non-blocking socket is waited on rather than the message dropped or
+    // the peer left mid-frame
+    while (done < total) {
+        ssize_t n = send(sockfd, frame + done, total - done, MSG_NOSIGNAL);
+        if (n > 0) {
+            done += (size_t)n;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {sockfd, POLLOUT, 0};
+            if (poll(&pfd, 1, PROTOCOL_SEND_TIMEOUT_MS) == 0) {
+                fprintf(stderr, "send: peer stopped reading\n");
+                return false;
+            }
+        } else if (n == -1 && errno != EINTR) {
+            perror("send");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool protocol_status_report(const car_shared_data_t *data, message_t *last, bool binary, bool heartbeat,
+                            message_t *report) {
+    message_t current = {.type = MSG_STATUS, .status = stringToStatus(data->status),
+                         .floor = {(int16_t)stringToFloor((char *)data->current_floor),
+                                   (int16_t)stringToFloor((char *)data->destination_floor)}};
+    if ((int)current.status < 0) {
+        // Not a status the controller could act on; the safety checks deal with it
+        return false;
+    }
+    bool reported = (last->type == MSG_STATUS);
+    bool same_floors = reported && current.floor[0] == last->floor[0] && current.floor[1] == last->floor[1];
+
+    if (!heartbeat && same_floors && current.status == last->status) {
+        return false;
+    }
+    *last = current;
+    *report = current;
+    if (binary && !heartbeat && same_floors) {
+        report->type = MSG_STATUS_ONLY;
+    }
+    return true;
+}
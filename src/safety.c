@@ -5,11 +5,11 @@
 #include <string.h>
 #include <arpa/inet.h>
 #include <pthread.h>
-#include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
 
 #include "sharedmemory.h"
+#include "safetycheck.h"
 
 /**
  This code adheres to the following MISRA C guidelines:
@@ -75,63 +75,25 @@ void handle_sigint(int sig)
 }
 
 /**
- * @brief Validates if the given floor string is in a valid format.
- * 
- * This function checks if the provided floor string is valid. A valid floor string
- * can either start with 'B' followed by digits (e.g., "B1", "B2") or just digits 
- * (e.g., "1", "2"). The length of the floor string should not exceed 3 characters.
- * 
- * @param floor The floor string to be validated.
- * @return true if the floor string is valid, false otherwise.
+ * The car as the last check saw it.
  */
-bool is_valid_floor(const char* floor) {
-    if (floor[0] == 'B') {
-        if (strlen(floor) > 3) {
-            return false;
-        }
-        for (int i = 1; i < strlen(floor); i++) {
-            if (!isdigit(floor[i])) {
-                return false;
-            }
-        }
-    } else {
-        if (strlen(floor) > 3) {
-            return false;
-        }
-        for (int i = 0; i < strlen(floor); i++) {
-            if (!isdigit(floor[i])) {
-                return false;
-            }
-        }
-    }
-    return true;  // Placeholder
-}
+static safety_state_t checked;
 
 /**
- * @brief This function processes the given input and performs the specified operation.
- * 
- * @param input The input data to be processed.
- * @param operation The operation to be performed on the input data.
- * @return The result of the operation performed on the input data.
- * 
- * @note Ensure that the input data is valid and the operation is supported.
+ * @brief Writes the message for each finding of a check to stdout.
  * 
- * @example
- * int result = functionName(inputData, operationType);
- * printf("Result: %d", result);
+ * @param found SAFETY_* bits returned by safety_check.
  */
-bool is_valid_status(const char* status) {
-    for (int i = 0; i < NUM_STATUSES; i++) {
-        if (strcmp(status, status_names[i]) == 0) {
-            return true;
+static void report(uint32_t found)
+{
+    for (int i = 0; i < SAFETY_FINDING_COUNT; i++) {
+        if ((found & (1u << i)) != 0u) {
+            (void)snprintf(buffer, BUFFER_SIZE, "%s\n", safety_messages[i]);
+            (void)write(STDOUT_FILENO, buffer, strlen(buffer));
         }
     }
-    return false;
 }
 
-
-
-
 int main(int argc, char *argv[]){
     signal(SIGINT, handle_sigint);
     
@@ -161,85 +123,21 @@ int main(int argc, char *argv[]){
 
      
 
+    /* The first wake checks every field */
+    uint32_t changed = SHM_DIRTY_ALL;
     while(true){
         pthread_mutex_lock(&cardata.data->mutex);
         pthread_cond_wait(&cardata.data->cond, &cardata.data->mutex);
-
-        if (cardata.data->door_obstruction == 1 && strcmp(cardata.data->status, "Closing") == 0) {
-        strcpy(cardata.data->status, "Opening");
-        cardata.data->open_button = 1;
-        //printf("Obstruction detected. Reopening doors.\n");
-        }
-
-        if (cardata.data->emergency_stop == 1 && cardata.data->emergency_mode == 0) {
-            snprintf(buffer, BUFFER_SIZE, "The emergency stop button has been pressed!\n");
-            write(STDOUT_FILENO, buffer, strlen(buffer));
-            fflush(stdout);
-            cardata.data->emergency_mode = 1;
-        }
-
-        if (cardata.data->overload == 1 && cardata.data->emergency_mode == 0) {
-            snprintf(buffer, BUFFER_SIZE, "The overload sensor has been tripped!\n");
-            write(STDOUT_FILENO, buffer, strlen(buffer));
-            fflush(stdout);
-            cardata.data->emergency_mode = 1;
-        }
-
-        if (cardata.data->emergency_mode != 1) {
-            if (
-                /*current_floor or destination_floor does not contain a valid floor string*/
-                !is_valid_floor(cardata.data->current_floor) || 
-                !is_valid_floor(cardata.data->destination_floor) ||
-
-                /*status is not one of the 5 valid statuses*/
-                !is_valid_status(cardata.data->status) ||
-
-                /*uint8_t fields are 0 or 1*/
-                cardata.data->open_button > 1 || cardata.data->close_button > 1 ||
-                cardata.data->door_obstruction > 1 || cardata.data->overload > 1 ||
-                cardata.data->emergency_stop > 1 || cardata.data->individual_service_mode > 1 ||
-
-                /*door_obstruction is 1 and status is something other than Opening or Closing:*/
-                (cardata.data->door_obstruction == 1 && 
-                strcmp(cardata.data->status, status_names[Opening]) != 0 && 
-                strcmp(cardata.data->status, status_names[Closing]) != 0)) 
-            {
-                snprintf(buffer, BUFFER_SIZE, "Data consistency error!\n");
-                write(STDOUT_FILENO, buffer, strlen(buffer));
-                fflush(stdout);
-                cardata.data->emergency_mode = 1;
-            }
-
-            if (!is_valid_floor(cardata.data->current_floor) || !is_valid_floor(cardata.data->destination_floor))
-                {snprintf(buffer, BUFFER_SIZE, "Floor consistency error!\n");
-                write(STDOUT_FILENO, buffer, strlen(buffer));
-                fflush(stdout);
-                cardata.data->emergency_mode = 1;}
-            if (!is_valid_status(cardata.data->status))
-               {snprintf(buffer, BUFFER_SIZE, "Status consistency error!\n");
-                write(STDOUT_FILENO, buffer, strlen(buffer));
-                fflush(stdout);
-                cardata.data->emergency_mode = 1;}
-            if(cardata.data->open_button > 1 || cardata.data->close_button > 1 ||
-                cardata.data->open_button > 1 || cardata.data->close_button > 1 ||
-                cardata.data->door_obstruction > 1 || cardata.data->overload > 1 ||
-                cardata.data->emergency_stop > 1 || cardata.data->individual_service_mode > 1){
-                snprintf(buffer, BUFFER_SIZE, "Button consistency error!\n");
-                write(STDOUT_FILENO, buffer, strlen(buffer));
-                fflush(stdout);
-                cardata.data->emergency_mode = 1;
-                }
-
-            if(
-                (cardata.data->door_obstruction == 1 && 
-                strcmp(cardata.data->status, status_names[Opening]) != 0 && 
-                strcmp(cardata.data->status, status_names[Closing]) != 0)){
-                snprintf(buffer, BUFFER_SIZE, "Door Status consistency error!\n");
-                write(STDOUT_FILENO, buffer, strlen(buffer));
-                fflush(stdout);
-                cardata.data->emergency_mode = 1;
-                } 
+        shm_write_begin(&cardata);
+        changed |= atomic_exchange_explicit(&cardata.data->dirty, 0u, memory_order_relaxed);
+        uint32_t found = safety_check(&checked, cardata.data, changed);
+        if ((found & SAFETY_EMERGENCY) != 0u) {
+            /* Wake the car to report the emergency */
+            pthread_cond_broadcast(&cardata.data->cond);
         }
+        report(found);
+        changed = 0u;
+        shm_write_end(&cardata);
         pthread_mutex_unlock(&cardata.data->mutex);
     }
     return 0;
@@ -0,0 +1,160 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "sharedmemory.h"
+#include "safetycheck.h"
+
+/**
+ This code follows the same MISRA C guidelines as safety.c: explicit
+ comparisons, no heap allocation and no <stdio.h> output. The callers print
+ the findings.
+ */
+
+const char *const safety_messages[SAFETY_FINDING_COUNT] = {
+    "The emergency stop button has been pressed!",
+    "The overload sensor has been tripped!",
+    "Data consistency error!",
+    "Floor consistency error!",
+    "Status consistency error!",
+    "Button consistency error!",
+    "Door Status consistency error!",
+};
+
+/**
+ * Fields each check depends on. A check only runs again when one of its
+ * fields has changed.
+ */
+#define FLOOR_FIELDS  (SHM_DIRTY_CURRENT_FLOOR | SHM_DIRTY_DESTINATION_FLOOR)
+#define BUTTON_FIELDS (SHM_DIRTY_OPEN_BUTTON | SHM_DIRTY_CLOSE_BUTTON | SHM_DIRTY_DOOR_OBSTRUCTION | \
+                       SHM_DIRTY_OVERLOAD | SHM_DIRTY_EMERGENCY_STOP | SHM_DIRTY_INDIVIDUAL_SERVICE)
+#define DOOR_FIELDS   (SHM_DIRTY_DOOR_OBSTRUCTION | SHM_DIRTY_STATUS)
+
+bool is_valid_floor(const char* floor) {
+    if (floor[0] == 'B') {
+        if (strlen(floor) > 3) {
+            return false;
+        }
+        for (int i = 1; i < strlen(floor); i++) {
+            if (!isdigit(floor[i])) {
+                return false;
+            }
+        }
+    } else {
+        if (strlen(floor) > 3) {
+            return false;
+        }
+        for (int i = 0; i < strlen(floor); i++) {
+            if (!isdigit(floor[i])) {
+                return false;
+            }
+        }
+    }
+    return true;  // Placeholder
+}
+
+/**
+ * @brief Checks a status is one of the five valid statuses.
+ *
+ * @param status The status, as parsed by stringToStatus.
+ * @return true if the status is valid, false otherwise.
+ */
+static bool is_valid_status(Status status)
+{
+    return ((int)status >= 0) && ((int)status < NUM_STATUSES);
+}
+
+uint32_t safety_diff(const car_snapshot_t *last, const car_snapshot_t *now)
+{
+    uint32_t changed = 0u;
+
+    if (memcmp(now->current_floor, last->current_floor, sizeof(last->current_floor)) != 0) {
+        changed |= SHM_DIRTY_CURRENT_FLOOR;
+    }
+    if (memcmp(now->destination_floor, last->destination_floor, sizeof(last->destination_floor)) != 0) {
+        changed |= SHM_DIRTY_DESTINATION_FLOOR;
+    }
+    if (memcmp(now->status, last->status, sizeof(last->status)) != 0) {
+        changed |= SHM_DIRTY_STATUS;
+    }
+    changed |= (now->open_button != last->open_button) ? SHM_DIRTY_OPEN_BUTTON : 0u;
+    changed |= (now->close_button != last->close_button) ? SHM_DIRTY_CLOSE_BUTTON : 0u;
+    changed |= (now->door_obstruction != last->door_obstruction) ? SHM_DIRTY_DOOR_OBSTRUCTION : 0u;
+    changed |= (now->overload != last->overload) ? SHM_DIRTY_OVERLOAD : 0u;
+    changed |= (now->emergency_stop != last->emergency_stop) ? SHM_DIRTY_EMERGENCY_STOP : 0u;
+    changed |= (now->individual_service_mode != last->individual_service_mode) ? SHM_DIRTY_INDIVIDUAL_SERVICE : 0u;
+    changed |= (now->emergency_mode != last->emergency_mode) ? SHM_DIRTY_EMERGENCY_MODE : 0u;
+    return changed;
+}
+
+uint32_t safety_check(safety_state_t *state, car_shared_data_t *data, uint32_t changed)
+{
+    uint32_t found = 0u;
+    car_snapshot_t now;
+
+    copy_car_snapshot(data, &now);
+    changed |= safety_diff(&state->fields, &now);
+
+    if (((changed & SHM_DIRTY_EMERGENCY_MODE) != 0u) && (data->emergency_mode == 0u)) {
+        /* Nothing was checked during emergency mode */
+        changed = SHM_DIRTY_ALL;
+    }
+    if ((changed & SHM_DIRTY_STATUS) != 0u) {
+        state->status = stringToStatus(data->status);
+    }
+    if ((changed & SHM_DIRTY_CURRENT_FLOOR) != 0u) {
+        state->current_floor_valid = is_valid_floor(data->current_floor);
+    }
+    if ((changed & SHM_DIRTY_DESTINATION_FLOOR) != 0u) {
+        state->destination_floor_valid = is_valid_floor(data->destination_floor);
+    }
+
+    if (((changed & DOOR_FIELDS) != 0u) && (data->door_obstruction == 1u) && (state->status == Closing)) {
+        (void)strcpy(data->status, status_names[Opening]);
+        data->open_button = 1u;
+        state->status = Opening;
+    }
+
+    if (((changed & (SHM_DIRTY_EMERGENCY_STOP | SHM_DIRTY_EMERGENCY_MODE)) != 0u) &&
+        (data->emergency_stop == 1u) && (data->emergency_mode == 0u)) {
+        found |= SAFETY_EMERGENCY_STOP;
+        data->emergency_mode = 1u;
+    }
+
+    if (((changed & (SHM_DIRTY_OVERLOAD | SHM_DIRTY_EMERGENCY_MODE)) != 0u) &&
+        (data->overload == 1u) && (data->emergency_mode == 0u)) {
+        found |= SAFETY_OVERLOAD;
+        data->emergency_mode = 1u;
+    }
+
+    if (data->emergency_mode != 1u) {
+        if (((changed & FLOOR_FIELDS) != 0u) &&
+            (!state->current_floor_valid || !state->destination_floor_valid)) {
+            found |= SAFETY_FLOOR_ERROR;
+        }
+        if (((changed & SHM_DIRTY_STATUS) != 0u) && !is_valid_status(state->status)) {
+            found |= SAFETY_STATUS_ERROR;
+        }
+        if (((changed & BUTTON_FIELDS) != 0u) &&
+            ((data->open_button > 1u) || (data->close_button > 1u) ||
+             (data->door_obstruction > 1u) || (data->overload > 1u) ||
+             (data->emergency_stop > 1u) || (data->individual_service_mode > 1u))) {
+            found |= SAFETY_BUTTON_ERROR;
+        }
+        if (((changed & DOOR_FIELDS) != 0u) && (data->door_obstruction == 1u) &&
+            (state->status != Opening) && (state->status != Closing)) {
+            found |= SAFETY_DOOR_ERROR;
+        }
+        if (found != 0u) {
+            found |= SAFETY_DATA_ERROR;
+            data->emergency_mode = 1u;
+        }
+    }
+
+    if ((found & SAFETY_EMERGENCY) != 0u) {
+        data->emergency_at = shm_timestamp();
+    }
+    copy_car_snapshot(data, &state->fields);
+    return found;
+}
@@ -0,0 +1,374 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+#include "simulation.h"
+#include "workload.h"
+#include "histogram.h"
+
+/**
+ * Runs many independent, seeded simulations of the Test/test-sched.c
+ * scenario on a pool of threads and reports the mean, p50, p95 and p99 wait
+ * and ride times with 95% confidence intervals, for every combination of car
+ * count, floor range, arrival rate and traffic profile. Each statistic is worked out per run
+ * and then averaged over the runs, so the runs are the independent samples.
+ *
+ * Usage: schedbench [--threads n] [--runs n] [--seed n] [--car-delay ms]
+ *                   [--duration s] [--cars list] [--floors list] [--rates list]
+ *                   [--profiles list]
+ *
+ * Lists are comma separated, e.g. --cars 1,2,4 --floors 1-10,B2-20 --rates 20,60
+ * --profiles up-peak,lunch. Passengers arrive as a Poisson process at the
+ * rate, in passengers per minute, for the first --duration seconds, and
+ * travel as the profile says (see workload.h).
+ */
+
+#define RUNS        1000
+#define CAR_DELAY   100
+#define DURATION    300    // seconds
+#define SEED        1
+#define MAX_LIST    16
+
+#define STAT_MEAN   0
+#define STAT_P50    1
+#define STAT_P95    2
+#define STAT_P99    3
+#define STAT_COUNT  4
+
+static const char *stat_names[STAT_COUNT] = {"mean", "p50", "p95", "p99"};
+
+typedef struct {
+    int cars;
+    int lowest_floor;
+    int highest_floor;
+    char floors[12];
+    int rate;                   // Passengers per minute
+    workload_profile_t profile;
+} scenario_t;
+
+/**
+ * What one run measured, in milliseconds.
+ */
+typedef struct {
+    bool ok;
+    double wait[STAT_COUNT];
+    double ride[STAT_COUNT];
+    size_t passengers;
+    size_t arrived;
+    size_t unavailable;
+    size_t unfinished;
+} run_result_t;
+
+typedef struct {
+    const scenario_t *scenarios;
+    size_t runs;
+    size_t total_jobs;
+    run_result_t *results;
+    atomic_size_t next_job;
+} bench_t;
+
+static int threads = 0;
+static int runs = RUNS;
+static unsigned int seed = SEED;
+static int car_delay = CAR_DELAY;
+static int duration = DURATION;
+static int car_list[MAX_LIST] = {1, 2, 4};
+static size_t car_count = 3;
+static char floor_list[MAX_LIST][12] = {"1-10", "B2-20"};
+static size_t floor_count = 2;
+static int rate_list[MAX_LIST] = {20, 60};
+static size_t rate_count = 2;
+static char profile_list[MAX_LIST][12] = {"uniform"};
+static size_t profile_count = 1;
+
+static size_t parse_ints(const char *arg, int *list) {
+    char copy[256];
+    size_t count = 0;
+    snprintf(copy, sizeof(copy), "%s", arg);
+    for (char *save, *item = strtok_r(copy, ",", &save); item != NULL && count < MAX_LIST;
+         item = strtok_r(NULL, ",", &save)) {
+        list[count++] = atoi(item);
+    }
+    return count;
+}
+
+static size_t parse_floors(const char *arg, char list[][12]) {
+    char copy[256];
+    size_t count = 0;
+    snprintf(copy, sizeof(copy), "%s", arg);
+    for (char *save, *item = strtok_r(copy, ",", &save); item != NULL && count < MAX_LIST;
+         item = strtok_r(NULL, ",", &save)) {
+        snprintf(list[count++], 12, "%s", item);
+    }
+    return count;
+}
+
+static void init_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(argv[i], "--threads") == 0) threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--runs") == 0) runs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--seed") == 0) seed = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--car-delay") == 0) car_delay = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--duration") == 0) duration = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--cars") == 0) car_count = parse_ints(argv[i + 1], car_list);
+        else if (strcmp(argv[i], "--floors") == 0) floor_count = parse_floors(argv[i + 1], floor_list);
+        else if (strcmp(argv[i], "--rates") == 0) rate_count = parse_ints(argv[i + 1], rate_list);
+        else if (strcmp(argv[i], "--profiles") == 0) profile_count = parse_floors(argv[i + 1], profile_list);
+        else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads <= 0) {
+            threads = 1;
+        }
+    }
+}
+
+// Parse a floor range such as "B2-20"
+static bool parse_range(const char *range, int *lowest, int *highest) {
+    char low[4], high[4];
+    if (sscanf(range, "%3[^-]-%3s", low, high) != 2) {
+        return false;
+    }
+    *lowest = stringToFloor(low);
+    *highest = stringToFloor(high);
+    return *lowest != INT_MIN && *highest != INT_MIN && *lowest < *highest;
+}
+
+// Summarise sorted times in microseconds as milliseconds, percentiles by nearest rank
+static void summarise(int64_t *values, size_t count, double *stats) {
+    qsort(values, count, sizeof(int64_t), compare_int64);
+    double total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += (double)values[i];
+    }
+    stats[STAT_MEAN] = total / (double)count / 1000.0;
+    static const double ranks[] = {0.50, 0.95, 0.99};
+    for (int s = 0; s < 3; s++) {
+        size_t rank = (size_t)ceil(ranks[s] * (double)count);
+        stats[STAT_P50 + s] = (double)values[rank > 0 ? rank - 1 : 0] / 1000.0;
+    }
+}
+
+static void run_one(const scenario_t *scenario, unsigned int run_seed, run_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    sim_passenger_t *passengers = NULL;
+    int64_t *wait = NULL, *ride = NULL;
+
+    workload_t workload;
+    workload_call_t *calls;
+    size_t count;
+    if (!workload_init(&workload, scenario->profile, scenario->lowest_floor, scenario->highest_floor,
+                       0, (int64_t)duration * 1000000, 0)) {
+        return;
+    }
+    workload_set_poisson(&workload, scenario->rate);
+    bool generated = workload_generate(&workload, &run_seed, &calls, &count);
+    workload_destroy(&workload);
+    if (!generated) {
+        return;
+    }
+
+    sim_config_t config = {scenario->cars, scenario->lowest_floor, scenario->highest_floor, car_delay, 0};
+    passengers = calloc(count > 0 ? count : 1, sizeof(sim_passenger_t));
+    wait = malloc((count > 0 ? count : 1) * sizeof(int64_t));
+    ride = malloc((count > 0 ? count : 1) * sizeof(int64_t));
+    if (passengers == NULL || wait == NULL || ride == NULL) {
+        perror("malloc");
+        free(calls);
+        goto out;
+    }
+    for (size_t i = 0; i < count; i++) {
+        passengers[i].arrival_us = calls[i].time_us;
+        passengers[i].from = calls[i].from;
+        passengers[i].to = calls[i].to;
+    }
+    free(calls);
+
+    sim_summary_t summary;
+    if (!simulation_run(&config, passengers, count, &summary)) {
+        goto out;
+    }
+
+    size_t served = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (passengers[i].state == PASSENGER_ARRIVED) {
+            wait[served] = passengers[i].wait_us;
+            ride[served] = passengers[i].ride_us;
+            served++;
+        }
+    }
+    result->passengers = count;
+    result->arrived = summary.arrived;
+    result->unavailable = summary.unavailable;
+    result->unfinished = summary.unfinished;
+    if (served > 0) {
+        summarise(wait, served, result->wait);
+        summarise(ride, served, result->ride);
+        result->ok = true;
+    }
+
+out:
+    free(passengers);
+    free(wait);
+    free(ride);
+}
+
+static void *worker(void *arg) {
+    bench_t *bench = arg;
+    for (;;) {
+        size_t job = atomic_fetch_add(&bench->next_job, 1);
+        if (job >= bench->total_jobs) {
+            return NULL;
+        }
+        // Every run gets its own seed, so results don't depend on which
+        // thread ran it or in what order
+        unsigned int run_seed = seed + (unsigned int)job * 2654435761u;
+        run_one(&bench->scenarios[job / bench->runs], run_seed, &bench->results[job]);
+    }
+}
+
+// Print the mean of one statistic over the runs and its 95% confidence interval
+static void print_interval(const run_result_t *results, size_t count, bool ride, int stat) {
+    double sum = 0, sum_sq = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].ok) {
+            double v = ride ? results[i].ride[stat] : results[i].wait[stat];
+            sum += v;
+            sum_sq += v * v;
+            n++;
+        }
+    }
+    if (n == 0) {
+        printf(" %22s", "-");
+        return;
+    }
+    double mean = sum / (double)n;
+    double variance = (n > 1) ? (sum_sq - sum * mean) / (double)(n - 1) : 0;
+    double half_width = 1.96 * sqrt(variance > 0 ? variance : 0) / sqrt((double)n);
+    printf(" %10.1f +/- %-7.1f", mean, half_width);
+}
+
+static void report(const scenario_t *scenario, const run_result_t *results, size_t count) {
+    size_t passengers = 0, unavailable = 0, unfinished = 0;
+    for (size_t i = 0; i < count; i++) {
+        passengers += results[i].passengers;
+        unavailable += results[i].unavailable;
+        unfinished += results[i].unfinished;
+    }
+
+    printf("%d car%s, floors %s, %d passengers/min, %s (%zu runs)\n", scenario->cars,
+           scenario->cars == 1 ? "" : "s", scenario->floors, scenario->rate,
+           workload_profile_name(scenario->profile), count);
+    printf("%-10s", "");
+    for (int s = 0; s < STAT_COUNT; s++) {
+        printf(" %22s", stat_names[s]);
+    }
+    printf("\n%-10s", "Wait (ms)");
+    for (int s = 0; s < STAT_COUNT; s++) {
+        print_interval(results, count, false, s);
+    }
+    printf("\n%-10s", "Ride (ms)");
+    for (int s = 0; s < STAT_COUNT; s++) {
+        print_interval(results, count, true, s);
+    }
+    printf("\nUnavailable: %.2f%%  Unfinished: %.2f%%\n\n",
+           passengers ? 100.0 * (double)unavailable / (double)passengers : 0.0,
+           passengers ? 100.0 * (double)unfinished / (double)passengers : 0.0);
+}
+
+int main(int argc, char **argv) {
+    init_args(argc, argv);
+    if (runs <= 0 || car_delay <= 0 || duration <= 0 || car_count == 0 || floor_count == 0 || rate_count == 0 ||
+        profile_count == 0) {
+        fprintf(stderr, "Invalid benchmark parameters\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t scenario_count = car_count * floor_count * rate_count * profile_count;
+    scenario_t *scenarios = calloc(scenario_count, sizeof(scenario_t));
+    if (scenarios == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t n = 0;
+    for (size_t c = 0; c < car_count; c++) {
+        for (size_t f = 0; f < floor_count; f++) {
+            for (size_t r = 0; r < rate_count; r++) {
+                for (size_t p = 0; p < profile_count; p++) {
+                    scenario_t *scenario = &scenarios[n++];
+                    scenario->cars = car_list[c];
+                    scenario->rate = rate_list[r];
+                    memcpy(scenario->floors, floor_list[f], sizeof(scenario->floors));
+                    if (scenario->cars <= 0 || scenario->rate <= 0 ||
+                        !parse_range(floor_list[f], &scenario->lowest_floor, &scenario->highest_floor) ||
+                        !workload_profile_from_name(profile_list[p], &scenario->profile)) {
+                        fprintf(stderr, "Invalid scenario: %d cars, floors %s, rate %d, profile %s\n",
+                                scenario->cars, floor_list[f], scenario->rate, profile_list[p]);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+            }
+        }
+    }
+
+    bench_t bench;
+    bench.scenarios = scenarios;
+    bench.runs = (size_t)runs;
+    bench.total_jobs = scenario_count * (size_t)runs;
+    bench.results = calloc(bench.total_jobs, sizeof(run_result_t));
+    atomic_init(&bench.next_job, 0);
+    pthread_t *pool = malloc((size_t)threads * sizeof(pthread_t));
+    if (bench.results == NULL || pool == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&pool[started], NULL, worker, &bench) != 0) {
+            perror("pthread_create");
+            break;
+        }
+    }
+    if (started == 0) {
+        // Nothing to share the work with, so do it here
+        worker(&bench);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (size_t i = 0; i < scenario_count; i++) {
+        report(&scenarios[i], &bench.results[i * bench.runs], bench.runs);
+    }
+    printf("%zu simulations on %d thread%s in %.2fs\n", bench.total_jobs, started ? started : 1,
+           (started == 1) ? "" : "s",
+           (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9);
+
+    free(pool);
+    free(bench.results);
+    free(scenarios);
+    return 0;
+}
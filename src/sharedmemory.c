@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
 #include <semaphore.h>
 #include <fcntl.h>
 #include <semaphore.h>
@@ -13,8 +14,14 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "sharedmemory.h"
 
+// Lock-free attempts read_car_snapshot makes before taking the mutex
+#define SNAPSHOT_RETRIES 100
+
 
 const char *status_names[NUM_STATUSES] = {
     "Opening", // Fits exactly within 7 characters + null terminator
@@ -42,6 +49,29 @@ Status stringToStatus(const char *status_str)
     return -1; // Invalid status string
 }
 
+/**
+ * Every label in the B99..999 range, indexed by floor - FLOOR_LOWEST. Floor 0
+ * has no label of its own and maps to "1", as it always has.
+ */
+static char floor_labels[FLOOR_COUNT][4];
+static pthread_once_t floor_labels_once = PTHREAD_ONCE_INIT;
+
+static void build_floor_labels(void)
+{
+    for (int floor = FLOOR_LOWEST; floor <= FLOOR_HIGHEST; floor++)
+    {
+        char *label = floor_labels[floor - FLOOR_LOWEST];
+        if (floor < 0)
+        {
+            snprintf(label, 4, "B%d", -floor);
+        }
+        else
+        {
+            snprintf(label, 4, "%d", (floor == 0) ? 1 : floor);
+        }
+    }
+}
+
 /**
  * Get the label for a floor. Make sure you free the label after use.
  *
@@ -50,18 +80,18 @@ Status stringToStatus(const char *status_str)
  */
 void floorToString(char floorlabel[4], int floor)
 {
-    
-    if (floor < 0)
+    if (floor >= FLOOR_LOWEST && floor <= FLOOR_HIGHEST)
     {
-        // For basement levels, prefix with 'B' and invert the number
-        snprintf(floorlabel, 4, "B%d", abs(floor));
+        pthread_once(&floor_labels_once, build_floor_labels);
+        memcpy(floorlabel, floor_labels[floor - FLOOR_LOWEST], 4);
     }
-    else if(floor == 0){
-        snprintf(floorlabel, 4, "%d", 1);
+    else if (floor < 0)
+    {
+        // Out of range, keep the old (truncating) formatting
+        snprintf(floorlabel, 4, "B%d", abs(floor));
     }
     else
     {
-        // For regular floors, just print the number
         snprintf(floorlabel, 4, "%d", floor);
     }
 }
@@ -69,36 +99,37 @@ void floorToString(char floorlabel[4], int floor)
 /**
  * Convert a floor label back to a floor number.
  *
+ * Labels are "B1".."B99" and "1".."999" with no sign, padding or leading
+ * zeros. The digits are decoded directly instead of going through sscanf.
+ *
  * @param floorlabel The string representing the floor.
  * @return The floor number, or INT_MIN if the input is invalid.
  */
 int stringToFloor(char floorlabel[4])
 {
-    int floor = INT_MIN;
-
     if (floorlabel == NULL)
     {
-        return floor;
+        return INT_MIN;
     }
 
-    if (floorlabel[0] == 'B')
+    int basement = (floorlabel[0] == 'B');
+    const char *digits = floorlabel + basement;
+    int max_digits = 3 - basement;
+    int floor = 0;
+    int count = 0;
+
+    while (count < max_digits && (unsigned)(digits[count] - '0') <= 9u)
     {
-        // For basement levels, convert the number part and negate it
-        if (sscanf(floorlabel + 1, "%d", &floor) == 1)
-        {
-            floor = -floor;
-        }
+        floor = floor * 10 + (digits[count] - '0');
+        count++;
     }
-    else
+
+    // Needs at least one digit, no leading zero and nothing after the digits
+    if (count == 0 || digits[0] == '0' || digits[count] != '\0')
     {
-        // For regular floors, just convert the number
-        if (sscanf(floorlabel, "%d", &floor) != 1)
-        {
-            floor = INT_MIN; // Indicate an error if conversion fails
-        }
+        return INT_MIN;
     }
-
-    return floor;
+    return basement ? -floor : floor;
 }
 
 bool create_shared_object(shared_memory_t *shm, const char *share_name)
@@ -156,11 +187,21 @@ void init_shared_data(shared_memory_t* shm,char lowest[4]) {
     pthread_condattr_t cond_attr;
     pthread_condattr_init(&cond_attr);
     pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    // Timed waits use CLOCK_MONOTONIC deadlines, see cartimer.h
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
     pthread_cond_init(&shm->data->cond, &cond_attr);
     pthread_condattr_destroy(&cond_attr);
     
+    atomic_init(&shm->data->seq, 0);
+    atomic_init(&shm->data->dirty, 0);
+    shm->data->dirty_at = 0;
+    shm->data->fault_at = 0;
+    shm->data->emergency_at = 0;
+    shm->data->reported_at = 0;
+
     pthread_mutex_lock(&(shm->data->mutex));
     shm->shm_changed = 1;
+    shm_write_begin(shm);
 
     strcpy(shm->data->current_floor,lowest);
     shm->data->open_button = 0;
@@ -173,6 +214,7 @@ void init_shared_data(shared_memory_t* shm,char lowest[4]) {
     shm->data->individual_service_mode = 0;
     shm->data->emergency_mode = 0;
 
+    shm_write_end(shm);
     pthread_cond_broadcast(&(shm->data->cond));
     pthread_mutex_unlock(&(shm->data->mutex));
 }
@@ -249,73 +291,142 @@ void print_shared_memory(shared_memory_t *shm)
 
 
 
-    /**
-     * For a condition operation edit_shared_memory(shm, OP_SET_OPEN, 0, 0);
-     * For a floor operation edit_shared_memory(shm, OP_SET_FLOOR, 5, 0);
-     * For a status operation edit_shared_memory(shm, OP_SET_STATUS, 0, STATUS_OPEN);
-     * 
-     * @param shm The shared memory object.
-     * @param operation The operation to perform.
-     * @param floor The floor number.
-     * @param status The status to set.
-     * @return true if the operation was successful, false otherwise.
-     */
-bool edit_shared_memory(shared_memory_t *shm, car_op_t operation, int floor,Status status)
+void shm_write_begin(shared_memory_t *shm)
+{
+    uint32_t seq = atomic_load_explicit(&shm->data->seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->data->seq, seq + 1, memory_order_relaxed);
+    // Keep the field writes that follow after the odd sequence number
+    atomic_thread_fence(memory_order_release);
+}
+
+void shm_write_end(shared_memory_t *shm)
+{
+    uint32_t seq = atomic_load_explicit(&shm->data->seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->data->seq, seq + 1, memory_order_release);
+}
+
+uint64_t shm_timestamp(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void shm_mark_dirty(shared_memory_t *shm, uint32_t fields)
+{
+    if (fields == 0)
+    {
+        return;
+    }
+    // The mutex orders this with the monitor, which clears the bits under it
+    uint32_t previous = atomic_fetch_or_explicit(&shm->data->dirty, fields, memory_order_relaxed);
+    if ((previous & SHM_DIRTY_ALL) == 0)
+    {
+        shm->data->dirty_at = shm_timestamp();
+    }
+    if (previous == SHM_DIRTY_WATCHED)
+    {
+        syscall(SYS_futex, &shm->data->dirty, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+void copy_car_snapshot(const car_shared_data_t *data, car_snapshot_t *snapshot)
 {
+    memcpy(snapshot->current_floor, data->current_floor, sizeof(snapshot->current_floor));
+    memcpy(snapshot->destination_floor, data->destination_floor, sizeof(snapshot->destination_floor));
+    memcpy(snapshot->status, data->status, sizeof(snapshot->status));
+    snapshot->open_button = data->open_button;
+    snapshot->close_button = data->close_button;
+    snapshot->door_obstruction = data->door_obstruction;
+    snapshot->overload = data->overload;
+    snapshot->emergency_stop = data->emergency_stop;
+    snapshot->individual_service_mode = data->individual_service_mode;
+    snapshot->emergency_mode = data->emergency_mode;
+}
+
+void read_car_snapshot(shared_memory_t *shm, car_snapshot_t *snapshot)
+{
+    for (int attempt = 0; attempt < SNAPSHOT_RETRIES; attempt++)
+    {
+        uint32_t before = atomic_load_explicit(&shm->data->seq, memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+        copy_car_snapshot(shm->data, snapshot);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shm->data->seq, memory_order_relaxed) == before)
+        {
+            return;
+        }
+    }
+
+    // A writer kept the data busy, wait for it instead
     pthread_mutex_lock(&(shm->data->mutex));
-    bool retVal = true;
-    
-    
+    copy_car_snapshot(shm->data, snapshot);
+    pthread_mutex_unlock(&(shm->data->mutex));
+}
+
+/**
+ * Apply one edit to the shared data. The caller holds the mutex and has
+ * started a write with shm_write_begin.
+ *
+ * @return false if the operation is not an edit.
+ */
+static bool apply_edit(car_shared_data_t *data, car_op_t operation, int floor, Status status)
+{
     switch (operation){
         // Condition operations
         case OP_NOP:
             break;
         case OP_SET_OPEN:
-            shm->data->open_button = 1;
+            data->open_button = 1;
             break;
         case OP_CLEAR_OPEN:
-            shm->data->open_button = 0;
+            data->open_button = 0;
             break;
         case OP_SET_CLOSE:
-            shm->data->close_button = 1;
+            data->close_button = 1;
             break;
         case OP_CLEAR_CLOSE:
-            shm->data->close_button = 0;
+            data->close_button = 0;
             break;
         case OP_SET_OVERLOAD:
-            shm->data->overload = 1;
+            data->overload = 1;
+            data->fault_at = shm_timestamp();
             break;
         case OP_CLEAR_OVERLOAD:
-            shm->data->overload = 0;
+            data->overload = 0;
             break;
         case OP_SET_DOOR_OBSTRUCTION:
-            shm->data->door_obstruction = 1;
+            data->door_obstruction = 1;
             break;
         case OP_CLEAR_DOOR_OBSTRUCTION:
-            shm->data->door_obstruction = 0;
+            data->door_obstruction = 0;
             break;
         case OP_SET_EMERGENCY:
-            shm->data->emergency_mode = 1;
+            data->emergency_mode = 1;
             break;
         case OP_CLEAR_EMERGENCY:
-            shm->data->emergency_mode = 0;
+            data->emergency_mode = 0;
             break;
         case OP_SET_SERVICE:
-            shm->data->individual_service_mode = 1;
+            data->individual_service_mode = 1;
             break;
         case OP_CLEAR_SERVICE:
-            shm->data->individual_service_mode = 0;
+            data->individual_service_mode = 0;
             break;
         case OP_SET_EMERGENCY_STOP:
-            shm->data->emergency_stop = 1;
+            data->emergency_stop = 1;
+            data->fault_at = shm_timestamp();
             break;
         case OP_CLEAR_EMERGENCY_STOP:
-            shm->data->emergency_stop = 0;
+            data->emergency_stop = 0;
             break;
 
         // Floor operations
         case OP_MOVE_CURRENT:
-            int current_floor = stringToFloor(shm->data->current_floor);
+            int current_floor = stringToFloor(data->current_floor);
             //printf("Current Floor: %d\n", current_floor);
             //printf("Move: %d\n", floor);
             if (((current_floor+floor)>=0) && (current_floor<0) || ((current_floor+floor)<=0) && (current_floor>0))
@@ -331,10 +442,10 @@ bool edit_shared_memory(shared_memory_t *shm, car_op_t operation, int floor,Stat
                 current_floor+=floor;
             }
             //printf("New Floor: %d\n", current_floor);
-            floorToString(shm->data->current_floor, current_floor);
+            floorToString(data->current_floor, current_floor);
             break;
         case OP_MOVE_DESTINATION:
-            int destination_floor = stringToFloor(shm->data->destination_floor);
+            int destination_floor = stringToFloor(data->destination_floor);
             //printf("destination Floor: %d\n", destination_floor);
             //printf("Move: %d\n", floor);
             if (((destination_floor+floor)>=0) && (destination_floor<0) || ((destination_floor+floor)<=0) && (destination_floor>0))
@@ -350,29 +461,103 @@ bool edit_shared_memory(shared_memory_t *shm, car_op_t operation, int floor,Stat
                 destination_floor+=floor;
             }
             //printf("New Floor: %d\n", destination_floor);
-            floorToString(shm->data->destination_floor, destination_floor);
+            floorToString(data->destination_floor, destination_floor);
             break;
         case OP_SET_FLOOR:
-            floorToString(shm->data->current_floor, floor);
+            floorToString(data->current_floor, floor);
             break;
         case OP_SET_DESTINATION:
-            floorToString(shm->data->destination_floor, floor);
+            floorToString(data->destination_floor, floor);
             break;
 
         // Status operations
         case OP_SET_STATUS:
-            strcpy(shm->data->status, status_names[status]);
+            strcpy(data->status, status_names[status]);
             break;
 
         default:
+            return false;
+    }
+    return true;
+}
+
+/**
+ * The field each edit changes, for shm_mark_dirty.
+ */
+static const uint32_t edit_fields[OP_CLEAR_EMERGENCY_STOP + 1] = {
+    [OP_NOP] = 0,
+    [OP_SET_FLOOR] = SHM_DIRTY_CURRENT_FLOOR,
+    [OP_MOVE_CURRENT] = SHM_DIRTY_CURRENT_FLOOR,
+    [OP_MOVE_DESTINATION] = SHM_DIRTY_DESTINATION_FLOOR,
+    [OP_SET_DESTINATION] = SHM_DIRTY_DESTINATION_FLOOR,
+    [OP_SET_STATUS] = SHM_DIRTY_STATUS,
+    [OP_SET_OPEN] = SHM_DIRTY_OPEN_BUTTON,
+    [OP_CLEAR_OPEN] = SHM_DIRTY_OPEN_BUTTON,
+    [OP_SET_CLOSE] = SHM_DIRTY_CLOSE_BUTTON,
+    [OP_CLEAR_CLOSE] = SHM_DIRTY_CLOSE_BUTTON,
+    [OP_SET_DOOR_OBSTRUCTION] = SHM_DIRTY_DOOR_OBSTRUCTION,
+    [OP_CLEAR_DOOR_OBSTRUCTION] = SHM_DIRTY_DOOR_OBSTRUCTION,
+    [OP_SET_OVERLOAD] = SHM_DIRTY_OVERLOAD,
+    [OP_CLEAR_OVERLOAD] = SHM_DIRTY_OVERLOAD,
+    [OP_SET_EMERGENCY] = SHM_DIRTY_EMERGENCY_MODE,
+    [OP_CLEAR_EMERGENCY] = SHM_DIRTY_EMERGENCY_MODE,
+    [OP_SET_SERVICE] = SHM_DIRTY_INDIVIDUAL_SERVICE,
+    [OP_CLEAR_SERVICE] = SHM_DIRTY_INDIVIDUAL_SERVICE,
+    [OP_SET_EMERGENCY_STOP] = SHM_DIRTY_EMERGENCY_STOP,
+    [OP_CLEAR_EMERGENCY_STOP] = SHM_DIRTY_EMERGENCY_STOP,
+};
+
+/**
+ * Check an operation can be applied by apply_edit.
+ */
+static bool is_edit_operation(car_op_t operation)
+{
+    return operation >= OP_NOP && operation <= OP_CLEAR_EMERGENCY_STOP;
+}
+
+    /**
+     * For a condition operation edit_shared_memory(shm, OP_SET_OPEN, 0, 0);
+     * For a floor operation edit_shared_memory(shm, OP_SET_FLOOR, 5, 0);
+     * For a status operation edit_shared_memory(shm, OP_SET_STATUS, 0, STATUS_OPEN);
+     * 
+     * @param shm The shared memory object.
+     * @param operation The operation to perform.
+     * @param floor The floor number.
+     * @param status The status to set.
+     * @return true if the operation was successful, false otherwise.
+     */
+bool edit_shared_memory(shared_memory_t *shm, car_op_t operation, int floor,Status status)
+{
+    shm_edit_t edit = {operation, floor, status};
+    return edit_shared_memory_batch(shm, &edit, 1);
+}
+
+bool edit_shared_memory_batch(shared_memory_t *shm, const shm_edit_t *edits, size_t count)
+{
+    // Reject the whole batch up front so it is applied completely or not at all
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!is_edit_operation(edits[i].operation))
+        {
             printf("Invalid operation.\n");
-            retVal = false;
-            break;
+            return false;
+        }
     }
+
+    uint32_t fields = 0;
+    pthread_mutex_lock(&(shm->data->mutex));
+    shm_write_begin(shm);
+    for (size_t i = 0; i < count; i++)
+    {
+        apply_edit(shm->data, edits[i].operation, edits[i].floor, edits[i].status);
+        fields |= edit_fields[edits[i].operation];
+    }
+    shm_mark_dirty(shm, fields);
     shm->shm_changed = 1;
+    shm_write_end(shm);
     pthread_cond_broadcast(&(shm->data->cond));
     pthread_mutex_unlock(&(shm->data->mutex));
-    return retVal;
+    return true;
 }
 
 /**
@@ -384,44 +569,32 @@ bool edit_shared_memory(shared_memory_t *shm, car_op_t operation, int floor,Stat
      */
 bool read_shared_memory(shared_memory_t *shm, car_op_t operation)
 {   
-    pthread_mutex_lock(&(shm->data->mutex));
+    car_snapshot_t snapshot;
+    read_car_snapshot(shm, &snapshot);
     bool retVal = false;
     switch (operation)
     {
         // Condition operations
         case OP_GET_OPEN:
-            if(shm->data->open_button == 1){
-                retVal = true;
-            }
+            retVal = snapshot.open_button == 1;
             break;
         case OP_GET_CLOSE:
-            if(shm->data->close_button == 1){
-                retVal = true;
-            }
+            retVal = snapshot.close_button == 1;
             break;
         case OP_GET_OVERLOAD:
-            if(shm->data->overload == 1){
-                retVal = true;
-            }
+            retVal = snapshot.overload == 1;
             break;
         case OP_GET_EMERGENCY:
-            if(shm->data->emergency_stop == 1){
-                retVal = true;
-            }
+            retVal = snapshot.emergency_stop == 1;
+            break;
         case OP_GET_DOOR_OBSTRUCTION:
-            if(shm->data->door_obstruction== 1){
-                retVal = true;
-            }
+            retVal = snapshot.door_obstruction == 1;
             break;
         case OP_GET_SERVICE:
-            if(shm->data->individual_service_mode == 1){
-                retVal = true;
-            }
+            retVal = snapshot.individual_service_mode == 1;
             break;
         case OP_GET_EMERGENCY_STOP:
-            if(shm->data->emergency_mode == 1){
-                retVal = true;
-            }
+            retVal = snapshot.emergency_mode == 1;
             break;
 
         default:
@@ -429,31 +602,26 @@ bool read_shared_memory(shared_memory_t *shm, car_op_t operation)
             retVal = false;
             break;
     }
-    
-    pthread_mutex_unlock(&(shm->data->mutex));
 
     return retVal;
 }
 Status read_car_status(shared_memory_t *shm)
 {
-    pthread_mutex_lock(&(shm->data->mutex));
-    // Copy the status from shared memory to the provided buffer
-    Status carstatus = stringToStatus(shm->data->status);
-    pthread_mutex_unlock(&(shm->data->mutex));
-
-    return carstatus;
+    car_snapshot_t snapshot;
+    read_car_snapshot(shm, &snapshot);
+    return stringToStatus(snapshot.status);
 }
 
 void read_current_floor(shared_memory_t *shm, char current_floor[4])
 {
-    pthread_mutex_lock(&(shm->data->mutex));
-    strcpy(current_floor, shm->data->current_floor);
-    pthread_mutex_unlock(&(shm->data->mutex));
+    car_snapshot_t snapshot;
+    read_car_snapshot(shm, &snapshot);
+    strcpy(current_floor, snapshot.current_floor);
 }
 
 void read_destination_floor(shared_memory_t *shm, char destination_floor[4])
 {
-    pthread_mutex_lock(&(shm->data->mutex));
-    strcpy(destination_floor, shm->data->destination_floor);
-    pthread_mutex_unlock(&(shm->data->mutex));
-}
\ No newline at end of file
+    car_snapshot_t snapshot;
+    read_car_snapshot(shm, &snapshot);
+    strcpy(destination_floor, snapshot.destination_floor);
+}
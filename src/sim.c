@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+#include "simulation.h"
+#include "workload.h"
+#include "histogram.h"
+
+/**
+ * Runs the scheduling scenario from Test/test-sched.c on a virtual clock and
+ * prints the same report, so the two can be compared directly.
+ *
+ * Usage: sim [--car-delay ms] [--cars n] [--num-passengers n]
+ *            [--lowest-floor floor] [--highest-floor floor]
+ *            [--sim-start ms] [--sim-end ms] [--histogram-len n] [--seed n]
+ *            [--profile name] [--rate calls/min] [--weights floor:weight,...]
+ *            [--trace file]
+ *
+ * Passengers call between --sim-start and --sim-end following the traffic
+ * profile (see workload.h). With --rate they arrive as a Poisson process
+ * instead of --num-passengers at uniformly random times. --trace replays a
+ * recorded workload instead.
+ */
+
+#define CAR_DELAY       100
+#define CARS            1
+#define NUM_PASSENGERS  10
+#define LOWEST_FLOOR    "1"
+#define HIGHEST_FLOOR   "4"
+#define SIM_START       40    // milliseconds
+#define SIM_END         1000  // milliseconds
+#define HISTOGRAM_LEN   5
+
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+static int car_delay = CAR_DELAY;
+static int cars = CARS;
+static int num_passengers = NUM_PASSENGERS;
+static const char *lowest_floor = LOWEST_FLOOR;
+static const char *highest_floor = HIGHEST_FLOOR;
+static int sim_start = SIM_START;
+static int sim_end = SIM_END;
+static int histogram_len = HISTOGRAM_LEN;
+static unsigned int seed = 0;
+static int seeded = 0;
+static const char *profile = "uniform";
+static double rate = 0;
+static const char *weights = NULL;
+static const char *trace = NULL;
+
+static void init_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(argv[i], "--car-delay") == 0) car_delay = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--cars") == 0) cars = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--num-passengers") == 0) num_passengers = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--lowest-floor") == 0) lowest_floor = argv[i + 1];
+        else if (strcmp(argv[i], "--highest-floor") == 0) highest_floor = argv[i + 1];
+        else if (strcmp(argv[i], "--sim-start") == 0) sim_start = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--sim-end") == 0) sim_end = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--histogram-len") == 0) histogram_len = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--profile") == 0) profile = argv[i + 1];
+        else if (strcmp(argv[i], "--rate") == 0) rate = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--weights") == 0) weights = argv[i + 1];
+        else if (strcmp(argv[i], "--trace") == 0) trace = argv[i + 1];
+        else if (strcmp(argv[i], "--seed") == 0) {
+            seed = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+            seeded = 1;
+        } else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void report(const char *title, const int64_t *values, int count) {
+    int64_t total = 0, max = 0;
+    for (int i = 0; i < count; i++) {
+        total += values[i];
+        max = MAX(max, values[i]);
+    }
+
+    printf("%s:\n", title);
+    if (count == 0) {
+        printf("No passengers\n");
+        return;
+    }
+    printf("Avg time: %.2fms\n", (double)total / count / 1000.0);
+    printf("Longest time: %.2fms\n", (double)max / 1000.0);
+
+    histogram_print(values, count, histogram_len);
+}
+
+int main(int argc, char **argv) {
+    init_args(argc, argv);
+
+    sim_config_t config;
+    config.cars = cars;
+    config.lowest_floor = stringToFloor((char *)lowest_floor);
+    config.highest_floor = stringToFloor((char *)highest_floor);
+    config.delay_ms = car_delay;
+    config.time_limit_us = 0;
+    if (cars <= 0 || num_passengers <= 0 || car_delay <= 0 || histogram_len <= 0 ||
+        sim_end < sim_start || config.lowest_floor == INT_MIN || config.highest_floor == INT_MIN ||
+        config.lowest_floor >= config.highest_floor) {
+        fprintf(stderr, "Invalid simulation parameters\n");
+        exit(EXIT_FAILURE);
+    }
+
+    workload_call_t *calls;
+    size_t count;
+    if (trace != NULL) {
+        FILE *file = fopen(trace, "r");
+        if (file == NULL) {
+            perror("fopen");
+            exit(EXIT_FAILURE);
+        }
+        bool ok = workload_read_trace(file, &calls, &count);
+        fclose(file);
+        if (!ok) {
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        workload_t workload;
+        workload_profile_t traffic;
+        if (!workload_profile_from_name(profile, &traffic)) {
+            fprintf(stderr, "Unknown profile: %s\n", profile);
+            exit(EXIT_FAILURE);
+        }
+        if (!workload_init(&workload, traffic, config.lowest_floor, config.highest_floor,
+                           (int64_t)sim_start * 1000, (int64_t)sim_end * 1000, (size_t)num_passengers)) {
+            fprintf(stderr, "Invalid simulation parameters\n");
+            exit(EXIT_FAILURE);
+        }
+        if (weights != NULL && !workload_parse_weights(&workload, weights)) {
+            fprintf(stderr, "Invalid floor weights: %s\n", weights);
+            exit(EXIT_FAILURE);
+        }
+        if (rate > 0) {
+            workload_set_poisson(&workload, rate);
+        }
+        unsigned int state = seeded ? seed : (unsigned int)time(NULL);
+        bool ok = workload_generate(&workload, &state, &calls, &count);
+        workload_destroy(&workload);
+        if (!ok) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    sim_passenger_t *passengers = calloc(count > 0 ? count : 1, sizeof(sim_passenger_t));
+    int64_t *wait = malloc(sizeof(int64_t) * (count > 0 ? count : 1));
+    int64_t *ride = malloc(sizeof(int64_t) * (count > 0 ? count : 1));
+    if (passengers == NULL || wait == NULL || ride == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < count; i++) {
+        passengers[i].arrival_us = calls[i].time_us;
+        passengers[i].from = calls[i].from;
+        passengers[i].to = calls[i].to;
+    }
+    free(calls);
+
+    struct timespec start, end;
+    sim_summary_t summary;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!simulation_run(&config, passengers, count, &summary)) {
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int served = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (passengers[i].state == PASSENGER_ARRIVED) {
+            wait[served] = passengers[i].wait_us;
+            ride[served] = passengers[i].ride_us;
+            served++;
+        }
+    }
+
+    report("Time spent waiting for an elevator", wait, served);
+    printf("\n");
+    report("Time spent inside an elevator", ride, served);
+    printf("\n");
+    printf("%zu arrived, %zu unavailable, %zu unfinished\n", summary.arrived, summary.unavailable, summary.unfinished);
+    printf("Simulated %.2fs in %.3fs (%llu events)\n", (double)summary.end_us / 1e6,
+           (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9,
+           (unsigned long long)summary.events);
+
+    free(passengers);
+    free(wait);
+    free(ride);
+    return 0;
+}
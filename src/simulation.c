@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+#include "controllermemory.h"
+#include "carcontrol.h"
+#include "simulation.h"
+
+#define NSEC_PER_USEC 1000
+#define NSEC_PER_MSEC 1000000
+#define NSEC_PER_SEC 1000000000L
+
+typedef enum {
+    EVENT_CALL,      // A passenger calls a car
+    EVENT_CAR_TIMER  // A car's door or floor step is due
+} sim_event_type_t;
+
+typedef struct {
+    int64_t time_ns;
+    uint64_t order;          // Breaks ties so events at the same time run in the order they were scheduled
+    sim_event_type_t type;
+    size_t index;            // Passenger or car
+    uint64_t generation;     // For car timers, stale if the car has rescheduled since
+} sim_event_t;
+
+/**
+ * A simulated car: its shared data lives in ordinary memory and only the
+ * state machine touches it.
+ */
+typedef struct {
+    car_shared_data_t data;
+    shared_memory_t shm;
+    car_control_t control;
+
+    // What the controller was last told, as the car's report_to_server does
+    char last_status[8];
+    char last_current_floor[4];
+    char last_destination_floor[4];
+
+    uint64_t timer_generation;
+    bool timer_scheduled;
+    int64_t timer_ns;
+
+    // Passengers assigned to this car who are waiting or riding
+    size_t *active;
+    size_t active_count;
+    size_t active_capacity;
+} sim_car_t;
+
+typedef struct {
+    const sim_config_t *config;
+    controller_t controller;
+    sim_car_t *cars;
+    sim_passenger_t *passengers;
+
+    sim_event_t *heap;
+    size_t heap_size;
+    size_t heap_capacity;
+    uint64_t next_order;
+
+    int64_t now_ns;
+    sim_summary_t *summary;
+} sim_t;
+
+static bool event_before(const sim_event_t *a, const sim_event_t *b) {
+    return a->time_ns < b->time_ns || (a->time_ns == b->time_ns && a->order < b->order);
+}
+
+static bool heap_push(sim_t *sim, int64_t time_ns, sim_event_type_t type, size_t index, uint64_t generation) {
+    if (sim->heap_size == sim->heap_capacity) {
+        size_t capacity = sim->heap_capacity ? sim->heap_capacity * 2 : 64;
+        sim_event_t *heap = realloc(sim->heap, capacity * sizeof(sim_event_t));
+        if (heap == NULL) {
+            perror("realloc");
+            return false;
+        }
+        sim->heap = heap;
+        sim->heap_capacity = capacity;
+    }
+
+    sim_event_t event = {time_ns, sim->next_order++, type, index, generation};
+    size_t pos = sim->heap_size++;
+    while (pos > 0 && event_before(&event, &sim->heap[(pos - 1) / 2])) {
+        sim->heap[pos] = sim->heap[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    sim->heap[pos] = event;
+    return true;
+}
+
+static sim_event_t heap_pop(sim_t *sim) {
+    sim_event_t top = sim->heap[0];
+    sim_event_t last = sim->heap[--sim->heap_size];
+    size_t pos = 0;
+    for (;;) {
+        size_t child = pos * 2 + 1;
+        if (child >= sim->heap_size) {
+            break;
+        }
+        if (child + 1 < sim->heap_size && event_before(&sim->heap[child + 1], &sim->heap[child])) {
+            child++;
+        }
+        if (!event_before(&sim->heap[child], &last)) {
+            break;
+        }
+        sim->heap[pos] = sim->heap[child];
+        pos = child;
+    }
+    sim->heap[pos] = last;
+    return top;
+}
+
+static struct timespec to_timespec(int64_t ns) {
+    struct timespec ts = {ns / NSEC_PER_SEC, ns % NSEC_PER_SEC};
+    return ts;
+}
+
+static int64_t from_timespec(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static bool car_track(sim_car_t *car, size_t passenger) {
+    if (car->active_count == car->active_capacity) {
+        size_t capacity = car->active_capacity ? car->active_capacity * 2 : 16;
+        size_t *active = realloc(car->active, capacity * sizeof(size_t));
+        if (active == NULL) {
+            perror("realloc");
+            return false;
+        }
+        car->active = active;
+        car->active_capacity = capacity;
+    }
+    car->active[car->active_count++] = passenger;
+    return true;
+}
+
+/**
+ * Board or drop off a passenger if the car is open on their floor. Like
+ * Test/test-sched.c, a waiting passenger only gets in if the car is heading
+ * their way (or has nowhere else to go).
+ *
+ * @return true if the passenger has finished and can be forgotten.
+ */
+static bool passenger_update(sim_t *sim, sim_car_t *car, sim_passenger_t *passenger) {
+    car_shared_data_t *data = &car->data;
+    if (strcmp(data->status, status_names[Open]) != 0) {
+        return false;
+    }
+    int current = stringToFloor(data->current_floor);
+    int64_t now_us = sim->now_ns / NSEC_PER_USEC;
+
+    if (passenger->state == PASSENGER_WAITING && current == passenger->from) {
+        int destination = stringToFloor(data->destination_floor);
+        bool heading_up = destination >= current;
+        bool heading_down = destination <= current;
+        if ((passenger->to > passenger->from) ? heading_up : heading_down) {
+            passenger->state = PASSENGER_RIDING;
+            passenger->boarded_us = now_us;
+            passenger->wait_us = now_us - passenger->arrival_us;
+        }
+    } else if (passenger->state == PASSENGER_RIDING && current == passenger->to) {
+        passenger->state = PASSENGER_ARRIVED;
+        passenger->ride_us = now_us - passenger->boarded_us;
+        sim->summary->arrived++;
+        return true;
+    }
+    return false;
+}
+
+static void car_update_passengers(sim_t *sim, sim_car_t *car) {
+    size_t kept = 0;
+    for (size_t i = 0; i < car->active_count; i++) {
+        if (!passenger_update(sim, car, &sim->passengers[car->active[i]])) {
+            car->active[kept++] = car->active[i];
+        }
+    }
+    car->active_count = kept;
+}
+
+/**
+ * Send a FLOOR message to a simulated car.
+ */
+static void car_send_floor(sim_car_t *car, int floor) {
+    char label[4];
+    floorToString(label, floor);
+    car_control_request_floor(&car->control, label);
+}
+
+/**
+ * Report a changed status to the controller, as the car's TCP side does.
+ *
+ * @return true if the controller sent the car a new floor.
+ */
+static bool car_report(sim_t *sim, size_t index) {
+    sim_car_t *car = &sim->cars[index];
+    car_shared_data_t *data = &car->data;
+    if (strcmp(car->last_status, data->status) == 0 &&
+        strcmp(car->last_current_floor, data->current_floor) == 0 &&
+        strcmp(car->last_destination_floor, data->destination_floor) == 0) {
+        return false;
+    }
+    strcpy(car->last_status, data->status);
+    strcpy(car->last_current_floor, data->current_floor);
+    strcpy(car->last_destination_floor, data->destination_floor);
+
+    car_update_passengers(sim, car);
+
+    int next_floor;
+    connectedcar_t *controller_car = controller_find_by_socket(&sim->controller, (int)index);
+    if (controller_car != NULL &&
+        car_update_status(controller_car, data->status, stringToFloor(data->current_floor),
+                          stringToFloor(data->destination_floor), sim->now_ns / NSEC_PER_MSEC, &next_floor)) {
+        car_send_floor(car, next_floor);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Run a car's state machine at the current virtual time, pass its reports to
+ * the controller until nothing changes, then schedule its next timed step.
+ */
+static bool car_run(sim_t *sim, size_t index) {
+    sim_car_t *car = &sim->cars[index];
+    struct timespec now = to_timespec(sim->now_ns);
+
+    do {
+        car_control_step(&car->control, &now);
+    } while (car_report(sim, index));
+
+    struct timespec deadline;
+    if (!car_control_deadline(&car->control, &deadline)) {
+        car->timer_scheduled = false;
+        return true;
+    }
+    int64_t deadline_ns = from_timespec(&deadline);
+    if (car->timer_scheduled && car->timer_ns == deadline_ns) {
+        return true;
+    }
+    car->timer_generation++;
+    car->timer_scheduled = true;
+    car->timer_ns = deadline_ns;
+    return heap_push(sim, deadline_ns, EVENT_CAR_TIMER, index, car->timer_generation);
+}
+
+static bool handle_call(sim_t *sim, size_t index) {
+    sim_passenger_t *passenger = &sim->passengers[index];
+    connectedcar_t *controller_car = controller_assign_call(&sim->controller, passenger->from, passenger->to);
+    if (controller_car == NULL) {
+        passenger->state = PASSENGER_UNAVAILABLE;
+        sim->summary->unavailable++;
+        return true;
+    }
+
+    size_t car_index = (size_t)controller_car->connectionsocket;
+    sim_car_t *car = &sim->cars[car_index];
+    passenger->state = PASSENGER_WAITING;
+    passenger->car = (int)car_index;
+    if (!car_track(car, index)) {
+        return false;
+    }
+
+    // The car may already be open on the passenger's floor
+    car_update_passengers(sim, car);
+
+    int next_floor;
+    if (car_dispatch_call(controller_car, &next_floor)) {
+        car_send_floor(car, next_floor);
+    }
+    return car_run(sim, car_index);
+}
+
+static bool sim_init(sim_t *sim, const sim_config_t *config, sim_passenger_t *passengers, sim_summary_t *summary) {
+    memset(sim, 0, sizeof(*sim));
+    sim->config = config;
+    sim->passengers = passengers;
+    sim->summary = summary;
+    controller_init(&sim->controller);
+
+    sim->cars = calloc((size_t)config->cars, sizeof(sim_car_t));
+    if (sim->cars == NULL) {
+        perror("calloc");
+        return false;
+    }
+
+    char lowest[4];
+    floorToString(lowest, config->lowest_floor);
+    for (int i = 0; i < config->cars; i++) {
+        sim_car_t *car = &sim->cars[i];
+        car->shm.name = NULL;
+        car->shm.fd = -1;
+        car->shm.data = &car->data;
+        init_shared_data(&car->shm, lowest);
+        car_control_init(&car->control, &car->shm, config->lowest_floor, config->highest_floor, config->delay_ms);
+
+        // Register the car and send its first status, as car does on connecting
+        char name[50];
+        snprintf(name, sizeof(name), "Sim%d", i + 1);
+        connectedcar_t controller_car;
+        connectedcar_init(&controller_car, name, config->lowest_floor, config->highest_floor, i);
+        controller_push(&sim->controller, &controller_car);
+        car_report(sim, (size_t)i);
+    }
+    return true;
+}
+
+static void sim_destroy(sim_t *sim) {
+    if (sim->cars != NULL) {
+        for (int i = 0; i < sim->config->cars; i++) {
+            pthread_mutex_destroy(&sim->cars[i].data.mutex);
+            pthread_cond_destroy(&sim->cars[i].data.cond);
+            free(sim->cars[i].active);
+        }
+        free(sim->cars);
+    }
+    free(sim->heap);
+    controller_destroy(&sim->controller);
+}
+
+bool simulation_run(const sim_config_t *config, sim_passenger_t *passengers, size_t count, sim_summary_t *summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (config->cars <= 0 || config->delay_ms <= 0 || config->lowest_floor > config->highest_floor) {
+        fprintf(stderr, "Invalid simulation configuration\n");
+        return false;
+    }
+
+    sim_t sim;
+    bool ok = sim_init(&sim, config, passengers, summary);
+    for (size_t i = 0; ok && i < count; i++) {
+        passengers[i].state = PASSENGER_PENDING;
+        passengers[i].car = -1;
+        passengers[i].wait_us = 0;
+        passengers[i].ride_us = 0;
+        ok = heap_push(&sim, passengers[i].arrival_us * NSEC_PER_USEC, EVENT_CALL, i, 0);
+    }
+
+    int64_t limit_ns = config->time_limit_us * NSEC_PER_USEC;
+    while (ok && sim.heap_size > 0 && summary->arrived + summary->unavailable < count) {
+        if (limit_ns > 0 && sim.heap[0].time_ns > limit_ns) {
+            break;
+        }
+        sim_event_t event = heap_pop(&sim);
+        if (event.type == EVENT_CAR_TIMER &&
+            (event.generation != sim.cars[event.index].timer_generation || !sim.cars[event.index].timer_scheduled)) {
+            continue;
+        }
+        sim.now_ns = event.time_ns;
+        summary->events++;
+
+        if (event.type == EVENT_CALL) {
+            ok = handle_call(&sim, event.index);
+        } else {
+            sim.cars[event.index].timer_scheduled = false;
+            ok = car_run(&sim, event.index);
+        }
+    }
+
+    summary->end_us = sim.now_ns / NSEC_PER_USEC;
+    summary->unfinished = count - summary->arrived - summary->unavailable;
+    sim_destroy(&sim);
+    return ok;
+}
@@ -0,0 +1,297 @@
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+
+#include "sharedmemory.h"
+#include "safetycheck.h"
+#include "cartimer.h"
+
+/**
+ * Runs the safety checks for many cars in one process. Each car's shared
+ * memory gets the same checks as the safety process, but instead of one
+ * process blocked on each car's condition variable, one thread sleeps on
+ * every car's dirty word at once with futex_waitv. A writer that marks a
+ * field changed (shm_mark_dirty) wakes it, and only the cars whose word
+ * changed are locked and checked.
+ *
+ * Usage: supervisor [--poll ms] [car name ...]
+ *
+ * With no names, every /car* segment in /dev/shm is supervised, and the
+ * directory is rescanned each second for cars that start or stop. The Test
+ * tools write shared memory without marking it, so every poll interval
+ * (default 10ms) each car is also compared lock-free with its last check.
+ * Only the first FUTEX_WAITV_MAX cars can be slept on; any more are only
+ * checked by the poll.
+ *
+ * Findings are printed with the car's name, and for each emergency, how
+ * long after the change it was detected. On exit each car's detection
+ * latency is summarised. Don't run the safety process for a car the
+ * supervisor is watching: both take the dirty bits.
+ */
+
+#define SHM_DIRECTORY "/dev/shm"
+#define MAX_CARS 1024
+#define POLL_MS 10
+#define RESCAN_MS 1000
+
+typedef struct {
+    char name[256];
+    shared_memory_t cardata;
+    bool attached;
+    bool first;                      // The next check covers every field
+    safety_state_t state;
+    timer_stats_t changes;           // Latency from marked change to check
+    timer_stats_t emergencies;       // Latency from marked change to emergency mode
+} supervised_car_t;
+
+static supervised_car_t cars[MAX_CARS];
+static int car_count = 0;
+static bool scan_directory = true;
+static volatile sig_atomic_t stop_signal = 0;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    stop_signal = 1;
+}
+
+static supervised_car_t *add_car(const char *name) {
+    if (car_count == MAX_CARS) {
+        return NULL;
+    }
+    supervised_car_t *car = &cars[car_count++];
+    snprintf(car->name, sizeof(car->name), "%s", name);
+    timer_stats_init(&car->changes);
+    timer_stats_init(&car->emergencies);
+    return car;
+}
+
+static void attach_car(supervised_car_t *car) {
+    char shm_name[sizeof(car->name) + 4];
+    snprintf(shm_name, sizeof(shm_name), "/car%s", car->name);
+    if (!get_shared_object(&car->cardata, shm_name)) {
+        return;
+    }
+    car->attached = true;
+    car->first = true;
+    atomic_fetch_or_explicit(&car->cardata.data->dirty, SHM_DIRTY_WATCHED, memory_order_relaxed);
+    printf("Supervising car %s\n", car->name);
+}
+
+static void detach_car(supervised_car_t *car) {
+    atomic_fetch_and_explicit(&car->cardata.data->dirty, ~SHM_DIRTY_WATCHED, memory_order_relaxed);
+    munmap(car->cardata.data, sizeof(car_shared_data_t));
+    close(car->cardata.fd);
+    car->attached = false;
+}
+
+// Attach cars that have started and detach those whose segment was removed
+static void scan_cars(void) {
+    for (int i = 0; i < car_count; i++) {
+        struct stat st;
+        if (cars[i].attached && fstat(cars[i].cardata.fd, &st) == 0 && st.st_nlink == 0) {
+            printf("Car %s has stopped\n", cars[i].name);
+            detach_car(&cars[i]);
+        }
+    }
+
+    if (scan_directory) {
+        DIR *dir = opendir(SHM_DIRECTORY);
+        if (dir == NULL) {
+            perror("opendir");
+            return;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            const char *name = entry->d_name + 3;
+            if (strncmp(entry->d_name, "car", 3) != 0 || name[0] == '\0') {
+                continue;
+            }
+            int i = 0;
+            while (i < car_count && strcmp(cars[i].name, name) != 0) {
+                i++;
+            }
+            if (i == car_count && add_car(name) == NULL) {
+                break;
+            }
+        }
+        closedir(dir);
+    }
+
+    for (int i = 0; i < car_count; i++) {
+        if (!cars[i].attached) {
+            attach_car(&cars[i]);
+        }
+    }
+    fflush(stdout);
+}
+
+// Check a car if it was marked changed, or on a poll if its fields differ
+// from the last check
+static void visit_car(supervised_car_t *car, bool poll) {
+    car_shared_data_t *data = car->cardata.data;
+    uint32_t dirty = atomic_load_explicit(&data->dirty, memory_order_relaxed);
+    if (!car->first && (dirty & SHM_DIRTY_ALL) == 0) {
+        car_snapshot_t now;
+        if (!poll) {
+            return;
+        }
+        read_car_snapshot(&car->cardata, &now);
+        if (safety_diff(&car->state.fields, &now) == 0) {
+            return;
+        }
+    }
+
+    // safety_check may write the car's fields, so it is bracketed like any
+    // other writer for the lock-free readers
+    pthread_mutex_lock(&data->mutex);
+    shm_write_begin(&car->cardata);
+    uint32_t changed = atomic_exchange_explicit(&data->dirty, SHM_DIRTY_WATCHED, memory_order_relaxed) &
+                       SHM_DIRTY_ALL;
+    struct timespec changed_at = {(time_t)(data->dirty_at / 1000000000u), (long)(data->dirty_at % 1000000000u)};
+    bool timed = (changed != 0 && data->dirty_at != 0 && !car->first);
+    if (car->first) {
+        changed = SHM_DIRTY_ALL;
+        car->first = false;
+    }
+    uint32_t found = safety_check(&car->state, data, changed);
+    if ((found & SAFETY_EMERGENCY) != 0) {
+        // Wake the car to report the emergency
+        pthread_cond_broadcast(&data->cond);
+    }
+    shm_write_end(&car->cardata);
+    pthread_mutex_unlock(&data->mutex);
+
+    struct timespec detected;
+    cartimer_now(&detected);
+    if (timed) {
+        timer_stats_record(&car->changes, &changed_at, &detected);
+    }
+    for (int i = 0; i < SAFETY_FINDING_COUNT; i++) {
+        if ((found & (1u << i)) != 0) {
+            printf("%s: %s\n", car->name, safety_messages[i]);
+        }
+    }
+    if ((found & SAFETY_EMERGENCY) != 0) {
+        if (timed) {
+            timer_stats_record(&car->emergencies, &changed_at, &detected);
+            printf("%s: Emergency detected %.1f us after the change\n", car->name,
+                   cartimer_diff_ns(&detected, &changed_at) / 1000.0);
+        }
+        fflush(stdout);
+    }
+}
+
+// Sleep until a watched car is marked changed or the deadline passes
+static void wait_for_change(const struct timespec *deadline) {
+    struct futex_waitv waiters[FUTEX_WAITV_MAX];
+    unsigned int count = 0;
+
+    memset(waiters, 0, sizeof(waiters));
+    for (int i = 0; i < car_count && count < FUTEX_WAITV_MAX; i++) {
+        if (!cars[i].attached) {
+            continue;
+        }
+        _Atomic uint32_t *dirty = &cars[i].cardata.data->dirty;
+        // Re-arm in case a safety process cleared the bit
+        if ((atomic_fetch_or_explicit(dirty, SHM_DIRTY_WATCHED, memory_order_relaxed) & SHM_DIRTY_ALL) != 0) {
+            return;
+        }
+        waiters[count].val = SHM_DIRTY_WATCHED;
+        waiters[count].uaddr = (uintptr_t)dirty;
+        waiters[count].flags = FUTEX_32;
+        count++;
+    }
+
+    // EAGAIN means a word changed before the wait, so it is checked now
+    if (count == 0 ||
+        (syscall(SYS_futex_waitv, waiters, count, 0, deadline, CARTIMER_CLOCK) == -1 && errno == ENOSYS)) {
+        cartimer_sleep_until(deadline);
+    }
+}
+
+static void print_latency(const char *name, const char *what, const timer_stats_t *stats) {
+    if (stats->count == 0) {
+        printf("%s: no %s\n", name, what);
+        return;
+    }
+    printf("%s: %llu %s, latency min %.1f us, mean %.1f us, max %.1f us\n",
+           name, (unsigned long long)stats->count, what,
+           stats->min_ns / 1000.0,
+           (double)stats->total_ns / stats->count / 1000.0,
+           stats->max_ns / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    int poll_ms = POLL_MS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--poll") == 0 && i + 1 < argc) {
+            poll_ms = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Usage: %s [--poll ms] [car name ...]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        } else {
+            scan_directory = false;
+            if (add_car(argv[i]) == NULL) {
+                fprintf(stderr, "Error: At most %d cars can be supervised.\n", MAX_CARS);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (poll_ms <= 0) {
+        fprintf(stderr, "Error: Poll time must be a positive integer.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // No SA_RESTART, so a signal ends the wait
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    struct timespec next_poll, next_scan;
+    cartimer_now(&next_poll);
+    next_scan = next_poll;
+    while (!stop_signal) {
+        struct timespec now;
+        cartimer_now(&now);
+        if (cartimer_reached(&now, &next_scan)) {
+            scan_cars();
+            next_scan = now;
+            cartimer_add_ms(&next_scan, RESCAN_MS);
+        }
+        bool poll = cartimer_reached(&now, &next_poll);
+        if (poll) {
+            next_poll = now;
+            cartimer_add_ms(&next_poll, poll_ms);
+        }
+
+        for (int i = 0; i < car_count; i++) {
+            if (cars[i].attached) {
+                visit_car(&cars[i], poll);
+            }
+        }
+
+        wait_for_change(cartimer_diff_ns(&next_scan, &next_poll) < 0 ? &next_scan : &next_poll);
+    }
+
+    printf("\nCaught signal, detaching from %d cars and exiting...\n", car_count);
+    for (int i = 0; i < car_count; i++) {
+        if (cars[i].attached) {
+            detach_car(&cars[i]);
+        }
+        print_latency(cars[i].name, "changes checked", &cars[i].changes);
+        print_latency(cars[i].name, "emergencies", &cars[i].emergencies);
+    }
+    return 0;
+}
@@ -1,5 +1,25 @@
 #include <assert.h>
 #include "controllermemory.h"
+#include "cartimer.h"
+#include "simulation.h"
+#include "workload.h"
+#include "protocol.h"
+#include "safetycheck.h"
+
+connectedcar_t make_car(const char* name, int connection_socket) {
+    connectedcar_t car;
+    memset(&car, 0, sizeof(car));
+    strcpy(car.name, name);
+    car.highest_floor = 10;
+    car.lowest_floor = 1;
+    strcpy(car.status, "Closed");
+    car.currentfloor = 1;
+    car.destinationfloor = 1;
+    car.connectionsocket = connection_socket;
+    car.available = 1;
+    queue_init(&car);
+    return car;
+}
 
 void test_controller_init() {
     controller_t controller;
@@ -23,7 +43,7 @@ void test_controller_push_and_pop() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
+    connectedcar_t car = make_car("Car1", 1);
     controller_push(&controller, &car);
     assert(controller.size == 1);
     assert(strcmp(controller.data[0].name, "Car1") == 0);
@@ -38,7 +58,7 @@ void test_controller_last() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
+    connectedcar_t car = make_car("Car1", 1);
     controller_push(&controller, &car);
     connectedcar_t* last_car = controller_last(&controller);
     assert(last_car != NULL);
@@ -51,8 +71,8 @@ void test_controller_insert_at() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car1 = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
-    connectedcar_t car2 = {"Car2", "10", "0", "idle", "0", "5", 2, 1};
+    connectedcar_t car1 = make_car("Car1", 1);
+    connectedcar_t car2 = make_car("Car2", 2);
     controller_push(&controller, &car1);
     controller_insert_at(&controller, 0, &car2);
     assert(controller.size == 2);
@@ -65,7 +85,7 @@ void test_controller_get_name_by_socket() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
+    connectedcar_t car = make_car("Car1", 1);
     controller_push(&controller, &car);
     const char* name = controller_get_name_by_socket(&controller, 1);
     assert(name != NULL);
@@ -78,7 +98,7 @@ void test_controller_remove_by_name() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
+    connectedcar_t car = make_car("Car1", 1);
     controller_push(&controller, &car);
     controller_remove_by_name(&controller, "Car1");
     assert(controller.size == 0);
@@ -90,7 +110,7 @@ void test_controller_set_and_get() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
+    connectedcar_t car = make_car("Car1", 1);
     controller_push(&controller, &car);
 
     controller_set(&controller, "Car1", 1, "15");
@@ -105,7 +125,7 @@ void test_controller_clear() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
+    connectedcar_t car = make_car("Car1", 1);
     controller_push(&controller, &car);
     controller_clear(&controller);
     assert(controller.size == 0);
@@ -118,7 +138,7 @@ void test_controller_copy() {
     controller_init(&src);
     controller_init(&dest);
 
-    connectedcar_t car = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
+    connectedcar_t car = make_car("Car1", 1);
     controller_push(&src, &car);
     controller_copy(&src, &dest);
     assert(dest.size == 1);
@@ -129,6 +149,7 @@ void test_controller_copy() {
 }
 
 void callback(connectedcar_t* car, void* info) {
+        (void)info;
         car->available = 0;
     }
 
@@ -137,8 +158,8 @@ void test_controller_foreach() {
     controller_t controller;
     controller_init(&controller);
 
-    connectedcar_t car1 = {"Car1", "10", "0", "idle", "0", "5", 1, 1};
-    connectedcar_t car2 = {"Car2", "10", "0", "idle", "0", "5", 2, 1};
+    connectedcar_t car1 = make_car("Car1", 1);
+    connectedcar_t car2 = make_car("Car2", 2);
     controller_push(&controller, &car1);
     controller_push(&controller, &car2);
 
@@ -150,6 +171,662 @@ void test_controller_foreach() {
     controller_destroy(&controller);
 }
 
+void test_controller_index_after_growth() {
+    controller_t controller;
+    controller_init(&controller);
+
+    char name[50];
+    for (int i = 0; i < INITIAL_CAPACITY * 3; i++) {
+        snprintf(name, sizeof(name), "Car%d", i);
+        connectedcar_t car = make_car(name, 100 + i);
+        controller_push(&controller, &car);
+    }
+    assert(controller.capacity > INITIAL_CAPACITY);
+
+    for (int i = 0; i < INITIAL_CAPACITY * 3; i++) {
+        snprintf(name, sizeof(name), "Car%d", i);
+        connectedcar_t* car = controller_find_by_name(&controller, name);
+        assert(car != NULL);
+        assert(car->connectionsocket == 100 + i);
+        assert(controller_find_by_socket(&controller, 100 + i) == car);
+    }
+    assert(controller_find_by_name(&controller, "Missing") == NULL);
+    assert(controller_find_by_socket(&controller, 99) == NULL);
+
+    controller_destroy(&controller);
+}
+
+void test_controller_index_after_remove() {
+    controller_t controller;
+    controller_init(&controller);
+
+    connectedcar_t car1 = make_car("Car1", 4);
+    connectedcar_t car2 = make_car("Car2", 5);
+    connectedcar_t car3 = make_car("Car3", 6);
+    controller_push(&controller, &car1);
+    controller_push(&controller, &car2);
+    controller_push(&controller, &car3);
+
+    controller_remove_by_name(&controller, "Car1");
+    assert(controller_find_by_name(&controller, "Car1") == NULL);
+    assert(controller_find_by_socket(&controller, 4) == NULL);
+    assert(strcmp(controller_get_name_by_socket(&controller, 6), "Car3") == 0);
+    assert(controller_get_socket_by_name(&controller, "Car2") == 5);
+
+    controller_remove_by_socket(&controller, 5);
+    assert(controller.size == 1);
+    assert(controller_find_by_name(&controller, "Car3") == &controller.data[0]);
+
+    controller_set(&controller, "Car3", 6, "9");
+    assert(controller_find_by_socket(&controller, 6) == NULL);
+    assert(controller_find_by_socket(&controller, 9) == &controller.data[0]);
+
+    controller_destroy(&controller);
+}
+
+void test_controller_duplicate_name() {
+    controller_t controller;
+    controller_init(&controller);
+
+    connectedcar_t car1 = make_car("Car1", 4);
+    connectedcar_t again = make_car("Car1", 5);
+    assert(controller_push(&controller, &car1));
+    assert(!controller_push(&controller, &again));
+    assert(!controller_insert_at(&controller, 0, &again));
+
+    // The first car keeps its name and socket, and the second was never added
+    assert(controller.size == 1);
+    assert(controller_get_socket_by_name(&controller, "Car1") == 4);
+    assert(controller_find_by_socket(&controller, 5) == NULL);
+    controller_remove_by_name(&controller, "Car1");
+    assert(controller.size == 0 && controller_find_by_socket(&controller, 4) == NULL);
+
+    controller_destroy(&controller);
+}
+
+void test_car_queue_order() {
+    connectedcar_t car = make_car("Car1", 1);
+
+    assert(get_next_destination(&car) == -1);
+    assert(add_to_car_queue(&car, 3, 7));
+    assert(add_to_car_queue(&car, 8, 2));
+    assert(car.queue_length == 4);
+
+    int expected[] = {3, 7, 8, 2};
+    for (int i = 0; i < 4; i++) {
+        assert(get_next_destination(&car) == expected[i]);
+        remove_from_car_queue(&car);
+    }
+    assert(car.queue_length == 0);
+    assert(get_next_destination(&car) == -1);
+}
+
+void test_car_queue_capacity() {
+    connectedcar_t car = make_car("Car1", 1);
+
+    // Wrap the ring a few times before filling it
+    for (int i = 0; i < MAX_QUEUE_SIZE * 2; i++) {
+        assert(add_to_car_queue(&car, 2, 5));
+        remove_from_car_queue(&car);
+        remove_from_car_queue(&car);
+    }
+    // Different journeys, since the same one again would ride along
+    for (int i = 0; i < MAX_QUEUE_SIZE / 2; i++) {
+        assert(add_to_car_queue(&car, 1 + i % 5, 6 + i / 5));
+    }
+    assert(!add_to_car_queue(&car, 2, 5));
+    assert(car.queue_length == MAX_QUEUE_SIZE);
+}
+
+void test_car_stop_bits() {
+    connectedcar_t car;
+    connectedcar_init(&car, "Alpha", -5, 10, 3);
+    int next;
+
+    car_update_status(&car, "Closed", 1, 1, 0, &next);
+    assert(add_to_car_queue(&car, 3, 7));
+    assert(add_to_car_queue(&car, 8, -2));
+    assert(car_has_stop(&car, 3, DIRECTION_UP) && car_has_stop(&car, 7, DIRECTION_UP));
+    assert(car_has_stop(&car, 8, DIRECTION_DOWN) && car_has_stop(&car, -2, DIRECTION_DOWN));
+    assert(!car_has_stop(&car, 3, DIRECTION_DOWN) && !car_has_stop(&car, 5, DIRECTION_UP));
+
+    // The same journey again rides with the first passenger, picked up after
+    // 2 delays and dropped off after 9, for no detour
+    assert(car_call_cost(&car, 3, 7) == (2 + 9) * DEFAULT_CAR_DELAY_MS);
+    assert(add_to_car_queue(&car, 3, 7));
+    assert(car.queue_length == 4);
+
+    // Another journey to 7 keeps the bit after the first drop-off there
+    assert(add_to_car_queue(&car, 5, 7));
+    int expected[] = {3, 5, 7, 7, 8, -2};
+    for (int i = 0; i < 6; i++) {
+        assert(get_next_destination(&car) == expected[i]);
+        remove_from_car_queue(&car);
+        assert(car_has_stop(&car, 7, DIRECTION_UP) == (i < 3));
+    }
+    for (int floor = FLOOR_LOWEST; floor <= FLOOR_HIGHEST; floor++) {
+        assert(!car_has_stop(&car, floor, DIRECTION_UP) && !car_has_stop(&car, floor, DIRECTION_DOWN));
+    }
+
+    // Floors without a label are queued without a bit, and never joined
+    connectedcar_t tall;
+    connectedcar_init(&tall, "Tall", 1, 2000, 4);
+    assert(add_to_car_queue(&tall, 1500, 1800));
+    assert(add_to_car_queue(&tall, 1500, 1800));
+    assert(tall.queue_length == 4 && !car_has_stop(&tall, 1500, DIRECTION_UP));
+    for (int i = 0; i < 4; i++) {
+        remove_from_car_queue(&tall);
+    }
+}
+
+void test_floor_codec() {
+    char label[4];
+    for (int floor = FLOOR_LOWEST; floor <= FLOOR_HIGHEST; floor++) {
+        if (floor == 0) continue;
+        floorToString(label, floor);
+        assert(stringToFloor(label) == floor);
+    }
+    floorToString(label, 0);
+    assert(strcmp(label, "1") == 0);
+    floorToString(label, -12);
+    assert(strcmp(label, "B12") == 0);
+
+    // The top floor isn't mistaken for a parse error
+    floorToString(label, FLOOR_HIGHEST);
+    assert(strcmp(label, "999") == 0);
+    assert(stringToFloor(label) == 999 && stringToFloor(label) != INT_MIN);
+
+    char invalid[][4] = {"", "B", "B0", "0", "07", "B07", "1a", "-1", " 1", "X1"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        assert(stringToFloor(invalid[i]) == INT_MIN);
+    }
+    assert(stringToFloor(NULL) == INT_MIN);
+}
+
+void test_cartimer() {
+    struct timespec a = {10, 999500000};
+    struct timespec b = a;
+    cartimer_add_ms(&b, 1);
+    assert(b.tv_sec == 11 && b.tv_nsec == 500000);
+    assert(cartimer_diff_ns(&b, &a) == 1000000);
+    assert(cartimer_reached(&b, &a));
+    assert(!cartimer_reached(&a, &b));
+
+    timer_stats_t stats;
+    timer_stats_init(&stats);
+    timer_stats_record(&stats, &a, &b);
+    timer_stats_record(&stats, &a, &a);
+    assert(stats.count == 2);
+    assert(stats.min_ns == 0 && stats.max_ns == 1000000);
+    assert(stats.total_ns == 1000000);
+
+    // An absolute sleep never returns before its deadline
+    struct timespec deadline, now;
+    cartimer_now(&deadline);
+    cartimer_add_ms(&deadline, 5);
+    cartimer_sleep_until(&deadline);
+    cartimer_now(&now);
+    assert(cartimer_reached(&now, &deadline));
+}
+
+#define SNAPSHOT_ROUNDS 20000
+
+void *snapshot_writer(void *arg) {
+    shared_memory_t *shm = arg;
+    for (int i = 0; i < SNAPSHOT_ROUNDS; i++) {
+        const char *floor = (i % 2) ? "999" : "B1";
+        pthread_mutex_lock(&shm->data->mutex);
+        shm_write_begin(shm);
+        strcpy(shm->data->current_floor, floor);
+        strcpy(shm->data->destination_floor, floor);
+        shm_write_end(shm);
+        pthread_mutex_unlock(&shm->data->mutex);
+    }
+    return NULL;
+}
+
+void test_car_snapshot() {
+    shared_memory_t shm;
+    shm.name = "/cartest_snapshot";
+    assert(create_shared_object(&shm, shm.name));
+    char lowest[4] = "B1";
+    init_shared_data(&shm, lowest);
+
+    car_snapshot_t snapshot;
+    uint32_t seq = atomic_load(&shm.data->seq);
+    assert(seq % 2 == 0);
+    edit_shared_memory(&shm, OP_SET_OPEN, 0, 0);
+    assert(atomic_load(&shm.data->seq) == seq + 2);
+    read_car_snapshot(&shm, &snapshot);
+    assert(snapshot.open_button == 1);
+    assert(strcmp(snapshot.status, "Closed") == 0);
+    assert(strcmp(snapshot.current_floor, "B1") == 0);
+
+    // Both floors are always written together, so a snapshot never sees them differ
+    pthread_t writer;
+    pthread_create(&writer, NULL, snapshot_writer, &shm);
+    for (int i = 0; i < SNAPSHOT_ROUNDS; i++) {
+        read_car_snapshot(&shm, &snapshot);
+        assert(strcmp(snapshot.current_floor, snapshot.destination_floor) == 0);
+    }
+    pthread_join(writer, NULL);
+
+    destroy_shared_object(&shm);
+}
+
+void test_edit_batch() {
+    shared_memory_t shm;
+    shm.name = "/cartest_batch";
+    assert(create_shared_object(&shm, shm.name));
+    char lowest[4] = "3";
+    init_shared_data(&shm, lowest);
+
+    // All edits land in one write
+    uint32_t seq = atomic_load(&shm.data->seq);
+    shm_edit_t edits[] = {
+        {OP_SET_SERVICE, 0, 0},
+        {OP_SET_DESTINATION, 7, 0},
+        {OP_SET_STATUS, 0, Open},
+    };
+    assert(edit_shared_memory_batch(&shm, edits, 3));
+    assert(atomic_load(&shm.data->seq) == seq + 2);
+    car_snapshot_t snapshot;
+    read_car_snapshot(&shm, &snapshot);
+    assert(snapshot.individual_service_mode == 1);
+    assert(strcmp(snapshot.destination_floor, "7") == 0);
+    assert(strcmp(snapshot.status, "Open") == 0);
+    // and marks the fields it changed for the safety monitor
+    assert(atomic_exchange(&shm.data->dirty, 0) ==
+           (SHM_DIRTY_INDIVIDUAL_SERVICE | SHM_DIRTY_DESTINATION_FLOOR | SHM_DIRTY_STATUS));
+
+    // A batch containing a read is rejected without applying anything
+    shm_edit_t invalid[] = {
+        {OP_CLEAR_SERVICE, 0, 0},
+        {OP_GET_SERVICE, 0, 0},
+    };
+    assert(!edit_shared_memory_batch(&shm, invalid, 2));
+    assert(read_shared_memory(&shm, OP_GET_SERVICE));
+
+    destroy_shared_object(&shm);
+}
+
+void test_car_status_dispatch() {
+    connectedcar_t car;
+    connectedcar_init(&car, "Alpha", 1, 4, 3);
+    int next = 0;
+    assert(!car_update_status(&car, "Closed", 1, 1, 0, &next));
+
+    // A car at rest is sent to the pickup first
+    assert(add_to_car_queue(&car, 2, 4));
+    assert(car_dispatch_call(&car, &next) && next == 2);
+    assert(car.destinationfloor == 2 && car.reported_destination == 1);
+    assert(!car_update_status(&car, "Between", 1, 2, 0, &next));
+
+    // Opening at the pickup sends it on to the drop-off
+    assert(car_update_status(&car, "Opening", 2, 2, 0, &next) && next == 4);
+    assert(!car_update_status(&car, "Open", 2, 4, 0, &next));
+    assert(car.queue_length == 1);
+}
+
+void test_call_cost_prefers_passing_car() {
+    controller_t controller;
+    controller_init(&controller);
+    connectedcar_t idle, passing;
+    int next;
+
+    // One car idle at the bottom, another already heading down past the caller
+    connectedcar_init(&idle, "Idle", 1, 20, 3);
+    car_update_status(&idle, "Closed", 1, 1, 0, &next);
+    controller_push(&controller, &idle);
+    connectedcar_init(&passing, "Passing", 1, 20, 4);
+    car_update_status(&passing, "Closed", 20, 20, 0, &next);
+    assert(add_to_car_queue(&passing, 19, 1));
+    car_update_status(&passing, "Between", 20, 19, 0, &next);
+    controller_push(&controller, &passing);
+
+    // Picked up on the way down rather than fetching the idle car
+    connectedcar_t* chosen = controller_assign_call(&controller, 17, 1);
+    assert(chosen != NULL && strcmp(chosen->name, "Passing") == 0);
+    assert(chosen->queue_length == 4);
+    int expected[] = {19, 17, 1, 1};
+    for (int i = 0; i < 4; i++) {
+        assert(get_next_destination(chosen) == expected[i]);
+        remove_from_car_queue(chosen);
+    }
+    controller_destroy(&controller);
+}
+
+void test_best_car_matches_full_costing() {
+    controller_t controller;
+    controller_init(&controller);
+    const char *statuses[] = {"Closed", "Opening", "Open", "Closing", "Between"};
+    int next;
+    srand(7);
+
+    // Cars in two overlapping banks, spread over the building with some
+    // stops queued, changed through the controller once they're in it
+    for (int i = 0; i < 40; i++) {
+        connectedcar_t car;
+        char name[16];
+        snprintf(name, sizeof(name), "Car%d", i);
+        connectedcar_init(&car, name, (i % 2 == 0) ? -3 : 1, (i % 2 == 0) ? 20 : 30, 100 + i);
+        controller_push(&controller, &car);
+    }
+    for (size_t i = 0; i < controller.size; i++) {
+        connectedcar_t *car = &controller.data[i];
+        int span = car->highest_floor - car->lowest_floor + 1;
+        int floor = car->lowest_floor + rand() % span;
+        floor = (floor == 0) ? 1 : floor;
+        car_update_status(car, statuses[rand() % 5], floor, floor, (int64_t)i * 1000, &next);
+        for (int calls = rand() % 4; calls > 0; calls--) {
+            int from = 1 + rand() % 20, to = 1 + rand() % 20;
+            if (from != to) {
+                add_to_car_queue(car, from, to);
+            }
+        }
+        car_dispatch_call(car, &next);
+    }
+
+    // Pruning by the bound picks the same car as costing every car in order
+    for (int call = 0; call < 200; call++) {
+        int from = -3 + rand() % 34, to = -3 + rand() % 34;
+        if (from == 0 || to == 0 || from == to) {
+            continue;
+        }
+        connectedcar_t *expected = NULL;
+        int64_t expected_cost = 0, cost = -1;
+        for (size_t i = 0; i < controller.size; i++) {
+            connectedcar_t *car = &controller.data[i];
+            if (!can_service_request(car, from, to) || car->queue_length + 2 > MAX_QUEUE_SIZE) {
+                continue;
+            }
+            int64_t car_cost = car_call_cost(car, from, to);
+            if (expected == NULL || car_cost < expected_cost) {
+                expected = car;
+                expected_cost = car_cost;
+            }
+        }
+        assert(controller_best_car(&controller, from, to, &cost) == expected);
+        assert(expected == NULL || cost == expected_cost);
+        if (expected != NULL && call % 3 == 0) {
+            controller_assign_call(&controller, from, to);
+        }
+    }
+    controller_destroy(&controller);
+}
+
+void test_car_queue_on_the_way() {
+    connectedcar_t car;
+    connectedcar_init(&car, "Alpha", 1, 10, 3);
+    int next;
+
+    car_update_status(&car, "Closed", 8, 8, 0, &next);
+    assert(add_to_car_queue(&car, 7, 4));
+    car_update_status(&car, "Closing", 8, 7, 0, &next);
+
+    // Picked up and dropped off on the way down
+    assert(add_to_car_queue(&car, 6, 5));
+    int expected[] = {7, 6, 5, 4};
+    for (int i = 0; i < 4; i++) {
+        assert(get_next_destination(&car) == expected[i]);
+        remove_from_car_queue(&car);
+    }
+}
+
+void test_car_delay_estimate() {
+    connectedcar_t car;
+    connectedcar_init(&car, "Alpha", 1, 4, 3);
+    int next;
+
+    assert(car_delay_estimate(&car) == DEFAULT_CAR_DELAY_MS);
+    car_update_status(&car, "Opening", 1, 1, 1000, &next);
+    car_update_status(&car, "Open", 1, 1, 1040, &next);
+    assert(car_delay_estimate(&car) == 40);
+
+    // Held open for longer than a delay, which says nothing about the car
+    car_update_status(&car, "Closing", 1, 1, 5000, &next);
+    assert(car_delay_estimate(&car) == 40);
+    car_update_status(&car, "Closed", 1, 1, 5080, &next);
+    assert(car_delay_estimate(&car) == 50);
+}
+
+void test_simulation_single_trip() {
+    sim_config_t config = {1, 1, 4, 100, 0};
+    sim_passenger_t passenger = {0};
+    passenger.from = 1;
+    passenger.to = 3;
+    sim_summary_t summary;
+    assert(simulation_run(&config, &passenger, 1, &summary));
+    assert(summary.arrived == 1 && summary.unfinished == 0);
+    assert(passenger.state == PASSENGER_ARRIVED);
+
+    // Doors open in one delay, then close, move two floors and open again
+    assert(passenger.wait_us == 100000);
+    assert(passenger.ride_us == 500000);
+}
+
+void test_workload_generate() {
+    workload_t workload;
+    workload_call_t *a, *b;
+    size_t count_a, count_b;
+    unsigned int seed_a = 7, seed_b = 7;
+    assert(workload_init(&workload, PROFILE_UNIFORM, -2, 3, 1000, 2000, 50));
+    assert(workload_generate(&workload, &seed_a, &a, &count_a));
+    assert(workload_generate(&workload, &seed_b, &b, &count_b));
+
+    // The same seed gives the same calls, in time order and on real floors
+    assert(count_a == 50 && count_b == 50);
+    assert(memcmp(a, b, 50 * sizeof(workload_call_t)) == 0);
+    for (int i = 0; i < 50; i++) {
+        assert(a[i].from != a[i].to && a[i].from != 0 && a[i].to != 0);
+        assert(a[i].from >= -2 && a[i].from <= 3 && a[i].to >= -2 && a[i].to <= 3);
+        assert(a[i].time_us >= 1000 && a[i].time_us <= 2000);
+        assert(i == 0 || a[i].time_us >= a[i - 1].time_us);
+    }
+    free(a);
+    free(b);
+    workload_destroy(&workload);
+}
+
+void test_workload_profiles() {
+    workload_t workload;
+    workload_call_t *calls;
+    size_t count;
+    unsigned int seed = 1;
+    workload_profile_t profile;
+    assert(workload_profile_from_name("up-peak", &profile) && profile == PROFILE_UP_PEAK);
+    assert(!workload_profile_from_name("rush", &profile));
+
+    // About 60 calls a minute for ten minutes, mostly from the lobby
+    assert(workload_init(&workload, profile, 1, 10, 0, 600000000, 0));
+    workload_set_poisson(&workload, 60);
+    assert(workload_generate(&workload, &seed, &calls, &count));
+    assert(count > 500 && count < 700);
+    size_t from_lobby = 0;
+    for (size_t i = 0; i < count; i++) {
+        assert(calls[i].time_us >= 0 && calls[i].time_us <= 600000000);
+        assert(i == 0 || calls[i].time_us >= calls[i - 1].time_us);
+        from_lobby += (calls[i].from == 1);
+    }
+    assert(from_lobby > count * 7 / 10);
+    free(calls);
+
+    // Floor 5 never picked once its weight is zero
+    assert(workload_parse_weights(&workload, "5:0,B1:1") == false);
+    assert(workload_parse_weights(&workload, "5:0,10:4"));
+    assert(workload_generate(&workload, &seed, &calls, &count));
+    for (size_t i = 0; i < count; i++) {
+        assert(calls[i].from != 5 && calls[i].to != 5);
+    }
+    free(calls);
+    workload_destroy(&workload);
+}
+
+void test_workload_trace() {
+    workload_call_t written[3] = {{1500, -1, 3}, {0, 1, 2}, {2000000, 4, 1}};
+    workload_call_t *calls;
+    size_t count;
+    FILE *file = tmpfile();
+    assert(file != NULL);
+    workload_write_trace(file, written, 3);
+    fprintf(file, "\n# comment\n");
+    rewind(file);
+
+    // Read back in time order
+    assert(workload_read_trace(file, &calls, &count));
+    assert(count == 3);
+    assert(calls[0].time_us == 0 && calls[0].from == 1 && calls[0].to == 2);
+    assert(calls[1].time_us == 1500 && calls[1].from == -1 && calls[1].to == 3);
+    assert(calls[2].time_us == 2000000 && calls[2].from == 4 && calls[2].to == 1);
+    free(calls);
+    fclose(file);
+}
+
+void test_protocol_round_trip() {
+    message_t messages[] = {
+        {.type = MSG_CALL, .floor = {-1, 15}},
+        {.type = MSG_CAR, .floor = {1, 20}, .name = "Alpha"},
+        {.type = MSG_STATUS, .status = Closing, .floor = {7, 9}},
+        {.type = MSG_FLOOR, .floor = {-99}},
+        {.type = MSG_ASSIGNED, .name = "Alpha"},
+        {.type = MSG_UNAVAILABLE},
+        {.type = MSG_EMERGENCY},
+        {.type = MSG_SERVICE},
+    };
+    char frame[PROTOCOL_MAX_FRAME];
+    message_t decoded;
+
+    // Both encodings decode back to the same message, and only binary is flagged
+    for (size_t i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+        for (int binary = 0; binary < 2; binary++) {
+            size_t length = protocol_encode(&messages[i], binary, frame);
+            assert(length > 0 && length < PROTOCOL_MAX_FRAME);
+            assert(protocol_decode(frame, length, &decoded));
+            assert(decoded.type == messages[i].type);
+            assert(decoded.binary == binary);
+            assert(decoded.status == messages[i].status);
+            assert(decoded.floor[0] == messages[i].floor[0]);
+            assert(decoded.floor[1] == messages[i].floor[1]);
+            assert(strcmp(decoded.name, messages[i].name) == 0);
+        }
+    }
+
+    // The text form matches the original commands
+    size_t length = protocol_encode(&messages[2], false, frame);
+    assert(length == strlen("STATUS Closing 7 9") && strncmp(frame, "STATUS Closing 7 9", length) == 0);
+    assert(protocol_encode(&messages[2], true, frame) == 6);
+
+    // Binary floors a label can't name are rejected
+    int16_t bad_floors[] = {0, FLOOR_LOWEST - 1, FLOOR_HIGHEST + 1, INT16_MIN};
+    for (size_t i = 0; i < sizeof(bad_floors) / sizeof(bad_floors[0]); i++) {
+        message_t car = {.type = MSG_CAR, .floor = {1, bad_floors[i]}, .name = "Alpha"};
+        length = protocol_encode(&car, true, frame);
+        assert(!protocol_decode(frame, length, &decoded));
+    }
+
+    // And so are text labels that aren't floors
+    const char *bad_text[] = {"CALL X 5", "CALL 1 B0", "CAR Alpha 1 07", "STATUS Closed 1 -1", "FLOOR 0"};
+    for (size_t i = 0; i < sizeof(bad_text) / sizeof(bad_text[0]); i++) {
+        assert(!protocol_decode(bad_text[i], strlen(bad_text[i]), &decoded));
+    }
+    assert(protocol_decode("CAR Alpha B99 999", strlen("CAR Alpha B99 999"), &decoded));
+    assert(decoded.floor[0] == FLOOR_LOWEST && decoded.floor[1] == FLOOR_HIGHEST);
+}
+
+void test_protocol_negotiation() {
+    message_t decoded;
+    const char *text[] = {"CAR A 1 20 BINARY", "CALL B2 3 BINARY", "CAR A 1 20", "CALL 1 5"};
+    for (int i = 0; i < 4; i++) {
+        assert(protocol_decode(text[i], strlen(text[i]), &decoded));
+        assert(decoded.binary == (i < 2));
+    }
+    assert(protocol_decode("CALL B2 3 BINARY", 16, &decoded) && decoded.floor[0] == -2 && decoded.floor[1] == 3);
+
+    // Unknown opcodes, wrong lengths and bad statuses are rejected
+    const char bad_opcode[] = {MSG_TYPE_COUNT, 0, 1};
+    const char short_call[] = {MSG_CALL, 0, 1, 0};
+    const char long_floor[] = {MSG_FLOOR, 0, 1, 0};
+    const char bad_status[] = {MSG_STATUS, NUM_STATUSES, 0, 1, 0, 2};
+    assert(!protocol_decode(bad_opcode, sizeof(bad_opcode), &decoded));
+    assert(!protocol_decode(short_call, sizeof(short_call), &decoded));
+    assert(!protocol_decode(long_floor, sizeof(long_floor), &decoded));
+    assert(!protocol_decode(bad_status, sizeof(bad_status), &decoded));
+    assert(!protocol_decode("STATUS Flying 1 2", 17, &decoded));
+    assert(!protocol_decode("", 0, &decoded));
+}
+
+void test_protocol_status_report() {
+    car_shared_data_t data;
+    message_t last, report;
+    memset(&data, 0, sizeof(data));
+    memset(&last, 0, sizeof(last));
+    strcpy(data.status, "Closed");
+    strcpy(data.current_floor, "B1");
+    strcpy(data.destination_floor, "B1");
+
+    // The first report is the whole STATUS, then nothing until a change
+    assert(protocol_status_report(&data, &last, true, false, &report));
+    assert(report.type == MSG_STATUS && report.status == Closed && report.floor[0] == -1);
+    assert(!protocol_status_report(&data, &last, true, false, &report));
+
+    // A door step leaves out the floors in binary, but not in text
+    strcpy(data.status, "Opening");
+    assert(protocol_status_report(&data, &last, true, false, &report));
+    assert(report.type == MSG_STATUS_ONLY && report.status == Opening);
+    strcpy(data.status, "Open");
+    assert(protocol_status_report(&data, &last, false, false, &report));
+    assert(report.type == MSG_STATUS && report.status == Open);
+
+    // A floor change and a heartbeat are always the whole STATUS
+    strcpy(data.destination_floor, "3");
+    assert(protocol_status_report(&data, &last, true, false, &report));
+    assert(report.type == MSG_STATUS && report.floor[1] == 3);
+    assert(protocol_status_report(&data, &last, true, true, &report));
+    assert(report.type == MSG_STATUS && report.status == Open && report.floor[0] == -1 && report.floor[1] == 3);
+
+    // A corrupt status isn't reported, even as a heartbeat
+    strcpy(data.status, "Asdfghj");
+    assert(!protocol_status_report(&data, &last, false, true, &report));
+    assert(last.status == Open);
+
+    char frame[PROTOCOL_MAX_FRAME];
+    message_t doors = {.type = MSG_STATUS_ONLY, .status = Closing};
+    assert(protocol_encode(&doors, true, frame) == 2);
+    assert(protocol_decode(frame, 2, &report) && report.type == MSG_STATUS_ONLY && report.status == Closing);
+}
+
+void test_safety_check() {
+    car_shared_data_t data;
+    safety_state_t state;
+    memset(&data, 0, sizeof(data));
+    memset(&state, 0, sizeof(state));
+    strcpy(data.status, "Closing");
+    strcpy(data.current_floor, "2");
+    strcpy(data.destination_floor, "4");
+
+    // The first check covers every field
+    assert(safety_check(&state, &data, SHM_DIRTY_ALL) == 0);
+
+    // An obstruction reopens closing doors
+    data.door_obstruction = 1;
+    assert(safety_check(&state, &data, SHM_DIRTY_DOOR_OBSTRUCTION) == 0);
+    assert(strcmp(data.status, "Opening") == 0 && data.open_button == 1);
+
+    // Unmarked changes are found by comparing with the last check
+    data.door_obstruction = 0;
+    strcpy(data.destination_floor, "X");
+    assert(safety_check(&state, &data, 0) == (SAFETY_DATA_ERROR | SAFETY_FLOOR_ERROR));
+    assert(data.emergency_mode == 1 && data.emergency_at != 0);
+
+    // Nothing else is reported during emergency mode, and everything is
+    // rechecked when it ends
+    data.emergency_stop = 1;
+    assert(safety_check(&state, &data, SHM_DIRTY_EMERGENCY_STOP) == 0);
+    data.emergency_mode = 0;
+    assert(safety_check(&state, &data, 0) == SAFETY_EMERGENCY_STOP);
+    assert(data.emergency_mode == 1);
+}
+
 int main() {
     test_controller_init();
     test_controller_ensure_capacity();
@@ -162,6 +839,29 @@ int main() {
     test_controller_clear();
     test_controller_copy();
     test_controller_foreach();
+    test_controller_index_after_growth();
+    test_controller_index_after_remove();
+    test_controller_duplicate_name();
+    test_car_queue_order();
+    test_car_queue_capacity();
+    test_car_stop_bits();
+    test_floor_codec();
+    test_cartimer();
+    test_car_snapshot();
+    test_edit_batch();
+    test_car_status_dispatch();
+    test_call_cost_prefers_passing_car();
+    test_best_car_matches_full_costing();
+    test_car_queue_on_the_way();
+    test_car_delay_estimate();
+    test_simulation_single_trip();
+    test_workload_generate();
+    test_workload_profiles();
+    test_workload_trace();
+    test_protocol_round_trip();
+    test_protocol_negotiation();
+    test_protocol_status_report();
+    test_safety_check();
 
     printf("All tests passed!\n");
     return 0;
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+#include "workload.h"
+
+/**
+ * Writes a workload as a trace file, so the same passengers can be replayed
+ * against the real cars (Test/test-sched --trace) and the simulators
+ * (sim --trace).
+ *
+ * Usage: tracegen [--profile name] [--num-passengers n] [--rate calls/min]
+ *                 [--lowest-floor floor] [--highest-floor floor]
+ *                 [--sim-start ms] [--sim-end ms] [--weights floor:weight,...]
+ *                 [--seed n] [--output file]
+ *
+ * Without --rate, --num-passengers calls are made at uniformly random times
+ * between --sim-start and --sim-end. The trace goes to stdout unless
+ * --output is given.
+ */
+
+#define NUM_PASSENGERS  10
+#define LOWEST_FLOOR    "1"
+#define HIGHEST_FLOOR   "4"
+#define SIM_START       40    // milliseconds
+#define SIM_END         1000  // milliseconds
+
+static const char *profile = "uniform";
+static int num_passengers = NUM_PASSENGERS;
+static double rate = 0;
+static const char *lowest_floor = LOWEST_FLOOR;
+static const char *highest_floor = HIGHEST_FLOOR;
+static int sim_start = SIM_START;
+static int sim_end = SIM_END;
+static const char *weights = NULL;
+static unsigned int seed = 0;
+static int seeded = 0;
+static const char *output = NULL;
+
+static void init_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(argv[i], "--profile") == 0) profile = argv[i + 1];
+        else if (strcmp(argv[i], "--num-passengers") == 0) num_passengers = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--rate") == 0) rate = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--lowest-floor") == 0) lowest_floor = argv[i + 1];
+        else if (strcmp(argv[i], "--highest-floor") == 0) highest_floor = argv[i + 1];
+        else if (strcmp(argv[i], "--sim-start") == 0) sim_start = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--sim-end") == 0) sim_end = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--weights") == 0) weights = argv[i + 1];
+        else if (strcmp(argv[i], "--output") == 0) output = argv[i + 1];
+        else if (strcmp(argv[i], "--seed") == 0) {
+            seed = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+            seeded = 1;
+        } else {
+            fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    init_args(argc, argv);
+
+    workload_t workload;
+    workload_profile_t traffic;
+    if (!workload_profile_from_name(profile, &traffic)) {
+        fprintf(stderr, "Unknown profile: %s\n", profile);
+        exit(EXIT_FAILURE);
+    }
+    if (num_passengers < 0 || sim_start < 0 ||
+        !workload_init(&workload, traffic, stringToFloor((char *)lowest_floor), stringToFloor((char *)highest_floor),
+                       (int64_t)sim_start * 1000, (int64_t)sim_end * 1000, (size_t)num_passengers)) {
+        fprintf(stderr, "Invalid workload parameters\n");
+        exit(EXIT_FAILURE);
+    }
+    if (weights != NULL && !workload_parse_weights(&workload, weights)) {
+        fprintf(stderr, "Invalid floor weights: %s\n", weights);
+        exit(EXIT_FAILURE);
+    }
+    if (rate > 0) {
+        workload_set_poisson(&workload, rate);
+    }
+
+    workload_call_t *calls;
+    size_t count;
+    unsigned int state = seeded ? seed : (unsigned int)time(NULL);
+    if (!workload_generate(&workload, &state, &calls, &count)) {
+        exit(EXIT_FAILURE);
+    }
+    workload_destroy(&workload);
+
+    FILE *file = stdout;
+    if (output != NULL && (file = fopen(output, "w")) == NULL) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    workload_write_trace(file, calls, count);
+    if (file != stdout) {
+        fclose(file);
+    }
+    free(calls);
+    return 0;
+}
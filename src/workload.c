@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include "sharedmemory.h"
+#include "workload.h"
+
+/**
+ * The kinds of trip the profiles mix.
+ */
+typedef enum {
+    TRIP_ANY,            // Any floor to any other
+    TRIP_FROM_LOBBY,
+    TRIP_TO_LOBBY,
+    TRIP_INTERFLOOR      // Between two floors that aren't the lobby
+} trip_t;
+
+static const char *profile_names[] = {
+    "uniform",    // PROFILE_UNIFORM
+    "up-peak",    // PROFILE_UP_PEAK
+    "down-peak",  // PROFILE_DOWN_PEAK
+    "lunch",      // PROFILE_LUNCH
+    "interfloor"  // PROFILE_INTERFLOOR
+};
+
+#define PROFILE_COUNT (sizeof(profile_names) / sizeof(profile_names[0]))
+
+bool workload_profile_from_name(const char *name, workload_profile_t *profile) {
+    for (size_t i = 0; i < PROFILE_COUNT; i++) {
+        if (strcmp(name, profile_names[i]) == 0) {
+            *profile = (workload_profile_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *workload_profile_name(workload_profile_t profile) {
+    return ((size_t)profile < PROFILE_COUNT) ? profile_names[profile] : "unknown";
+}
+
+bool workload_init(workload_t *workload, workload_profile_t profile, int lowest_floor, int highest_floor,
+                   int64_t start_us, int64_t end_us, size_t count) {
+    memset(workload, 0, sizeof(*workload));
+    if (lowest_floor == INT_MIN || highest_floor == INT_MIN || lowest_floor >= highest_floor || end_us < start_us) {
+        return false;
+    }
+    workload->profile = profile;
+    workload->arrivals = ARRIVALS_UNIFORM;
+    workload->lowest_floor = lowest_floor;
+    workload->highest_floor = highest_floor;
+    workload->lobby_floor = (lowest_floor <= 1 && highest_floor >= 1) ? 1 : lowest_floor;
+    workload->start_us = start_us;
+    workload->end_us = end_us;
+    workload->count = count;
+
+    size_t floors = (size_t)(highest_floor - lowest_floor + 1);
+    workload->weights = malloc(floors * sizeof(double));
+    if (workload->weights == NULL) {
+        perror("malloc");
+        return false;
+    }
+    for (size_t i = 0; i < floors; i++) {
+        workload->weights[i] = 1.0;
+    }
+    return true;
+}
+
+void workload_set_poisson(workload_t *workload, double rate_per_minute) {
+    workload->arrivals = ARRIVALS_POISSON;
+    workload->rate_per_minute = rate_per_minute;
+}
+
+bool workload_parse_weights(workload_t *workload, const char *spec) {
+    const char *p = spec;
+    while (*p != '\0') {
+        char label[4];
+        double weight;
+        int used;
+        if (sscanf(p, "%3[^:,]:%lf%n", label, &weight, &used) != 2 || weight < 0) {
+            return false;
+        }
+        int floor = stringToFloor(label);
+        if (floor == INT_MIN || floor < workload->lowest_floor || floor > workload->highest_floor) {
+            return false;
+        }
+        workload->weights[floor - workload->lowest_floor] = weight;
+        p += used;
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+void workload_destroy(workload_t *workload) {
+    free(workload->weights);
+    workload->weights = NULL;
+}
+
+// A uniform random number in [0, 1)
+static double random_unit(unsigned int *seed) {
+    return (double)rand_r(seed) / ((double)RAND_MAX + 1);
+}
+
+static trip_t pick_trip(workload_profile_t profile, unsigned int *seed) {
+    double u = random_unit(seed);
+    switch (profile) {
+        case PROFILE_UP_PEAK:
+            return (u < 0.8) ? TRIP_FROM_LOBBY : (u < 0.9) ? TRIP_TO_LOBBY : TRIP_INTERFLOOR;
+        case PROFILE_DOWN_PEAK:
+            return (u < 0.8) ? TRIP_TO_LOBBY : (u < 0.9) ? TRIP_FROM_LOBBY : TRIP_INTERFLOOR;
+        case PROFILE_LUNCH:
+            return (u < 0.4) ? TRIP_TO_LOBBY : (u < 0.8) ? TRIP_FROM_LOBBY : TRIP_INTERFLOOR;
+        case PROFILE_INTERFLOOR:
+            return TRIP_INTERFLOOR;
+        default:
+            return TRIP_ANY;
+    }
+}
+
+/**
+ * Pick a floor by weight, skipping floor 0 and up to two excluded floors.
+ *
+ * @return The floor, or INT_MIN if every floor left has no weight.
+ */
+static int pick_floor(const workload_t *workload, unsigned int *seed, int exclude, int exclude_too) {
+    double total = 0;
+    for (int floor = workload->lowest_floor; floor <= workload->highest_floor; floor++) {
+        if (floor != 0 && floor != exclude && floor != exclude_too) {
+            total += workload->weights[floor - workload->lowest_floor];
+        }
+    }
+    if (total <= 0) {
+        return INT_MIN;
+    }
+
+    double target = random_unit(seed) * total;
+    int picked = INT_MIN;
+    for (int floor = workload->lowest_floor; floor <= workload->highest_floor; floor++) {
+        double weight = workload->weights[floor - workload->lowest_floor];
+        if (floor == 0 || floor == exclude || floor == exclude_too || weight <= 0) {
+            continue;
+        }
+        picked = floor;
+        if (target < weight) {
+            break;
+        }
+        target -= weight;
+    }
+    return picked;
+}
+
+static void make_trip(const workload_t *workload, unsigned int *seed, workload_call_t *call) {
+    int lobby = workload->lobby_floor;
+    int from = INT_MIN, to = INT_MIN;
+
+    switch (pick_trip(workload->profile, seed)) {
+        case TRIP_FROM_LOBBY:
+            from = lobby;
+            to = pick_floor(workload, seed, lobby, INT_MIN);
+            break;
+        case TRIP_TO_LOBBY:
+            from = pick_floor(workload, seed, lobby, INT_MIN);
+            to = lobby;
+            break;
+        case TRIP_INTERFLOOR:
+            from = pick_floor(workload, seed, lobby, INT_MIN);
+            to = pick_floor(workload, seed, lobby, from);
+            break;
+        default:
+            break;
+    }
+    if (from == INT_MIN || to == INT_MIN) {
+        // Not enough weighted floors for that kind of trip, so take any
+        from = pick_floor(workload, seed, INT_MIN, INT_MIN);
+        to = pick_floor(workload, seed, from, INT_MIN);
+    }
+    if (from == INT_MIN || to == INT_MIN) {
+        from = workload->lowest_floor;
+        to = workload->highest_floor;
+    }
+    call->from = from;
+    call->to = to;
+}
+
+static int compare_calls(const void *a, const void *b) {
+    int64_t x = ((const workload_call_t *)a)->time_us, y = ((const workload_call_t *)b)->time_us;
+    return (x > y) - (x < y);
+}
+
+bool workload_generate(const workload_t *workload, unsigned int *seed, workload_call_t **calls, size_t *count) {
+    size_t capacity = (workload->arrivals == ARRIVALS_UNIFORM) ? workload->count : 64;
+    workload_call_t *list = malloc((capacity > 0 ? capacity : 1) * sizeof(workload_call_t));
+    size_t n = 0;
+    if (list == NULL) {
+        perror("malloc");
+        return false;
+    }
+
+    if (workload->arrivals == ARRIVALS_UNIFORM) {
+        for (; n < workload->count; n++) {
+            double span = (double)(workload->end_us - workload->start_us + 1);
+            list[n].time_us = workload->start_us + (int64_t)(random_unit(seed) * span);
+            make_trip(workload, seed, &list[n]);
+        }
+        qsort(list, n, sizeof(workload_call_t), compare_calls);
+    } else if (workload->rate_per_minute > 0) {
+        // Exponential gaps between calls, mean 60 s / rate
+        double mean_gap_us = 60e6 / workload->rate_per_minute;
+        double time = (double)workload->start_us;
+        for (;;) {
+            time += -log(1.0 - random_unit(seed)) * mean_gap_us;
+            if (time > (double)workload->end_us) {
+                break;
+            }
+            if (n == capacity) {
+                capacity *= 2;
+                workload_call_t *grown = realloc(list, capacity * sizeof(workload_call_t));
+                if (grown == NULL) {
+                    perror("realloc");
+                    free(list);
+                    return false;
+                }
+                list = grown;
+            }
+            list[n].time_us = (int64_t)time;
+            make_trip(workload, seed, &list[n]);
+            n++;
+        }
+    }
+
+    *calls = list;
+    *count = n;
+    return true;
+}
+
+bool workload_read_trace(FILE *file, workload_call_t **calls, size_t *count) {
+    size_t capacity = 64, n = 0;
+    workload_call_t *list = malloc(capacity * sizeof(workload_call_t));
+    char line[256];
+    if (list == NULL) {
+        perror("malloc");
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+
+        double time_ms;
+        char from[4], to[4];
+        if (sscanf(p, "%lf %3s %3s", &time_ms, from, to) != 3 || time_ms < 0) {
+            fprintf(stderr, "Invalid trace line: %s", line);
+            free(list);
+            return false;
+        }
+        workload_call_t call = {(int64_t)llround(time_ms * 1000.0), stringToFloor(from), stringToFloor(to)};
+        if (call.from == INT_MIN || call.to == INT_MIN || call.from == call.to) {
+            fprintf(stderr, "Invalid trace line: %s", line);
+            free(list);
+            return false;
+        }
+
+        if (n == capacity) {
+            capacity *= 2;
+            workload_call_t *grown = realloc(list, capacity * sizeof(workload_call_t));
+            if (grown == NULL) {
+                perror("realloc");
+                free(list);
+                return false;
+            }
+            list = grown;
+        }
+        list[n++] = call;
+    }
+
+    qsort(list, n, sizeof(workload_call_t), compare_calls);
+    *calls = list;
+    *count = n;
+    return true;
+}
+
+void workload_write_trace(FILE *file, const workload_call_t *calls, size_t count) {
+    fprintf(file, "# time_ms from to\n");
+    for (size_t i = 0; i < count; i++) {
+        char from[4], to[4];
+        floorToString(from, calls[i].from);
+        floorToString(to, calls[i].to);
+        fprintf(file, "%.3f %s %s\n", (double)calls[i].time_us / 1000.0, from, to);
+    }
+}